@@ -0,0 +1,148 @@
+/*
+   arena.c - region based memory allocation
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* the alignment of allocated memory */
+union arena_align {
+  long l;
+  double d;
+  void *p;
+};
+#define ARENA_ALIGN (sizeof(union arena_align))
+
+/* round the size up to the alignment */
+#define ARENA_ROUND(size) \
+  (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/* a chunk of memory, the memory that is handed out follows the header */
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t size;                /* the number of bytes after the header */
+  size_t used;                /* the number of bytes handed out */
+};
+
+#define ARENA_CHUNK_HEADER ARENA_ROUND(sizeof(struct arena_chunk))
+
+/* the arena is stored in the same allocation as the first chunk */
+struct arena {
+  struct arena_chunk *current; /* the chunk that is allocated from */
+  struct arena_chunk *first;   /* the chunk that is kept on reset */
+  size_t chunksize;
+  unsigned long mallocs;
+};
+
+#define ARENA_HEADER ARENA_ROUND(sizeof(struct arena))
+
+/* initialise the chunk header */
+static struct arena_chunk *arena_chunk_init(void *buffer, size_t size)
+{
+  struct arena_chunk *chunk = (struct arena_chunk *)buffer;
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+ARENA *arena_new(size_t chunksize)
+{
+  char *buffer;
+  ARENA *arena;
+  chunksize = ARENA_ROUND(chunksize);
+  buffer = (char *)malloc(ARENA_HEADER + ARENA_CHUNK_HEADER + chunksize);
+  if (buffer == NULL)
+    return NULL;
+  arena = (ARENA *)(void *)buffer;
+  arena->first = arena_chunk_init(buffer + ARENA_HEADER, chunksize);
+  arena->current = arena->first;
+  arena->chunksize = chunksize;
+  arena->mallocs = 1;
+  return arena;
+}
+
+void *arena_alloc(ARENA *arena, size_t size)
+{
+  struct arena_chunk *chunk = arena->current;
+  size_t chunksize;
+  void *ptr;
+  size = ARENA_ROUND(size > 0 ? size : 1);
+  /* get a new chunk if the current one is full (large allocations get a
+     chunk of their own) */
+  if (size > (chunk->size - chunk->used))
+  {
+    chunksize = (size > arena->chunksize) ? size : arena->chunksize;
+    ptr = malloc(ARENA_CHUNK_HEADER + chunksize);
+    if (ptr == NULL)
+      return NULL;
+    arena->mallocs++;
+    chunk = arena_chunk_init(ptr, chunksize);
+    chunk->next = arena->current;
+    arena->current = chunk;
+  }
+  ptr = (char *)chunk + ARENA_CHUNK_HEADER + chunk->used;
+  chunk->used += size;
+  return ptr;
+}
+
+char *arena_strdup(ARENA *arena, const char *value)
+{
+  size_t len = strlen(value) + 1;
+  char *copy;
+  copy = (char *)arena_alloc(arena, len);
+  if (copy != NULL)
+    memcpy(copy, value, len);
+  return copy;
+}
+
+/* free all chunks except the first one */
+static void arena_free_chunks(ARENA *arena)
+{
+  struct arena_chunk *chunk, *next;
+  for (chunk = arena->current; chunk != arena->first; chunk = next)
+  {
+    next = chunk->next;
+    free(chunk);
+  }
+}
+
+void arena_reset(ARENA *arena)
+{
+  arena_free_chunks(arena);
+  arena->current = arena->first;
+  arena->first->used = 0;
+}
+
+void arena_free(ARENA *arena)
+{
+  arena_free_chunks(arena);
+  free(arena);
+}
+
+unsigned long arena_mallocs(ARENA *arena)
+{
+  return arena->mallocs;
+}
@@ -0,0 +1,69 @@
+/*
+   arena.h - region based memory allocation
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#ifndef COMMON__ARENA_H
+#define COMMON__ARENA_H
+
+#include <stddef.h>
+
+#include "compat/attrs.h"
+
+/*
+   These functions provide an arena (or region) from which memory can be
+   allocated that is only released in bulk. Memory is taken from large
+   chunks so most allocations do not result in a call to malloc(). This
+   is useful for memory that is only needed while handling a single
+   request.
+
+   The arena keeps the first chunk when it is reset so an arena that is
+   reused for many requests does not need to call malloc() at all as long
+   as the data for a request fits in the first chunk.
+*/
+typedef struct arena ARENA;
+
+/* Create a new arena that allocates memory in chunks of the specified
+   size. Returns NULL in case of memory allocation errors. */
+ARENA *arena_new(size_t chunksize)
+  LIKE_MALLOC MUST_USE;
+
+/* Allocate memory from the arena. The memory is suitably aligned for any
+   type and remains valid until the arena is reset or freed. Returns NULL
+   in case of memory allocation errors. */
+void *arena_alloc(ARENA *arena, size_t size)
+  MUST_USE;
+
+/* Return a copy of the string that is allocated from the arena. Returns
+   NULL in case of memory allocation errors. */
+char *arena_strdup(ARENA *arena, const char *value)
+  MUST_USE;
+
+/* Release all memory that was allocated from the arena. The first chunk
+   is kept for subsequent allocations. */
+void arena_reset(ARENA *arena);
+
+/* Free the arena and all memory that was allocated from it. */
+void arena_free(ARENA *arena);
+
+/* Return the number of times the arena called malloc(). */
+unsigned long arena_mallocs(ARENA *arena);
+
+#endif /* COMMON__ARENA_H */
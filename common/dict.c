@@ -33,156 +33,287 @@
 #include "dict.h"
 
 /*
-   This module uses a hashtable to store its key to value mappings. The
-   structure is basically as follows:
+   This module uses a hashtable with open addressing to store its key to
+   value mappings. The table is an array of slots that hold the hash of the
+   key, a reference to a copy of the key and the value, so most probes do
+   not need to follow a pointer.
 
-   [struct dictionary]
-     \- holds an array of pointers to a linked list of [struct dict_entry]
-          \- each entry has a key/value mapping
+   Collisions are resolved with linear probing using Robin Hood hashing:
+   when inserting, an entry that is further away from its home slot takes
+   the place of an entry that is closer to its home slot. This keeps probe
+   sequences short even at high load. Removal shifts the following entries
+   back one slot so no tombstones are needed.
 
-   The hashmap can be resized when the total number of elements in the hashmap
-   exceeds a certain load factor.
+   The size of the table is always a power of two and the table is grown
+   when it is more than DICT_LOADPERCENTAGE full.
 
-   All the keys are copied in a separate linked list of buffers where each new
-   buffer that is allocated is larger than the previous one. The first buffer
-   in the linked list is always the current one.
+   Dictionaries that are created with DICT_IGNORECASE or DICT_DN compare
+   keys character by character as they are normalised (see dict_keychar())
+   so no normalised copies of the keys need to be made. The key is stored
+   as it was first added.
 */
 
-/* an entry stores one key/value pair */
+/* a slot stores one key/value pair (the slot is unused if key is NULL) */
 struct dict_entry {
   uint32_t hash;      /* used for quick matching and rehashing */
   const char *key;    /* a reference to a copy of the key */
   void *value;        /* the stored value */
-  struct dict_entry *next;
 };
 
-/* the initial size of the hashtable */
-#define DICT_INITSIZE 7
+/* the initial size of the hashtable (must be a power of two) */
+#define DICT_INITSIZE 8
 
 /* load factor at which point to grow hashtable */
-#define DICT_LOADPERCENTAGE 400
+#define DICT_LOADPERCENTAGE 80
 
 /* the dictionary is a hashtable */
 struct dictionary {
-  int size;                      /* size of the hashtable */
-  int num;                       /* total number of keys stored */
-  struct dict_entry **table;     /* the hashtable */
+  uint32_t size;                 /* size of the hashtable */
+  uint32_t num;                  /* total number of keys stored */
+  uint32_t any;                  /* where dict_getany() starts looking */
+  int flags;                     /* how keys are compared */
+  struct dict_entry *table;      /* the hashtable */
 };
 
-/* Simple hash function that computes the hash value of a string. */
-static uint32_t stringhash(const char *str)
+/* state that is kept while normalising a DN */
+#define DN_SEP 1 /* the previous character was a separator (or the start) */
+#define DN_ESC 2 /* the previous character was a backslash */
+
+/* Return the next character of the key the way it should be compared,
+   this returns 0 at the end of the key. ASCII letters are converted to
+   lower case and with DICT_DN spaces around separators are skipped. The
+   state should be initialised to DN_SEP. */
+static uint32_t dict_keychar(const char **ptr, int *state, int flags)
+{
+  uint32_t c;
+  const char *p;
+  while ((c = (uint8_t)**ptr) != '\0')
+  {
+    (*ptr)++;
+    if (((flags & DICT_DN) == DICT_DN) && (!(*state & DN_ESC)))
+    {
+      if (c == ' ')
+      {
+        /* skip spaces after a separator */
+        if (*state & DN_SEP)
+          continue;
+        /* skip spaces before a separator or the end */
+        for (p = *ptr; *p == ' '; p++)
+          /* nothing */ ;
+        if ((*p == '\0') || (*p == ',') || (*p == '+') || (*p == '='))
+        {
+          *ptr = p;
+          continue;
+        }
+        *state = 0;
+        return c;
+      }
+      if (c == '\\')
+        *state = DN_ESC;
+      else if ((c == ',') || (c == '+') || (c == '='))
+        *state = DN_SEP;
+      else
+        *state = 0;
+    }
+    else
+      *state = 0;
+    if ((c >= 'A') && (c <= 'Z'))
+      c += 'a' - 'A';
+    return c;
+  }
+  return 0;
+}
+
+/* FNV-1a hash of the string with a final mix so that the low bits that
+   are used to select a slot depend on all characters */
+static uint32_t stringhash(const char *str, int flags)
 {
-  uint32_t hash = 5381;
+  uint32_t hash = 2166136261U;
   uint32_t c;
-  while ((c = *str++) != '\0')
-    hash = 33 * hash + c;
+  int state = DN_SEP;
+  if (flags == 0)
+  {
+    while ((c = (uint8_t)*str++) != '\0')
+      hash = (hash ^ c) * 16777619U;
+  }
+  else
+  {
+    while ((c = dict_keychar(&str, &state, flags)) != 0)
+      hash = (hash ^ c) * 16777619U;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bU;
+  hash ^= hash >> 13;
   return hash;
 }
 
-/* Grow the hashtable. */
-static void growhashtable(DICT *dict)
+/* compare the keys the way the dictionary does, returns 0 if they match */
+static int keycmp(const char *key1, const char *key2, int flags)
 {
-  int i;
-  int newsize;
-  struct dict_entry **newtable;
-  struct dict_entry *entry, *tmp;
-  newsize = dict->size * 3 + 1;
-  /* allocate room for new hashtable */
-  newtable = (struct dict_entry **)malloc(newsize * sizeof(struct dict_entry *));
-  if (newtable == NULL)
-    return; /* allocating memory failed continue to fill the existing table */
-  /* clear new table */
-  for (i = 0; i < newsize; i++)
-    newtable[i] = NULL;
-  /* copy old hashtable into new table */
-  for (i = 0; i < dict->size; i++)
+  uint32_t c1, c2;
+  int state1 = DN_SEP, state2 = DN_SEP;
+  if (flags == 0)
+    return strcmp(key1, key2);
+  do
   {
-    /* go over elements in linked list */
-    entry = dict->table[i];
-    while (entry != NULL)
+    c1 = dict_keychar(&key1, &state1, flags);
+    c2 = dict_keychar(&key2, &state2, flags);
+  }
+  while ((c1 == c2) && (c1 != 0));
+  return (int)c1 - (int)c2;
+}
+
+/* the distance of the entry in the slot from its home slot */
+#define DICT_DISTANCE(dict, idx)                                            \
+  (((idx) - ((dict)->table[idx].hash & ((dict)->size - 1))) &               \
+   ((dict)->size - 1))
+
+/* place the entry in the table using Robin Hood hashing, the table should
+   have at least one unused slot and not contain the key */
+static void dict_place(DICT *dict, struct dict_entry entry)
+{
+  uint32_t mask = dict->size - 1;
+  uint32_t idx = entry.hash & mask;
+  uint32_t dist = 0, other;
+  struct dict_entry tmp;
+  while (dict->table[idx].key != NULL)
+  {
+    /* take the slot of an entry that is closer to its home slot */
+    other = DICT_DISTANCE(dict, idx);
+    if (other < dist)
     {
-      tmp = entry;
-      entry = entry->next;
-      /* put in new position */
-      tmp->next = newtable[tmp->hash % newsize];
-      newtable[tmp->hash % newsize] = tmp;
+      tmp = dict->table[idx];
+      dict->table[idx] = entry;
+      entry = tmp;
+      dist = other;
     }
+    idx = (idx + 1) & mask;
+    dist++;
   }
-  /* free the old hashtable */
-  free(dict->table);
-  /* put new hashtable in place */
-  dict->size = newsize;
+  dict->table[idx] = entry;
+}
+
+/* Resize the hashtable to the specified size (a power of two that is
+   large enough to hold all entries). */
+static int resizehashtable(DICT *dict, uint32_t newsize)
+{
+  struct dict_entry *oldtable = dict->table;
+  uint32_t oldsize = dict->size;
+  uint32_t i;
+  struct dict_entry *newtable;
+  newtable = (struct dict_entry *)calloc(newsize, sizeof(struct dict_entry));
+  if (newtable == NULL)
+    return -1;
   dict->table = newtable;
+  dict->size = newsize;
+  dict->any = 0;
+  /* copy the entries into the new table */
+  for (i = 0; i < oldsize; i++)
+    if (oldtable[i].key != NULL)
+      dict_place(dict, oldtable[i]);
+  free(oldtable);
+  return 0;
+}
+
+/* find the slot that holds the key, returns -1 if it is not found */
+static int32_t dict_find(DICT *dict, const char *key, uint32_t hash)
+{
+  uint32_t mask = dict->size - 1;
+  uint32_t idx = hash & mask;
+  uint32_t dist = 0;
+  while (dict->table[idx].key != NULL)
+  {
+    /* the key would have been placed before an entry that is closer to
+       its home slot */
+    if (DICT_DISTANCE(dict, idx) < dist)
+      break;
+    if ((dict->table[idx].hash == hash) &&
+        (keycmp(dict->table[idx].key, key, dict->flags) == 0))
+      return (int32_t)idx;
+    idx = (idx + 1) & mask;
+    dist++;
+  }
+  return -1;
 }
 
 DICT *dict_new(void)
+{
+  return dict_new_flags(0);
+}
+
+DICT *dict_new_flags(int flags)
 {
   struct dictionary *dict;
-  int i;
   /* allocate room for dictionary information */
   dict = (struct dictionary *)malloc(sizeof(struct dictionary));
   if (dict == NULL)
     return NULL;
   dict->size = DICT_INITSIZE;
   dict->num = 0;
-  /* allocate initial hashtable */
-  dict->table = (struct dict_entry **)malloc(DICT_INITSIZE * sizeof(struct dict_entry *));
+  dict->any = 0;
+  dict->flags = flags;
+  /* allocate initial (cleared) hashtable */
+  dict->table = (struct dict_entry *)calloc(DICT_INITSIZE, sizeof(struct dict_entry));
   if (dict->table == NULL)
   {
     free(dict);
     return NULL;
   }
-  /* clear the hashtable */
-  for (i = 0; i < DICT_INITSIZE; i++)
-    dict->table[i] = NULL;
   /* we're done */
   return dict;
 }
 
+unsigned int dict_hash(const char *key, int flags)
+{
+  return stringhash(key, flags);
+}
+
 void dict_free(DICT *dict)
 {
-  struct dict_entry *entry, *etmp;
-  int i;
-  /* free hashtable entries */
+  uint32_t i;
+  /* free the copies of the keys */
   for (i = 0; i < dict->size; i++)
-  {
-    entry = dict->table[i];
-    while (entry != NULL)
-    {
-      etmp = entry;
-      entry = entry->next;
-      free(etmp);
-    }
-  }
+    if (dict->table[i].key != NULL)
+      free((char *)dict->table[i].key);
   /* free the hashtable */
   free(dict->table);
   /* free dictionary struct itself */
   free(dict);
 }
 
+int dict_reserve(DICT *dict, int num)
+{
+  uint32_t newsize = dict->size;
+  while ((((uint64_t)newsize * DICT_LOADPERCENTAGE) / 100) < (uint64_t)num)
+    newsize *= 2;
+  if (newsize == dict->size)
+    return 0;
+  return resizehashtable(dict, newsize);
+}
+
 void *dict_get(DICT *dict, const char *key)
 {
-  uint32_t hash;
-  struct dict_entry *entry;
-  /* calculate the hash */
-  hash = stringhash(key);
-  /* loop over the linked list in the hashtable */
-  for (entry = dict->table[hash % dict->size]; entry != NULL; entry = entry->next)
-  {
-    if ((entry->hash == hash) && (strcmp(entry->key, key) == 0))
-      return entry->value;
-  }
-  /* no matches found */
-  return NULL;
+  int32_t idx;
+  idx = dict_find(dict, key, stringhash(key, dict->flags));
+  if (idx < 0)
+    return NULL;
+  return dict->table[idx].value;
 }
 
 const char *dict_getany(DICT *dict)
 {
-  int i;
-  /* loop over the linked list in the hashtable */
+  uint32_t i, idx;
+  /* continue where the previous call left off so that repeatedly taking
+     an entry and removing it does not scan the table from the start */
   for (i = 0; i < dict->size; i++)
-    if (dict->table[i])
-      return dict->table[i]->key;
+  {
+    idx = (dict->any + i) & (dict->size - 1);
+    if (dict->table[idx].key != NULL)
+    {
+      dict->any = idx;
+      return dict->table[idx].key;
+    }
+  }
   /* no matches found */
   return NULL;
 }
@@ -190,65 +321,81 @@ const char *dict_getany(DICT *dict)
 int dict_put(DICT *dict, const char *key, void *value)
 {
   uint32_t hash;
-  int l;
-  char *buf;
-  int idx;
-  struct dict_entry *entry, *prev;
-  /* check if we should grow the hashtable */
-  if (dict->num >= ((dict->size * DICT_LOADPERCENTAGE) / 100))
-    growhashtable(dict);
-  /* calculate the hash and position in the hashtable */
-  hash = stringhash(key);
-  idx = hash % dict->size;
+  int32_t idx;
+  struct dict_entry entry;
+  char *copy;
+  size_t l;
+  /* if entry should be unset just remove it */
+  if (value == NULL)
+  {
+    (void)dict_del(dict, key);
+    return 0;
+  }
   /* check if the entry is already present */
-  for (entry = dict->table[idx], prev = NULL; entry != NULL; prev = entry, entry = entry->next)
+  hash = stringhash(key, dict->flags);
+  idx = dict_find(dict, key, hash);
+  if (idx >= 0)
   {
-    if ((entry->hash == hash) && (strcmp(entry->key, key) == 0))
+    /* just set the new value */
+    dict->table[idx].value = value;
+    return 0;
+  }
+  /* check if we should grow the hashtable */
+  if (((uint64_t)(dict->num + 1) * 100) >
+      ((uint64_t)dict->size * DICT_LOADPERCENTAGE))
+  {
+    if (resizehashtable(dict, dict->size * 2))
     {
-      /* check if we should unset the entry */
-      if (value == NULL)
-      {
-        /* remove from linked list */
-        if (prev == NULL)
-          dict->table[idx] = entry->next;
-        else
-          prev->next = entry->next;
-        /* free entry memory and register removal */
-        free(entry);
-        dict->num--;
-        return 0;
-      }
-      /* just set the new value */
-      entry->value = value;
-      return 0;
+      /* continue to fill the existing table as long as there is room */
+      if ((dict->num + 1) >= dict->size)
+        return -1;
     }
   }
-  /* if entry should be unset we're done */
-  if (value == NULL)
-    return 0;
-  /* entry is not present, make new entry */
+  /* entry is not present, make a copy of the key */
   l = strlen(key) + 1;
-  buf = (char *)malloc(sizeof(struct dict_entry) + l);
-  if (buf == NULL)
+  copy = (char *)malloc(l);
+  if (copy == NULL)
     return -1;
-  entry = (struct dict_entry *)(void *)buf;
-  buf += sizeof(struct dict_entry);
-  strcpy(buf, key);
-  entry->hash = hash;
-  entry->key = buf;
-  entry->value = value;
-  /* insert into hashtable/linked list */
-  entry->next = dict->table[idx];
-  dict->table[idx] = entry;
+  memcpy(copy, key, l);
+  entry.hash = hash;
+  entry.key = copy;
+  entry.value = value;
+  dict_place(dict, entry);
   /* increment number of stored items */
   dict->num++;
   return 0;
 }
 
+void *dict_del(DICT *dict, const char *key)
+{
+  uint32_t mask = dict->size - 1;
+  uint32_t idx, next;
+  int32_t found;
+  void *value;
+  /* find the slot with the key */
+  found = dict_find(dict, key, stringhash(key, dict->flags));
+  if (found < 0)
+    return NULL;
+  idx = (uint32_t)found;
+  value = dict->table[idx].value;
+  free((char *)dict->table[idx].key);
+  /* shift following entries that are not in their home slot back */
+  next = (idx + 1) & mask;
+  while ((dict->table[next].key != NULL) && (DICT_DISTANCE(dict, next) > 0))
+  {
+    dict->table[idx] = dict->table[next];
+    idx = next;
+    next = (next + 1) & mask;
+  }
+  dict->table[idx].key = NULL;
+  dict->table[idx].value = NULL;
+  dict->num--;
+  return value;
+}
+
 const char **dict_keys(DICT *dict)
 {
-  int i;
-  struct dict_entry *entry;
+  uint32_t i;
   char *buf;
   const char **values;
   size_t sz;
@@ -258,12 +405,10 @@ const char **dict_keys(DICT *dict)
   sz = 0;
   for (i = 0; i < dict->size; i++)
   {
-    entry = dict->table[i];
-    while (entry != NULL)
+    if (dict->table[i].key != NULL)
     {
       num++;
-      sz += strlen(entry->key) + 1;
-      entry = entry->next;
+      sz += strlen(dict->table[i].key) + 1;
     }
   }
   /* allocate the needed memory */
@@ -276,13 +421,11 @@ const char **dict_keys(DICT *dict)
   num = 0;
   for (i = 0; i < dict->size; i++)
   {
-    entry = dict->table[i];
-    while (entry != NULL)
+    if (dict->table[i].key != NULL)
     {
-      strcpy(buf, entry->key);
+      strcpy(buf, dict->table[i].key);
       values[num++] = buf;
       buf += strlen(buf) + 1;
-      entry = entry->next;
     }
   }
   values[num] = NULL;
@@ -30,21 +30,39 @@
 */
 typedef struct dictionary DICT;
 
+/* Flags that change how keys are compared. DICT_IGNORECASE ignores
+   differences in the case of ASCII letters and DICT_DN also ignores the
+   spaces around the separators in distinguished names (it implies
+   DICT_IGNORECASE). */
+#define DICT_IGNORECASE 0x01
+#define DICT_DN         0x03
+
 /* Create a new instance of a dictionary. Returns NULL
    in case of memory allocation errors. */
 DICT *dict_new(void)
   LIKE_MALLOC MUST_USE;
 
+/* Create a new instance of a dictionary that compares keys according to
+   the flags. Returns NULL in case of memory allocation errors. */
+DICT *dict_new_flags(int flags)
+  LIKE_MALLOC MUST_USE;
+
 /* Add a relation in the dictionary. The key is duplicated
    and can be reused by the caller. The pointer is just stored.
    This function returns non-zero in case of memory allocation
    errors. If the key was previously in use the value
-   is replaced. All key comparisons are case sensitive. */
+   is replaced. Passing a NULL value removes the key (see dict_del()).
+   Keys are compared according to the flags of the dictionary. */
 int dict_put(DICT *dict, const char *key, void *value);
 
+/* Make room in the dictionary for the specified total number of keys
+   so that adding them does not need to grow the hashtable repeatedly.
+   This function returns non-zero in case of memory allocation errors. */
+int dict_reserve(DICT *dict, int num);
+
 /* Look up a key in the dictionary and return the associated
    value. NULL is returned if the key is not found in the dictionary.
-   All key comparisons are case sensitive. */
+   Keys are compared according to the flags of the dictionary. */
 void *dict_get(DICT *dict, const char *key)
   MUST_USE;
 
@@ -53,9 +71,17 @@ void *dict_get(DICT *dict, const char *key)
    is called). */
 const char *dict_getany(DICT *dict);
 
-/* Delete a key-value association from the dictionary.
-   All key comparisons are case sensitive. */
-/*void dict_del(DICT *dict, const char *key);*/
+/* Delete a key-value association from the dictionary and return the
+   value that was associated with the key (NULL if the key was not found).
+   The caller is responsible for freeing the value.
+   Keys are compared according to the flags of the dictionary. */
+void *dict_del(DICT *dict, const char *key);
+
+/* Return the hash of the key as it is used by a dictionary that was
+   created with the flags. This can be used to spread keys over a number
+   of dictionaries. */
+unsigned int dict_hash(const char *key, int flags)
+  MUST_USE;
 
 /* Remove the dictionary from memory. All allocated storage
    for the dictionary and the keys is freed.
@@ -337,8 +337,13 @@ TFILE *nslcd_client_open(void)
 
 /* generic request code */
 #define NSLCD_REQUEST(fp, action, writefn)                                  \
+  NSLCD_REQUEST_ON(fp, nslcd_client_open(), action, writefn)
+
+/* generic request code that uses the stream that is returned by openfn,
+   this may be a stream that was used for an earlier request */
+#define NSLCD_REQUEST_ON(fp, openfn, action, writefn)                       \
   /* open a client socket */                                                \
-  if ((fp = nslcd_client_open()) == NULL)                                   \
+  if ((fp = openfn) == NULL)                                                \
   {                                                                         \
     ERROR_OUT_OPENERROR;                                                    \
   }                                                                         \
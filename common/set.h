@@ -36,14 +36,24 @@ typedef struct set SET;
 SET *set_new(void)
   LIKE_MALLOC MUST_USE;
 
+/* Flags that change how values are compared (the same as those of
+   dict_new_flags()). */
+#define SET_IGNORECASE 0x01
+#define SET_DN         0x03
+
+/* Create a new instance of a set that compares values according to the
+   flags. Returns NULL in case of memory allocation errors. */
+SET *set_new_flags(int flags)
+  LIKE_MALLOC MUST_USE;
+
 /* Add a string in the set. The value is duplicated
    and can be reused by the caller.
    This function returns non-zero in case of memory allocation
-   errors. All value comparisons are case sensitive. */
+   errors. Values are compared according to the flags of the set. */
 int set_add(SET *set, const char *value);
 
 /* Return non-zero if the value is in the set.
-   All value comparisons are case sensitive. */
+   Values are compared according to the flags of the set. */
 int set_contains(SET *set, const char *value)
   MUST_USE;
 
@@ -0,0 +1,354 @@
+/*
+   shmcache.c - shared memory lookup cache
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "shmcache.h"
+
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+
+/* magic value and version of the file format */
+#define SHMCACHE_MAGIC 0x6e736c63
+#define SHMCACHE_VERSION 1
+
+/* the number of consecutive slots that are checked for a key */
+#define SHMCACHE_PROBES 4
+
+/* the header at the start of the file (padded to a full slot) */
+struct shmcache_header {
+  uint32_t magic;    /* SHMCACHE_MAGIC or 0 if the file is no longer used */
+  uint32_t version;  /* SHMCACHE_VERSION */
+  uint32_t numslots; /* the number of slots following the header */
+  uint32_t slotsize; /* the size of each slot */
+};
+
+/* a single slot, the data contains the key followed by the result */
+struct shmcache_slot {
+  uint32_t seq;      /* sequence number that is odd during updates */
+  int32_t action;    /* the request action (0 for unused slots) */
+  int64_t expire;    /* the time the result is valid until */
+  uint32_t keylen;   /* the length of the key */
+  uint32_t datalen;  /* the length of the result */
+  uint8_t data[SHMCACHE_MAXDATA];
+};
+
+/* the mapped cache file */
+struct shmcache {
+  uint8_t *map;
+  size_t size;
+  uint32_t numslots;
+};
+
+/* get a pointer to the header of the cache */
+#define HEADER(cache) ((volatile struct shmcache_header *)(cache)->map)
+
+/* get a pointer to the specified slot of the cache */
+#define SLOT(cache, idx)                                                    \
+  ((volatile struct shmcache_slot *)((cache)->map +                         \
+                                     (1 + (size_t)(idx)) * SHMCACHE_SLOTSIZE))
+
+/* FNV-1a hash of the action and key */
+static uint32_t shmcache_hash(int32_t action, const void *key, size_t keylen)
+{
+  uint32_t hash = 2166136261U;
+  const uint8_t *ptr;
+  size_t i;
+  ptr = (const uint8_t *)&action;
+  for (i = 0; i < sizeof(int32_t); i++)
+    hash = (hash ^ ptr[i]) * 16777619U;
+  ptr = (const uint8_t *)key;
+  for (i = 0; i < keylen; i++)
+    hash = (hash ^ ptr[i]) * 16777619U;
+  return hash;
+}
+
+/* map the file and check the header */
+static SHMCACHE *shmcache_map(int fd, int prot)
+{
+  SHMCACHE *cache;
+  struct stat sb;
+  void *map;
+  volatile struct shmcache_header *header;
+  if (fstat(fd, &sb) != 0)
+    return NULL;
+  if (sb.st_size < (off_t)SHMCACHE_SLOTSIZE)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+  map = mmap(NULL, (size_t)sb.st_size, prot, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return NULL;
+  header = (volatile struct shmcache_header *)map;
+  /* check that the file is a valid cache file */
+  if ((header->magic != SHMCACHE_MAGIC) ||
+      (header->version != SHMCACHE_VERSION) ||
+      (header->slotsize != SHMCACHE_SLOTSIZE) ||
+      ((off_t)((1 + (size_t)header->numslots) * SHMCACHE_SLOTSIZE) > sb.st_size))
+  {
+    (void)munmap(map, (size_t)sb.st_size);
+    errno = EINVAL;
+    return NULL;
+  }
+  cache = (SHMCACHE *)malloc(sizeof(SHMCACHE));
+  if (cache == NULL)
+  {
+    (void)munmap(map, (size_t)sb.st_size);
+    return NULL;
+  }
+  cache->map = (uint8_t *)map;
+  cache->size = (size_t)sb.st_size;
+  cache->numslots = header->numslots;
+  return cache;
+}
+
+SHMCACHE *shmcache_create(const char *filename, unsigned int numslots)
+{
+  char tmpname[256];
+  int fd;
+  size_t size;
+  void *map;
+  struct shmcache_header *header;
+  SHMCACHE *cache;
+  if (numslots == 0)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+  /* invalidate the existing file for processes that still have it mapped */
+  shmcache_remove(filename);
+  /* create a new file */
+  if (snprintf(tmpname, sizeof(tmpname), "%s.new", filename) >= (int)sizeof(tmpname))
+  {
+    errno = ENAMETOOLONG;
+    return NULL;
+  }
+  (void)unlink(tmpname);
+  fd = open(tmpname, O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return NULL;
+  size = (1 + (size_t)numslots) * SHMCACHE_SLOTSIZE;
+  /* the file is created sparse so only used slots take up space */
+  if ((fchmod(fd, 0644) != 0) || (ftruncate(fd, (off_t)size) != 0))
+  {
+    (void)close(fd);
+    (void)unlink(tmpname);
+    return NULL;
+  }
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  (void)close(fd);
+  if (map == MAP_FAILED)
+  {
+    (void)unlink(tmpname);
+    return NULL;
+  }
+  /* write the header (the magic last) */
+  header = (struct shmcache_header *)map;
+  header->version = SHMCACHE_VERSION;
+  header->numslots = numslots;
+  header->slotsize = SHMCACHE_SLOTSIZE;
+  __sync_synchronize();
+  header->magic = SHMCACHE_MAGIC;
+  /* move the file into place */
+  if (rename(tmpname, filename) != 0)
+  {
+    (void)munmap(map, size);
+    (void)unlink(tmpname);
+    return NULL;
+  }
+  cache = (SHMCACHE *)malloc(sizeof(SHMCACHE));
+  if (cache == NULL)
+  {
+    (void)munmap(map, size);
+    (void)unlink(filename);
+    return NULL;
+  }
+  cache->map = (uint8_t *)map;
+  cache->size = size;
+  cache->numslots = numslots;
+  return cache;
+}
+
+SHMCACHE *shmcache_open(const char *filename)
+{
+  int fd;
+  SHMCACHE *cache;
+  fd = open(filename, O_RDONLY | O_NOCTTY);
+  if (fd < 0)
+    return NULL;
+#ifdef FD_CLOEXEC
+  (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif /* FD_CLOEXEC */
+  /* the mapping remains valid after closing the file */
+  cache = shmcache_map(fd, PROT_READ);
+  (void)close(fd);
+  return cache;
+}
+
+int shmcache_valid(SHMCACHE *cache)
+{
+  return HEADER(cache)->magic == SHMCACHE_MAGIC;
+}
+
+int shmcache_lookup(SHMCACHE *cache, int32_t action,
+                    const void *key, size_t keylen,
+                    void *buf, size_t buflen)
+{
+  volatile struct shmcache_slot *slot;
+  uint32_t hash, seq, len;
+  time_t now;
+  int i;
+  if ((!shmcache_valid(cache)) || (keylen > sizeof(slot->data)))
+    return -1;
+  now = time(NULL);
+  hash = shmcache_hash(action, key, keylen);
+  for (i = 0; i < SHMCACHE_PROBES; i++)
+  {
+    slot = SLOT(cache, (hash + i) % cache->numslots);
+    seq = slot->seq;
+    __sync_synchronize();
+    /* skip slots that are being updated or are for another key */
+    if ((seq & 1) || (slot->action != action) || (slot->keylen != keylen) ||
+        (memcmp((const void *)slot->data, key, keylen) != 0))
+      continue;
+    len = slot->datalen;
+    if ((slot->expire <= (int64_t)now) ||
+        (len > (sizeof(slot->data) - keylen)) || (len > buflen))
+      return -1;
+    memcpy(buf, (const void *)(slot->data + keylen), len);
+    /* check that the slot was not changed while copying */
+    __sync_synchronize();
+    if (slot->seq != seq)
+      return -1;
+    return (int)len;
+  }
+  return -1;
+}
+
+void shmcache_store(SHMCACHE *cache, int32_t action,
+                    const void *key, size_t keylen,
+                    const void *data, size_t datalen, time_t expire)
+{
+  volatile struct shmcache_slot *slot, *use = NULL;
+  uint32_t hash, seq;
+  time_t now;
+  int i;
+  if ((keylen + datalen) > sizeof(slot->data))
+    return;
+  now = time(NULL);
+  hash = shmcache_hash(action, key, keylen);
+  /* find a slot with the same key, an unused slot or the oldest slot */
+  for (i = 0; i < SHMCACHE_PROBES; i++)
+  {
+    slot = SLOT(cache, (hash + i) % cache->numslots);
+    if ((slot->action == action) && (slot->keylen == keylen) &&
+        (memcmp((const void *)slot->data, key, keylen) == 0))
+    {
+      use = slot;
+      break;
+    }
+    if ((use == NULL) || (use->expire > slot->expire))
+      use = slot;
+    if ((slot->action == 0) || (slot->expire <= (int64_t)now))
+      break;
+  }
+  /* mark the slot as being updated (give up if another thread is
+     already updating it) */
+  seq = use->seq;
+  if ((seq & 1) || (!__sync_bool_compare_and_swap(&use->seq, seq, seq + 1)))
+    return;
+  use->action = action;
+  use->expire = (int64_t)expire;
+  use->keylen = (uint32_t)keylen;
+  use->datalen = (uint32_t)datalen;
+  memcpy((void *)use->data, key, keylen);
+  memcpy((void *)(use->data + keylen), data, datalen);
+  __sync_synchronize();
+  use->seq = seq + 2;
+}
+
+void shmcache_invalidate(SHMCACHE *cache, int32_t action,
+                         const void *key, size_t keylen)
+{
+  volatile struct shmcache_slot *slot;
+  uint32_t hash, seq;
+  int i;
+  if (keylen > sizeof(slot->data))
+    return;
+  hash = shmcache_hash(action, key, keylen);
+  for (i = 0; i < SHMCACHE_PROBES; i++)
+  {
+    slot = SLOT(cache, (hash + i) % cache->numslots);
+    /* wait for other threads that are updating the slot (these should
+       not take long) because the slot may be for our key */
+    while (1)
+    {
+      seq = slot->seq;
+      if ((!(seq & 1)) && (__sync_bool_compare_and_swap(&slot->seq, seq, seq + 1)))
+        break;
+    }
+    if ((slot->action == action) && (slot->keylen == keylen) &&
+        (memcmp((const void *)slot->data, key, keylen) == 0))
+    {
+      slot->action = 0;
+      slot->expire = 0;
+    }
+    __sync_synchronize();
+    slot->seq = seq + 2;
+  }
+}
+
+void shmcache_remove(const char *filename)
+{
+  int fd;
+  SHMCACHE *cache;
+  fd = open(filename, O_RDWR | O_NOCTTY);
+  if (fd >= 0)
+  {
+    cache = shmcache_map(fd, PROT_READ | PROT_WRITE);
+    (void)close(fd);
+    if (cache != NULL)
+    {
+      HEADER(cache)->magic = 0;
+      shmcache_close(cache);
+    }
+  }
+  (void)unlink(filename);
+}
+
+void shmcache_close(SHMCACHE *cache)
+{
+  (void)munmap(cache->map, cache->size);
+  free(cache);
+}
+
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
@@ -0,0 +1,103 @@
+/*
+   shmcache.h - shared memory lookup cache
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#ifndef COMMON__SHMCACHE_H
+#define COMMON__SHMCACHE_H
+
+#include <stddef.h>
+#include <time.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif /* HAVE_STDINT_H */
+
+#include "compat/attrs.h"
+
+/*
+   These functions provide a cache of lookup results in a file that is
+   written by nslcd and mapped read-only by the NSS module.
+
+   The file consists of a header followed by a fixed number of fixed-size
+   slots. Each slot holds the result of a single request, keyed by the
+   request action and the request parameter (the name or the numeric id).
+   The data that is stored is the result entry in the format that nslcd
+   writes to the socket (without the NSLCD_RESULT_BEGIN).
+
+   Slots are protected by a sequence number that is odd while the slot is
+   being written so readers do not need any locking. A new file is created
+   each time nslcd starts and the file is invalidated when nslcd stops.
+
+   These functions require atomic operations so are only available if
+   HAVE_SYNC_BOOL_COMPARE_AND_SWAP is defined.
+*/
+typedef struct shmcache SHMCACHE;
+
+/* the size of a single slot in the cache file */
+#define SHMCACHE_SLOTSIZE 1024
+
+/* the maximum combined size of the key and the result that fit in a
+   slot (the slot header takes up 24 bytes) */
+#define SHMCACHE_MAXDATA (SHMCACHE_SLOTSIZE - 24)
+
+/* the default number of slots in the cache file */
+#define SHMCACHE_NUMSLOTS 8192
+
+/* Create a new cache file with the specified number of slots, replacing
+   any existing file, and map it for writing. Returns NULL on errors (with
+   errno set). */
+SHMCACHE *shmcache_create(const char *filename, unsigned int numslots)
+  MUST_USE;
+
+/* Map an existing cache file read-only. Returns NULL if the file does not
+   exist or is not a valid cache file. */
+SHMCACHE *shmcache_open(const char *filename)
+  MUST_USE;
+
+/* Return whether the mapped cache file is still valid. A cache file is
+   invalidated when nslcd stops or starts using a new file. */
+int shmcache_valid(SHMCACHE *cache);
+
+/* Look up the result for the request in the cache. The result is copied
+   to buf and the length is returned. Returns -1 if no valid result was
+   found. */
+int shmcache_lookup(SHMCACHE *cache, int32_t action,
+                    const void *key, size_t keylen,
+                    void *buf, size_t buflen);
+
+/* Store the result for the request in the cache. The result is valid until
+   the expire time. Results that do not fit in a slot are ignored. */
+void shmcache_store(SHMCACHE *cache, int32_t action,
+                    const void *key, size_t keylen,
+                    const void *data, size_t datalen, time_t expire);
+
+/* Remove the result for the request from the cache so that it is no longer
+   returned by shmcache_lookup(). */
+void shmcache_invalidate(SHMCACHE *cache, int32_t action,
+                         const void *key, size_t keylen);
+
+/* Invalidate the cache file and remove it. */
+void shmcache_remove(const char *filename);
+
+/* Unmap the cache file. The caller should ensure that no other threads
+   are still using it. */
+void shmcache_close(SHMCACHE *cache);
+
+#endif /* COMMON__SHMCACHE_H */
@@ -52,6 +52,19 @@ TFILE *tio_fdopen(int fd, int readtimeout, int writetimeout,
                   size_t initwritesize, size_t maxwritesize)
   LIKE_MALLOC MUST_USE;
 
+/* Open a new TFILE that is not backed by a file descriptor. Reads return
+   the len bytes from buf (which is copied) and writes are kept in memory
+   up to maxwritesize bytes (see tio_memdata()). */
+TFILE *tio_memopen(const void *buf, size_t len, size_t maxwritesize)
+  LIKE_MALLOC MUST_USE;
+
+/* Return the data that has been written to a memory stream. The returned
+   buffer is valid until the next operation on the stream. */
+const void *tio_memdata(TFILE *fp, size_t *len);
+
+/* Return the file descriptor that is used by the stream. */
+int tio_fileno(TFILE *fp);
+
 /* Read the specified number of bytes from the stream. */
 int tio_read(TFILE *fp, void *buf, size_t count);
 
@@ -67,6 +80,11 @@ int tio_write(TFILE *fp, const void *buf, size_t count);
 /* Write out all buffered data to the stream. */
 int tio_flush(TFILE *fp);
 
+/* Try a single write of the buffered data if the file descriptor will
+   accept data without blocking. Use tio_wpending() to find out whether
+   any data is left. */
+int tio_flush_nonblock(TFILE *fp);
+
 /* Flush the streams and closes the underlying file descriptor. */
 int tio_close(TFILE *fp);
 
@@ -80,4 +98,24 @@ void tio_mark(TFILE *fp);
    were full). */
 int tio_reset(TFILE *fp);
 
+/* Store the current position in the write stream. Any data that is
+   written after this point is kept in the buffer (the buffer is grown up
+   to the maximum size instead of flushed) so that it can be retrieved with
+   tio_wmarked(). The mark is cleared when data is written to the file
+   descriptor. */
+void tio_wmark(TFILE *fp);
+
+/* Return the data that was written to the stream since tio_wmark() and
+   clear the mark. Returns NULL if the mark was cleared because (part of)
+   the data was already written to the file descriptor. */
+const void *tio_wmarked(TFILE *fp, size_t *len);
+
+/* Return the number of bytes in the read buffer that have been read from
+   the file descriptor but not yet returned by tio_read(). */
+size_t tio_rpending(TFILE *fp);
+
+/* Return the number of bytes in the write buffer that have not yet been
+   written to the file descriptor. */
+size_t tio_wpending(TFILE *fp);
+
 #endif /* COMMON__TIO_H */
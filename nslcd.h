@@ -28,6 +28,12 @@
    protocol. It is request/response based where the client initiates a
    connection, does a single request and closes the connection again. Any
    mangled or not understood messages will be silently ignored by the server.
+   A client may ask the server to keep the connection open (see
+   NSLCD_ACTION_KEEPALIVE below) after which further requests may be sent
+   over the same connection, one at a time after the complete response to
+   the previous request has been read. A client may also switch the
+   connection to pipelined mode (see NSLCD_ACTION_PIPELINE below) to send
+   many requests without waiting for the responses.
 
    A request looks like:
      INT32  NSLCD_VERSION
@@ -79,6 +85,61 @@
    modification through PAM is prohibited */
 #define NSLCD_CONFIG_PAM_PASSWORD_PROHIBIT_MESSAGE 1
 
+/* Request the server to keep the connection open after each response so
+   it can be re-used for further requests. There are no request parameters,
+   the result value is:
+     INT32   number of seconds an idle connection is kept open
+   If the server does not keep the connection open 0 is returned and the
+   connection is closed after this response as usual. The server only closes
+   a kept open connection after it has been idle for the returned time or
+   after an error in a request. */
+#define NSLCD_ACTION_KEEPALIVE         0x00010002
+
+/* Request the server to switch the connection to pipelined mode. There are
+   no request parameters, the result value is:
+     INT32   maximum number of requests that may be outstanding
+   If the server does not support pipelining 0 is returned and the
+   connection is closed after this response (servers that do not know this
+   request close the connection without a response). Otherwise every
+   following request on the connection is sent as:
+     INT32   request id (chosen by the client)
+     INT32   length of the request
+     [request as described above, starting with NSLCD_VERSION]
+   and the response to each request is sent as:
+     INT32   request id
+     INT32   length of the response
+     [response as described above, starting with NSLCD_VERSION]
+   Responses may be sent in a different order than the requests were
+   received. A length of 0 in a response indicates that the request failed
+   (where on a normal connection the server would close the connection).
+   The client should not have more requests outstanding than the returned
+   maximum. Pipelined connections are kept open as with
+   NSLCD_ACTION_KEEPALIVE. */
+#define NSLCD_ACTION_PIPELINE          0x00010003
+
+/* Get statistics of the running server. There are no request parameters.
+   COUNTER values are sent as two INT32 values (the high and the low 32
+   bits) and count from the start of the server. The result value is:
+     INT32       number of seconds since the server was started
+     INT32       number of latency buckets (N)
+     INT32[N-1]  upper bound of each bucket but the last in microseconds
+     INT32       number of counters
+   followed by each counter as:
+     STRING      name of the counter (e.g. "ldap_searches")
+     COUNTER     value
+   followed by:
+     INT32       number of actions
+   and for each action that has been requested:
+     INT32       NSLCD_ACTION_*
+     COUNTER     number of requests
+     COUNTER     number of failed requests
+     COUNTER[N]  number of requests that completed within each bucket */
+#define NSLCD_ACTION_STATS             0x00010004
+
+/* The maximum number of keys that may be passed in a single batch request
+   (e.g. NSLCD_ACTION_PASSWD_BYUIDS). */
+#define NSLCD_BATCH_MAXKEYS 1024
+
 /* Email alias (/etc/aliases) NSS requests. The result values for a
    single entry are:
      STRING      alias name
@@ -100,9 +161,17 @@
      STRING       group password
      INT32        group id
      STRINGLIST   members (usernames) of the group
-     (not that the BYMEMER call returns an emtpy members list) */
+     (not that the BYMEMER call returns an emtpy members list)
+   The BYNAMES and BYGIDS requests look up a number of groups at once. The
+   request parameters are:
+     INT32        number of names or group ids (at most NSLCD_BATCH_MAXKEYS)
+     STRING/INT32 group name or group id (repeated)
+   The entries of all groups that were found are returned in no particular
+   order. */
 #define NSLCD_ACTION_GROUP_BYNAME      0x00040001
 #define NSLCD_ACTION_GROUP_BYGID       0x00040002
+#define NSLCD_ACTION_GROUP_BYNAMES     0x00040003
+#define NSLCD_ACTION_GROUP_BYGIDS      0x00040004
 #define NSLCD_ACTION_GROUP_BYMEMBER    0x00040006
 #define NSLCD_ACTION_GROUP_ALL         0x00040008
 
@@ -129,8 +198,17 @@
      STRING  domain
    A netgroup result entry is terminated by:
      INT32   NSLCD_NETGROUP_TYPE_END
-   */
+   The NSLCD_ACTION_NETGROUP_EXPAND request takes a netgroup name and
+   returns a single result entry that contains the triples of the netgroup
+   and of all netgroups that are (indirectly) a member of it, without
+   duplicates and without any references to other netgroups.
+   The NSLCD_ACTION_NETGROUP_INNETGR request takes a netgroup name, a host,
+   a user and a domain (an empty string matches any value) and returns a
+   single result entry with the netgroup name if they are a member of the
+   netgroup (including nested netgroups) or no entries if not. */
 #define NSLCD_ACTION_NETGROUP_BYNAME   0x00060001
+#define NSLCD_ACTION_NETGROUP_EXPAND   0x00060003
+#define NSLCD_ACTION_NETGROUP_INNETGR  0x00060004
 #define NSLCD_ACTION_NETGROUP_ALL      0x00060008
 #define NSLCD_NETGROUP_TYPE_NETGROUP 1
 #define NSLCD_NETGROUP_TYPE_TRIPLE   2
@@ -152,9 +230,17 @@
      INT32        group id
      STRING       gecos information
      STRING       home directory
-     STRING       login shell */
+     STRING       login shell
+   The BYNAMES and BYUIDS requests look up a number of users at once. The
+   request parameters are:
+     INT32        number of names or user ids (at most NSLCD_BATCH_MAXKEYS)
+     STRING/INT32 user name or user id (repeated)
+   The entries of all users that were found are returned in no particular
+   order. */
 #define NSLCD_ACTION_PASSWD_BYNAME     0x00080001
 #define NSLCD_ACTION_PASSWD_BYUID      0x00080002
+#define NSLCD_ACTION_PASSWD_BYNAMES    0x00080003
+#define NSLCD_ACTION_PASSWD_BYUIDS     0x00080004
 #define NSLCD_ACTION_PASSWD_ALL        0x00080008
 
 /* Protocol information requests. Result values are:
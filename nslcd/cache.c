@@ -0,0 +1,486 @@
+/*
+   cache.c - cache of responses to passwd, group and shadow lookups
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "log.h"
+#include "cfg.h"
+#include "common/dict.h"
+
+/*
+   The cache stores complete responses (including the response header and
+   the final NSLCD_RESULT_END) as they were written to the client so that a
+   cache hit only requires a single write. Responses without any entries
+   are negative results. Other data that is expensive to look up (e.g. the
+   parents of nested groups) can be stored with cache_put().
+
+   All entries are also kept in a doubly linked list with the most recently
+   used entry at the head. When the cache grows beyond the configured size
+   entries are removed from the tail.
+
+   Requests for a key that another thread is already looking up wait for
+   that thread to finish and write the same response instead of doing the
+   same search (this also happens for maps that are not cached). A search
+   is in progress between cache_write() returning 0 and the following
+   cache_store() or cache_done() from the same stream.
+*/
+
+/* a single cached response, the response data and the key follow the
+   structure in the same allocation */
+struct cache_entry {
+  struct cache_entry *prev; /* more recently used entry */
+  struct cache_entry *next; /* less recently used entry */
+  time_t expire;            /* the time the entry is valid until */
+  size_t size;              /* total size of the allocation */
+  size_t len;               /* length of the response data */
+  const char *key;          /* the key in the dictionary */
+};
+
+/* get the response data of the entry */
+#define CACHE_DATA(entry) ((void *)((entry) + 1))
+
+/* the cache and the list of entries, the mutex protects all of these */
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DICT *cache_dict = NULL;
+static struct cache_entry *cache_head = NULL;
+static struct cache_entry *cache_tail = NULL;
+static size_t cache_used = 0;
+
+/* statistics of the cache (also protected by the mutex) */
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+static unsigned long cache_shared = 0;
+static unsigned long cache_evictions = 0;
+
+/* a search for the key that is in progress, the key follows the structure
+   in the same allocation */
+struct cache_inflight {
+  struct cache_inflight *next;
+  TFILE *fp;                /* the stream the response is written to */
+  int waiters;              /* the number of threads waiting for the search */
+  int done;                 /* whether the search has completed */
+  void *data;               /* the response (NULL if the search failed) */
+  size_t len;               /* length of the response data */
+  const char *key;
+};
+
+/* the searches that are in progress (also protected by the mutex), the
+   condition is signalled whenever a search completes */
+static struct cache_inflight *cache_inflight = NULL;
+static pthread_cond_t cache_cond = PTHREAD_COND_INITIALIZER;
+
+/* return the map that the response to the action belongs to (LM_NONE if
+   responses to the action are never cached) */
+static enum ldap_map_selector cache_action2map(int32_t action)
+{
+  switch (action)
+  {
+    case NSLCD_ACTION_PASSWD_BYNAME:
+    case NSLCD_ACTION_PASSWD_BYUID:
+      return LM_PASSWD;
+    case NSLCD_ACTION_GROUP_BYNAME:
+    case NSLCD_ACTION_GROUP_BYGID:
+    case NSLCD_ACTION_GROUP_BYMEMBER:
+      return LM_GROUP;
+    case NSLCD_ACTION_SHADOW_BYNAME:
+      return LM_SHADOW;
+    default:
+      return LM_NONE;
+  }
+}
+
+/* remove the entry from the linked list */
+static void cache_unlink(struct cache_entry *entry)
+{
+  if (entry->prev != NULL)
+    entry->prev->next = entry->next;
+  else
+    cache_head = entry->next;
+  if (entry->next != NULL)
+    entry->next->prev = entry->prev;
+  else
+    cache_tail = entry->prev;
+}
+
+/* add the entry to the head of the linked list */
+static void cache_link(struct cache_entry *entry)
+{
+  entry->prev = NULL;
+  entry->next = cache_head;
+  if (cache_head != NULL)
+    cache_head->prev = entry;
+  else
+    cache_tail = entry;
+  cache_head = entry;
+}
+
+/* remove the entry from the cache and free it */
+static void cache_remove(struct cache_entry *entry)
+{
+  (void)dict_put(cache_dict, entry->key, NULL);
+  cache_unlink(entry);
+  cache_used -= entry->size;
+  free(entry);
+}
+
+/* find the search that is in progress for the key */
+static struct cache_inflight *cache_inflight_find(const char *key)
+{
+  struct cache_inflight *inflight;
+  for (inflight = cache_inflight; inflight != NULL; inflight = inflight->next)
+    if (strcmp(inflight->key, key) == 0)
+      return inflight;
+  return NULL;
+}
+
+/* complete the search that is in progress for the stream and pass a copy
+   of the response to the waiting threads (data is NULL if the search
+   failed), this should be called with the mutex held */
+static void cache_inflight_done(TFILE *fp, const void *data, size_t len)
+{
+  struct cache_inflight **ptr, *inflight;
+  for (ptr = &cache_inflight; (*ptr) != NULL; ptr = &((*ptr)->next))
+  {
+    if ((*ptr)->fp == fp)
+    {
+      inflight = *ptr;
+      *ptr = inflight->next;
+      if (inflight->waiters == 0)
+      {
+        free(inflight);
+        return;
+      }
+      if (data != NULL)
+      {
+        inflight->data = malloc(len > 0 ? len : 1);
+        if (inflight->data == NULL)
+          log_log(LOG_CRIT, "cache_inflight_done(): malloc() failed to allocate memory");
+        else
+        {
+          memcpy(inflight->data, data, len);
+          inflight->len = len;
+        }
+      }
+      inflight->done = 1;
+      pthread_cond_broadcast(&cache_cond);
+      return;
+    }
+  }
+}
+
+/* wait for the search that is in progress and write the response, returns
+   1 if the response was written and -1 on errors or if the search failed,
+   this should be called with the mutex held and releases it */
+static int cache_inflight_wait(TFILE *fp, struct cache_inflight *inflight)
+{
+  int rc = -1;
+  inflight->waiters++;
+  while (!inflight->done)
+    pthread_cond_wait(&cache_cond, &cache_mutex);
+  inflight->waiters--;
+  /* this only copies the data into the (empty) write buffer */
+  if (inflight->data != NULL)
+  {
+    rc = tio_write(fp, inflight->data, inflight->len);
+    if (rc)
+      log_log(LOG_WARNING, "error writing to client: %s", strerror(errno));
+    else
+    {
+      log_log(LOG_DEBUG, "response from concurrent search");
+      cache_shared++;
+    }
+    rc = rc ? -1 : 1;
+  }
+  else
+    log_log(LOG_DEBUG, "concurrent search failed");
+  /* the last waiting thread frees the response */
+  if (inflight->waiters == 0)
+  {
+    free(inflight->data);
+    free(inflight);
+  }
+  pthread_mutex_unlock(&cache_mutex);
+  return rc;
+}
+
+const char *cache_key(char *buffer, size_t buflen, int32_t action,
+                      const char *format, ...)
+{
+  enum ldap_map_selector map;
+  va_list ap;
+  int res;
+  /* a key is also returned when the cache is disabled so that concurrent
+     requests can share the search */
+  map = cache_action2map(action);
+  if (map == LM_NONE)
+    return NULL;
+  /* the key is the action followed by the formatted parameters */
+  if (mysnprintf(buffer, buflen, "%08x ", (unsigned int)action))
+    return NULL;
+  va_start(ap, format);
+  res = vsnprintf(buffer + 9, buflen - 9, format, ap);
+  va_end(ap);
+  if ((res < 0) || (((size_t)res) >= (buflen - 9)))
+    return NULL;
+  return buffer;
+}
+
+int cache_write(TFILE *fp, const char *key)
+{
+  struct cache_entry *entry;
+  struct cache_inflight *inflight;
+  int rc;
+  pthread_mutex_lock(&cache_mutex);
+  if ((cache_dict != NULL) &&
+      ((entry = (struct cache_entry *)dict_get(cache_dict, key)) != NULL))
+  {
+    if (entry->expire > time(NULL))
+    {
+      /* move the entry to the head of the list */
+      cache_unlink(entry);
+      cache_link(entry);
+      cache_hits++;
+      /* this only copies the data into the (empty) write buffer */
+      rc = tio_write(fp, CACHE_DATA(entry), entry->len);
+      pthread_mutex_unlock(&cache_mutex);
+      if (rc)
+      {
+        log_log(LOG_WARNING, "error writing to client: %s", strerror(errno));
+        return -1;
+      }
+      log_log(LOG_DEBUG, "response from cache");
+      return 1;
+    }
+    /* the entry has expired */
+    cache_remove(entry);
+  }
+  /* wait for another thread that is doing the same search */
+  if ((inflight = cache_inflight_find(key)) != NULL)
+    return cache_inflight_wait(fp, inflight);
+  cache_misses++;
+  /* register the search that we are about to do (if this fails the search
+     is just not shared) */
+  inflight = (struct cache_inflight *)malloc(sizeof(struct cache_inflight) +
+                                             strlen(key) + 1);
+  if (inflight == NULL)
+    log_log(LOG_CRIT, "cache_write(): malloc() failed to allocate memory");
+  else
+  {
+    inflight->fp = fp;
+    inflight->waiters = 0;
+    inflight->done = 0;
+    inflight->data = NULL;
+    inflight->len = 0;
+    inflight->key = strcpy((char *)(inflight + 1), key);
+    inflight->next = cache_inflight;
+    cache_inflight = inflight;
+  }
+  pthread_mutex_unlock(&cache_mutex);
+  /* keep the response that is written next */
+  tio_wmark(fp);
+  return 0;
+}
+
+void cache_store(TFILE *fp, int32_t action, const char *key)
+{
+  const void *data;
+  size_t len;
+  enum ldap_map_selector map;
+  /* get the response that was written */
+  data = tio_wmarked(fp, &len);
+  if (data == NULL)
+  {
+    cache_done(fp);
+    return;
+  }
+  map = cache_action2map(action);
+  if (map != LM_NONE)
+  {
+    /* responses with only the header and NSLCD_RESULT_END are negative */
+    if (len > (3 * sizeof(int32_t)))
+      cache_put(key, data, len, nslcd_cfg->cache_positive[map]);
+    else
+      cache_put(key, data, len, nslcd_cfg->cache_negative[map]);
+  }
+  /* pass the response to threads that are waiting for it */
+  pthread_mutex_lock(&cache_mutex);
+  cache_inflight_done(fp, data, len);
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+void cache_share(TFILE *fp)
+{
+  const void *data;
+  size_t len;
+  data = tio_wmarked(fp, &len);
+  pthread_mutex_lock(&cache_mutex);
+  cache_inflight_done(fp, data, len);
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+void cache_done(TFILE *fp)
+{
+  pthread_mutex_lock(&cache_mutex);
+  cache_inflight_done(fp, NULL, 0);
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+void *cache_get(const char *key, size_t *len)
+{
+  struct cache_entry *entry;
+  void *data = NULL;
+  pthread_mutex_lock(&cache_mutex);
+  if ((cache_dict != NULL) &&
+      ((entry = (struct cache_entry *)dict_get(cache_dict, key)) != NULL))
+  {
+    if (entry->expire > time(NULL))
+    {
+      /* move the entry to the head of the list */
+      cache_unlink(entry);
+      cache_link(entry);
+      data = malloc(entry->len > 0 ? entry->len : 1);
+      if (data == NULL)
+        log_log(LOG_CRIT, "cache_get(): malloc() failed to allocate memory");
+      else
+      {
+        memcpy(data, CACHE_DATA(entry), entry->len);
+        *len = entry->len;
+      }
+    }
+    else
+      cache_remove(entry);
+  }
+  pthread_mutex_unlock(&cache_mutex);
+  return data;
+}
+
+void cache_put(const char *key, const void *data, size_t len, time_t ttl)
+{
+  size_t size;
+  struct cache_entry *entry, *old;
+  size = sizeof(struct cache_entry) + len + strlen(key) + 1;
+  if ((ttl == 0) || (size > nslcd_cfg->cache_size))
+    return;
+  /* build the new entry */
+  entry = (struct cache_entry *)malloc(size);
+  if (entry == NULL)
+  {
+    log_log(LOG_CRIT, "cache_put(): malloc() failed to allocate memory");
+    return;
+  }
+  entry->expire = time(NULL) + ttl;
+  entry->size = size;
+  entry->len = len;
+  memcpy(CACHE_DATA(entry), data, len);
+  entry->key = (char *)CACHE_DATA(entry) + len;
+  strcpy((char *)entry->key, key);
+  /* add it to the cache */
+  pthread_mutex_lock(&cache_mutex);
+  if (cache_dict == NULL)
+    cache_dict = dict_new();
+  if (cache_dict == NULL)
+  {
+    pthread_mutex_unlock(&cache_mutex);
+    log_log(LOG_CRIT, "cache_put(): malloc() failed to allocate memory");
+    free(entry);
+    return;
+  }
+  /* replace any existing entry and remove the least recently used entries
+     to make room */
+  if ((old = (struct cache_entry *)dict_get(cache_dict, key)) != NULL)
+    cache_remove(old);
+  while ((cache_tail != NULL) &&
+         ((cache_used + size) > nslcd_cfg->cache_size))
+  {
+    cache_remove(cache_tail);
+    cache_evictions++;
+  }
+  if (dict_put(cache_dict, entry->key, entry))
+  {
+    pthread_mutex_unlock(&cache_mutex);
+    log_log(LOG_CRIT, "cache_put(): malloc() failed to allocate memory");
+    free(entry);
+    return;
+  }
+  cache_link(entry);
+  cache_used += size;
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+/* remove the entry with the key from the cache if it exists, this should
+   be called with the mutex held */
+static void cache_remove_key(const char *key)
+{
+  struct cache_entry *entry;
+  if ((key != NULL) && (cache_dict != NULL) &&
+      ((entry = (struct cache_entry *)dict_get(cache_dict, key)) != NULL))
+    cache_remove(entry);
+}
+
+void cache_invalidate(const char *name, uid_t uid)
+{
+  char keybuf[BUFLEN_CACHEKEY];
+  int root;
+  pthread_mutex_lock(&cache_mutex);
+  /* the responses differ for root and other callers */
+  for (root = 0; root <= 1; root++)
+  {
+    if (name != NULL)
+    {
+      cache_remove_key(cache_key(keybuf, sizeof(keybuf),
+                                 NSLCD_ACTION_PASSWD_BYNAME,
+                                 "%d %s", root, name));
+      cache_remove_key(cache_key(keybuf, sizeof(keybuf),
+                                 NSLCD_ACTION_SHADOW_BYNAME,
+                                 "%d %s", root, name));
+    }
+    if (uid != (uid_t)-1)
+      cache_remove_key(cache_key(keybuf, sizeof(keybuf),
+                                 NSLCD_ACTION_PASSWD_BYUID,
+                                 "%d %lu", root, (unsigned long int)uid));
+  }
+  if (name != NULL)
+    cache_remove_key(cache_key(keybuf, sizeof(keybuf),
+                               NSLCD_ACTION_GROUP_BYMEMBER, "u %s", name));
+  pthread_mutex_unlock(&cache_mutex);
+}
+
+void cache_stats(unsigned long *hits, unsigned long *misses,
+                 unsigned long *shared, unsigned long *evictions,
+                 unsigned long *used)
+{
+  pthread_mutex_lock(&cache_mutex);
+  *hits = cache_hits;
+  *misses = cache_misses;
+  *shared = cache_shared;
+  *evictions = cache_evictions;
+  *used = (unsigned long)cache_used;
+  pthread_mutex_unlock(&cache_mutex);
+}
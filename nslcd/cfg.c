@@ -270,6 +270,28 @@ static void print_time(time_t t, char *buffer, size_t buflen)
     mysnprintf(buffer, buflen, "%lds", (long)t);
 }
 
+#ifdef LDAP_OPT_X_KEEPALIVE_IDLE
+static void handle_tcp_keepalive(const char *filename, int lnr,
+                                 const char *keyword, char *line,
+                                 struct ldap_config *cfg)
+{
+  /* the idle time is required, the interval and probes are optional */
+  cfg->tcp_keepalive_idle = (int)get_time(filename, lnr, keyword, &line);
+  if ((line != NULL) && (*line != '\0'))
+    cfg->tcp_keepalive_interval = (int)get_time(filename, lnr, keyword, &line);
+  if ((line != NULL) && (*line != '\0'))
+    cfg->tcp_keepalive_probes = get_int(filename, lnr, keyword, &line);
+  get_eol(filename, lnr, keyword, &line);
+  if ((cfg->tcp_keepalive_idle < 0) || (cfg->tcp_keepalive_interval < 0) ||
+      (cfg->tcp_keepalive_probes < 0))
+  {
+    log_log(LOG_ERR, "%s:%d: %s: value must not be negative",
+            filename, lnr, keyword);
+    exit(EXIT_FAILURE);
+  }
+}
+#endif /* LDAP_OPT_X_KEEPALIVE_IDLE */
+
 static void handle_uid(const char *filename, int lnr,
                        const char *keyword, char *line,
                        struct ldap_config *cfg)
@@ -1108,20 +1130,86 @@ static void handle_reconnect_invalidate(
   }
 }
 
+static size_t get_size(const char *filename, int lnr,
+                       const char *keyword, char **line)
+{
+  char token[32];
+  char *tmp;
+  unsigned long value;
+  check_argumentcount(filename, lnr, keyword,
+                      get_token(line, token, sizeof(token)) != NULL);
+  errno = 0;
+  value = strtoul(token, &tmp, 10);
+  if ((token[0] < '0') || (token[0] > '9') || (errno != 0))
+  {
+    log_log(LOG_ERR, "%s:%d: %s: invalid size value: '%s'",
+            filename, lnr, keyword, token);
+    exit(EXIT_FAILURE);
+  }
+  if ((strcasecmp(tmp, "k") == 0) || (strcasecmp(tmp, "kb") == 0))
+    return (size_t)value * 1024;
+  else if ((strcasecmp(tmp, "m") == 0) || (strcasecmp(tmp, "mb") == 0))
+    return (size_t)value * 1024 * 1024;
+  else if ((strcasecmp(tmp, "g") == 0) || (strcasecmp(tmp, "gb") == 0))
+    return (size_t)value * 1024 * 1024 * 1024;
+  else if (*tmp != '\0')
+  {
+    log_log(LOG_ERR, "%s:%d: %s: invalid size value: '%s'",
+            filename, lnr, keyword, token);
+    exit(EXIT_FAILURE);
+  }
+  return (size_t)value;
+}
+
+static void print_size(size_t size, char *buffer, size_t buflen)
+{
+  if ((size > 0) && ((size % (1024 * 1024)) == 0))
+    mysnprintf(buffer, buflen, "%luM", (unsigned long)(size / (1024 * 1024)));
+  else if ((size > 0) && ((size % 1024) == 0))
+    mysnprintf(buffer, buflen, "%luk", (unsigned long)(size / 1024));
+  else
+    mysnprintf(buffer, buflen, "%lu", (unsigned long)size);
+}
+
 static void handle_cache(const char *filename, int lnr,
                          const char *keyword, char *line,
                          struct ldap_config *cfg)
 {
   char cache[16];
+  char token[16];
   time_t value1, value2;
+  int maxentries;
+  enum ldap_map_selector map;
   /* get cache map and values */
   check_argumentcount(filename, lnr, keyword,
                       get_token(&line, cache, sizeof(cache)) != NULL);
+  /* the size takes a different kind of value */
+  if (strcasecmp(cache, "size") == 0)
+  {
+    cfg->cache_size = get_size(filename, lnr, keyword, &line);
+    get_eol(filename, lnr, keyword, &line);
+    return;
+  }
   value1 = get_time(filename, lnr, keyword, &line);
-  if ((line != NULL) && (*line != '\0'))
+  if ((line != NULL) && (*line != '\0') &&
+      (strncasecmp(line, "maxentries", 10) != 0))
     value2 = get_time(filename, lnr, keyword, &line);
   else
     value2 = value1;
+  /* the dn2uid cache can optionally be limited in size */
+  if ((line != NULL) && (strncasecmp(line, "maxentries", 10) == 0) &&
+      (strcasecmp(cache, "dn2uid") == 0))
+  {
+    (void)get_token(&line, token, sizeof(token));
+    maxentries = get_int(filename, lnr, keyword, &line);
+    if (maxentries < 0)
+    {
+      log_log(LOG_ERR, "%s:%d: %s: maxentries must not be negative",
+              filename, lnr, keyword);
+      exit(EXIT_FAILURE);
+    }
+    cfg->cache_dn2uid_maxentries = maxentries;
+  }
   get_eol(filename, lnr, keyword, &line);
   /* check the cache */
   if (strcasecmp(cache, "dn2uid") == 0)
@@ -1129,6 +1217,17 @@ static void handle_cache(const char *filename, int lnr,
     cfg->cache_dn2uid_positive = value1;
     cfg->cache_dn2uid_negative = value2;
   }
+  else if (strcasecmp(cache, "shared") == 0)
+  {
+    /* only found entries are published so the second value is not used */
+    cfg->cache_shared = value1;
+  }
+  else if (((map = parse_map(cache)) == LM_PASSWD) || (map == LM_GROUP) ||
+           (map == LM_SHADOW) || (map == LM_NETGROUP))
+  {
+    cfg->cache_positive[map] = value1;
+    cfg->cache_negative[map] = value2;
+  }
   else
   {
     log_log(LOG_ERR, "%s:%d: unknown cache: '%s'", filename, lnr, cache);
@@ -1194,6 +1293,10 @@ static void cfg_defaults(struct ldap_config *cfg)
   int i;
   memset(cfg, 0, sizeof(struct ldap_config));
   cfg->threads = 5;
+  cfg->connections = 0;
+  cfg->connections_min = 0;
+  cfg->connections_per_uri = 0;
+  cfg->pam_bind_connections = 0;
   cfg->uidname = NULL;
   cfg->uid = NOUID;
   cfg->gid = NOGID;
@@ -1231,6 +1334,10 @@ static void cfg_defaults(struct ldap_config *cfg)
   cfg->bind_timelimit = 10;
   cfg->timelimit = LDAP_NO_LIMIT;
   cfg->idle_timelimit = 0;
+  cfg->idle_reconnect = 0;
+  cfg->tcp_keepalive_idle = 0;
+  cfg->tcp_keepalive_interval = 0;
+  cfg->tcp_keepalive_probes = 0;
   cfg->reconnect_sleeptime = 1;
   cfg->reconnect_retrytime = 10;
 #ifdef LDAP_OPT_X_TLS
@@ -1242,6 +1349,7 @@ static void cfg_defaults(struct ldap_config *cfg)
   cfg->nss_uid_offset = 0;
   cfg->nss_gid_offset = 0;
   cfg->nss_nested_groups = 0;
+  cfg->nss_nested_groups_batch = 16;
   cfg->nss_getgrent_skipmembers = 0;
   cfg->nss_disable_enumeration = 0;
   cfg->validnames_str = NULL;
@@ -1257,6 +1365,14 @@ static void cfg_defaults(struct ldap_config *cfg)
     cfg->reconnect_invalidate[i] = 0;
   cfg->cache_dn2uid_positive = 15 * TIME_MINUTES;
   cfg->cache_dn2uid_negative = 15 * TIME_MINUTES;
+  cfg->cache_dn2uid_maxentries = 0;
+  cfg->cache_shared = 0;
+  for (i = 0; i < LM_NONE; i++)
+  {
+    cfg->cache_positive[i] = 0;
+    cfg->cache_negative[i] = 0;
+  }
+  cfg->cache_size = 4 * 1024 * 1024;
 }
 
 static void cfg_read(const char *filename, struct ldap_config *cfg)
@@ -1308,6 +1424,51 @@ static void cfg_read(const char *filename, struct ldap_config *cfg)
       cfg->threads = get_int(filename, lnr, keyword, &line);
       get_eol(filename, lnr, keyword, &line);
     }
+    else if (strcasecmp(keyword, "connections") == 0)
+    {
+      /* the number of connections to keep open and optionally the
+         maximum number of connections */
+      cfg->connections_min = get_int(filename, lnr, keyword, &line);
+      if ((line != NULL) && (*line != '\0'))
+        cfg->connections = get_int(filename, lnr, keyword, &line);
+      else
+        cfg->connections = cfg->connections_min;
+      if ((cfg->connections_min < 0) || (cfg->connections < 0))
+      {
+        log_log(LOG_ERR, "%s:%d: %s: value must not be negative",
+                filename, lnr, keyword);
+        exit(EXIT_FAILURE);
+      }
+      if (cfg->connections < cfg->connections_min)
+      {
+        log_log(LOG_ERR, "%s:%d: %s: maximum must not be lower than minimum",
+                filename, lnr, keyword);
+        exit(EXIT_FAILURE);
+      }
+      get_eol(filename, lnr, keyword, &line);
+    }
+    else if (strcasecmp(keyword, "connections_per_uri") == 0)
+    {
+      cfg->connections_per_uri = get_int(filename, lnr, keyword, &line);
+      if (cfg->connections_per_uri < 0)
+      {
+        log_log(LOG_ERR, "%s:%d: %s: value must not be negative",
+                filename, lnr, keyword);
+        exit(EXIT_FAILURE);
+      }
+      get_eol(filename, lnr, keyword, &line);
+    }
+    else if (strcasecmp(keyword, "pam_bind_connections") == 0)
+    {
+      cfg->pam_bind_connections = get_int(filename, lnr, keyword, &line);
+      if (cfg->pam_bind_connections < 0)
+      {
+        log_log(LOG_ERR, "%s:%d: %s: value must not be negative",
+                filename, lnr, keyword);
+        exit(EXIT_FAILURE);
+      }
+      get_eol(filename, lnr, keyword, &line);
+    }
     else if (strcasecmp(keyword, "uid") == 0)
     {
       handle_uid(filename, lnr, keyword, line, cfg);
@@ -1474,6 +1635,17 @@ static void cfg_read(const char *filename, struct ldap_config *cfg)
       cfg->idle_timelimit = get_int(filename, lnr, keyword, &line);
       get_eol(filename, lnr, keyword, &line);
     }
+    else if (strcasecmp(keyword, "idle_reconnect") == 0)
+    {
+      cfg->idle_reconnect = get_boolean(filename, lnr, keyword, &line);
+      get_eol(filename, lnr, keyword, &line);
+    }
+#ifdef LDAP_OPT_X_KEEPALIVE_IDLE
+    else if (strcasecmp(keyword, "tcp_keepalive") == 0)
+    {
+      handle_tcp_keepalive(filename, lnr, keyword, line, cfg);
+    }
+#endif /* LDAP_OPT_X_KEEPALIVE_IDLE */
     else if (!strcasecmp(keyword, "reconnect_sleeptime"))
     {
       cfg->reconnect_sleeptime = get_int(filename, lnr, keyword, &line);
@@ -1592,6 +1764,17 @@ static void cfg_read(const char *filename, struct ldap_config *cfg)
       cfg->nss_nested_groups = get_boolean(filename, lnr, keyword, &line);
       get_eol(filename, lnr, keyword, &line);
     }
+    else if (strcasecmp(keyword, "nss_nested_groups_batch") == 0)
+    {
+      cfg->nss_nested_groups_batch = get_int(filename, lnr, keyword, &line);
+      if (cfg->nss_nested_groups_batch < 1)
+      {
+        log_log(LOG_ERR, "%s:%d: %s: value must be at least 1",
+                filename, lnr, keyword);
+        exit(EXIT_FAILURE);
+      }
+      get_eol(filename, lnr, keyword, &line);
+    }
     else if (strcasecmp(keyword, "nss_getgrent_skipmembers") == 0)
     {
       cfg->nss_getgrent_skipmembers = get_boolean(filename, lnr, keyword, &line);
@@ -1712,6 +1895,14 @@ static void cfg_dump(void)
   char buffer[1024];
   int *scopep;
   log_log(LOG_DEBUG, "CFG: threads %d", nslcd_cfg->threads);
+  if (nslcd_cfg->connections_min != nslcd_cfg->connections)
+    log_log(LOG_DEBUG, "CFG: connections %d %d", nslcd_cfg->connections_min,
+            nslcd_cfg->connections);
+  else
+    log_log(LOG_DEBUG, "CFG: connections %d", nslcd_cfg->connections);
+  if (nslcd_cfg->connections_per_uri > 0)
+    log_log(LOG_DEBUG, "CFG: connections_per_uri %d", nslcd_cfg->connections_per_uri);
+  log_log(LOG_DEBUG, "CFG: pam_bind_connections %d", nslcd_cfg->pam_bind_connections);
   if (nslcd_cfg->uidname != NULL)
     log_log(LOG_DEBUG, "CFG: uid %s", nslcd_cfg->uidname);
   else if (nslcd_cfg->uid != NOUID)
@@ -1827,6 +2018,13 @@ static void cfg_dump(void)
   log_log(LOG_DEBUG, "CFG: bind_timelimit %d", nslcd_cfg->bind_timelimit);
   log_log(LOG_DEBUG, "CFG: timelimit %d", nslcd_cfg->timelimit);
   log_log(LOG_DEBUG, "CFG: idle_timelimit %d", nslcd_cfg->idle_timelimit);
+  log_log(LOG_DEBUG, "CFG: idle_reconnect %s", print_boolean(nslcd_cfg->idle_reconnect));
+#ifdef LDAP_OPT_X_KEEPALIVE_IDLE
+  if (nslcd_cfg->tcp_keepalive_idle > 0)
+    log_log(LOG_DEBUG, "CFG: tcp_keepalive %d %d %d",
+            nslcd_cfg->tcp_keepalive_idle, nslcd_cfg->tcp_keepalive_interval,
+            nslcd_cfg->tcp_keepalive_probes);
+#endif /* LDAP_OPT_X_KEEPALIVE_IDLE */
   log_log(LOG_DEBUG, "CFG: reconnect_sleeptime %d", nslcd_cfg->reconnect_sleeptime);
   log_log(LOG_DEBUG, "CFG: reconnect_retrytime %d", nslcd_cfg->reconnect_retrytime);
 #ifdef LDAP_OPT_X_TLS
@@ -1879,6 +2077,7 @@ static void cfg_dump(void)
   log_log(LOG_DEBUG, "CFG: nss_uid_offset %lu", (unsigned long int)nslcd_cfg->nss_uid_offset);
   log_log(LOG_DEBUG, "CFG: nss_gid_offset %lu", (unsigned long int)nslcd_cfg->nss_gid_offset);
   log_log(LOG_DEBUG, "CFG: nss_nested_groups %s", print_boolean(nslcd_cfg->nss_nested_groups));
+  log_log(LOG_DEBUG, "CFG: nss_nested_groups_batch %d", nslcd_cfg->nss_nested_groups_batch);
   log_log(LOG_DEBUG, "CFG: nss_getgrent_skipmembers %s", print_boolean(nslcd_cfg->nss_getgrent_skipmembers));
   log_log(LOG_DEBUG, "CFG: nss_disable_enumeration %s", print_boolean(nslcd_cfg->nss_disable_enumeration));
   log_log(LOG_DEBUG, "CFG: validnames %s", nslcd_cfg->validnames_str);
@@ -1901,8 +2100,25 @@ static void cfg_dump(void)
   if (buffer[0] != '\0')
     log_log(LOG_DEBUG, "CFG: reconnect_invalidate %s", buffer);
   print_time(nslcd_cfg->cache_dn2uid_positive, buffer, sizeof(buffer) / 2);
-  print_time(nslcd_cfg->cache_dn2uid_positive, buffer + (sizeof(buffer) / 2), sizeof(buffer) / 2);
-  log_log(LOG_DEBUG, "CFG: cache dn2uid %s %s", buffer, buffer + (sizeof(buffer) / 2));
+  print_time(nslcd_cfg->cache_dn2uid_negative, buffer + (sizeof(buffer) / 2), sizeof(buffer) / 2);
+  if (nslcd_cfg->cache_dn2uid_maxentries > 0)
+    log_log(LOG_DEBUG, "CFG: cache dn2uid %s %s maxentries %d", buffer,
+            buffer + (sizeof(buffer) / 2), nslcd_cfg->cache_dn2uid_maxentries);
+  else
+    log_log(LOG_DEBUG, "CFG: cache dn2uid %s %s", buffer, buffer + (sizeof(buffer) / 2));
+  print_time(nslcd_cfg->cache_shared, buffer, sizeof(buffer));
+  log_log(LOG_DEBUG, "CFG: cache shared %s", buffer);
+  for (i = 0; i < LM_NONE; i++)
+  {
+    if ((nslcd_cfg->cache_positive[i] > 0) || (nslcd_cfg->cache_negative[i] > 0))
+    {
+      print_time(nslcd_cfg->cache_positive[i], buffer, sizeof(buffer) / 2);
+      print_time(nslcd_cfg->cache_negative[i], buffer + (sizeof(buffer) / 2), sizeof(buffer) / 2);
+      log_log(LOG_DEBUG, "CFG: cache %s %s %s", print_map(i), buffer, buffer + (sizeof(buffer) / 2));
+    }
+  }
+  print_size(nslcd_cfg->cache_size, buffer, sizeof(buffer));
+  log_log(LOG_DEBUG, "CFG: cache size %s", buffer);
 }
 
 void cfg_init(const char *fname)
@@ -82,6 +82,10 @@ struct myldap_uri {
 
 struct ldap_config {
   int threads;    /* the number of threads to start */
+  int connections; /* the maximum number of shared LDAP connections (0 for one per thread) */
+  int connections_min; /* the number of shared LDAP connections to keep open */
+  int connections_per_uri; /* the maximum number of shared connections per URI (0 for no limit) */
+  int pam_bind_connections; /* the number of connections kept for binding as users */
   char *uidname;  /* the user name specified in the uid option */
   uid_t uid;      /* the user id nslcd should be run as */
   gid_t gid;      /* the group id nslcd should be run as */
@@ -113,6 +117,10 @@ struct ldap_config {
   int bind_timelimit;       /* bind timelimit */
   int timelimit;            /* search timelimit */
   int idle_timelimit;       /* idle timeout */
+  int idle_reconnect;       /* reopen connections closed by idle_timelimit */
+  int tcp_keepalive_idle;     /* seconds before sending keepalive probes */
+  int tcp_keepalive_interval; /* seconds between keepalive probes */
+  int tcp_keepalive_probes;   /* number of unanswered probes to give up after */
   int reconnect_sleeptime;  /* seconds to sleep; doubled until max */
   int reconnect_retrytime;  /* maximum seconds to sleep */
 
@@ -127,6 +135,7 @@ struct ldap_config {
   uid_t nss_uid_offset; /* offset for uids retrieved from LDAP to avoid local uid clashes */
   gid_t nss_gid_offset; /* offset for gids retrieved from LDAP to avoid local gid clashes */
   int nss_nested_groups; /* whether to expand nested groups */
+  int nss_nested_groups_batch; /* number of groups to look up parents of in one search */
   int nss_getgrent_skipmembers;  /* whether to skip member lookups */
   int nss_disable_enumeration;  /* enumeration turned on or off */
   regex_t validnames; /* the regular expression to determine valid names */
@@ -139,6 +148,11 @@ struct ldap_config {
 
   time_t cache_dn2uid_positive;
   time_t cache_dn2uid_negative;
+  int cache_dn2uid_maxentries; /* maximum number of dn2uid entries (0 is no limit) */
+  time_t cache_shared; /* time results are published in the shared cache */
+  time_t cache_positive[LM_NONE]; /* time found entries are cached per map */
+  time_t cache_negative[LM_NONE]; /* time missing entries are cached per map */
+  size_t cache_size; /* maximum memory used for the map caches */
 };
 
 /* this is a pointer to the global configuration, it should be available
@@ -36,6 +36,7 @@
 #include <regex.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <time.h>
 
 #include "nslcd.h"
 #include "common.h"
@@ -59,6 +60,103 @@ int mysnprintf(char *buffer, size_t buflen, const char *format, ...)
   return ((res < 0) || (((size_t)res) >= buflen));
 }
 
+int mkfilter_anyof(const char *filter, const char *attr,
+                   const char **values, int numvalues,
+                   char *buffer, size_t buflen)
+{
+  char first[BUFLEN_SAFEDN];
+  char safevalue[BUFLEN_SAFEDN];
+  size_t len, sz;
+  int i;
+  /* escape the first value */
+  if ((numvalues < 1) || (myldap_escape(values[0], first, sizeof(first))))
+  {
+    log_log(LOG_ERR, "mkfilter_anyof(): safevalue buffer too small");
+    return -1;
+  }
+  /* the filter for a single value */
+  if (mysnprintf(buffer, buflen, "(&%s(%s=%s))", filter, attr, first))
+    return -1;
+  if (numvalues == 1)
+    return 1;
+  /* add values as long as they fit (leaving room for the closing
+     parentheses) */
+  if (mysnprintf(buffer, buflen, "(&%s(|(%s=%s)", filter, attr, first))
+    return -1;
+  len = strlen(buffer);
+  for (i = 1; i < numvalues; i++)
+  {
+    if (myldap_escape(values[i], safevalue, sizeof(safevalue)))
+      break;
+    sz = strlen(attr) + strlen(safevalue) + 3;
+    if ((len + sz + 2) >= buflen)
+      break;
+    sprintf(buffer + len, "(%s=%s)", attr, safevalue);
+    len += sz;
+  }
+  /* fall back to the single value filter if nothing else fit */
+  if ((i == 1) || ((len + 2) >= buflen))
+  {
+    (void)mysnprintf(buffer, buflen, "(&%s(%s=%s))", filter, attr, first);
+    return 1;
+  }
+  strcpy(buffer + len, "))");
+  return i;
+}
+
+/* read a single key of a batch request into the buffer */
+static int read_batch_key(TFILE *fp, int numeric, char *buffer)
+{
+  int32_t tmpint32;
+  int32_t value;
+  char name[BUFLEN_NAME];
+  if (numeric)
+  {
+    READ_INT32(fp, value);
+    return mysnprintf(buffer, BUFLEN_NAME, "%lu",
+                      (unsigned long int)(uint32_t)value);
+  }
+  READ_STRING(fp, name);
+  strcpy(buffer, name);
+  return 0;
+}
+
+int read_batch(TFILE *fp, int numeric, char ***keys)
+{
+  int32_t tmpint32;
+  int32_t num;
+  char **list;
+  char *buffer;
+  int i;
+  READ_INT32(fp, num);
+  if ((num < 0) || (num > NSLCD_BATCH_MAXKEYS))
+  {
+    log_log(LOG_WARNING, "invalid number of keys in batch request: %d",
+            (int)num);
+    return -1;
+  }
+  /* the keys are stored after the list of pointers */
+  list = (char **)malloc((num + 1) * sizeof(char *) + num * BUFLEN_NAME);
+  if (list == NULL)
+  {
+    log_log(LOG_CRIT, "read_batch(): malloc() failed to allocate memory");
+    return -1;
+  }
+  buffer = (char *)(list + num + 1);
+  for (i = 0; i < num; i++)
+  {
+    list[i] = buffer + i * BUFLEN_NAME;
+    if (read_batch_key(fp, numeric, list[i]))
+    {
+      free(list);
+      return -1;
+    }
+  }
+  list[num] = NULL;
+  *keys = list;
+  return (int)num;
+}
+
 /* get a name of a signal with a given signal number */
 const char *signame(int signum)
 {
@@ -207,6 +305,49 @@ int isvalidname(const char *name)
   return regexec(&nslcd_cfg->validnames, name, 0, NULL, 0) == 0;
 }
 
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+/* the shared cache that is published for the NSS module */
+SHMCACHE *nslcd_shmcache = NULL;
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+
+/* open a memory stream for writing a result entry for the shared cache */
+TFILE *shared_open(void)
+{
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  if (nslcd_shmcache != NULL)
+    return tio_memopen(NULL, 0, SHARED_MAXENTRY);
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+  return NULL;
+}
+
+/* publish the entry in the shared cache and write it to the stream */
+int shared_write(TFILE *fp, TFILE *mfp, int32_t action,
+                 const void *key, size_t keylen)
+{
+  const void *data;
+  size_t len;
+  int rc;
+  data = tio_memdata(mfp, &len);
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  shmcache_store(nslcd_shmcache, action, key, keylen, data, len,
+                 time(NULL) + nslcd_cfg->cache_shared);
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+  rc = tio_write(fp, data, len);
+  if (rc)
+    log_log(LOG_WARNING, "error writing to client: %s", strerror(errno));
+  (void)tio_close(mfp);
+  return rc ? -1 : 0;
+}
+
+/* remove the entry from the shared cache */
+void shared_invalidate(int32_t action, const void *key, size_t keylen)
+{
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  if (nslcd_shmcache != NULL)
+    shmcache_invalidate(nslcd_shmcache, action, key, keylen);
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+}
+
 /* this writes a single address to the stream */
 int write_address(TFILE *fp, MYLDAP_ENTRY *entry, const char *attr,
                   const char *addr)
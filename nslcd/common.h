@@ -30,10 +30,12 @@
 #include <stdint.h>
 #endif /* HAVE_STDINT_H */
 #include <sys/types.h>
+#include <time.h>
 
 #include "nslcd.h"
 #include "common/nslcd-prot.h"
 #include "common/tio.h"
+#include "common/shmcache.h"
 #include "compat/attrs.h"
 #include "myldap.h"
 #include "cfg.h"
@@ -67,6 +69,21 @@ int mysnprintf(char *buffer, size_t buflen, const char *format, ...)
 /* get a name of a signal with a given signal number */
 const char *signame(int signum);
 
+/* Create a search filter that matches entries that match filter and where
+   attr has any of the specified values (the values are escaped). As many
+   values as fit in the buffer are used. Returns the number of values used
+   or -1 if not even the first value fits. */
+int mkfilter_anyof(const char *filter, const char *attr,
+                   const char **values, int numvalues,
+                   char *buffer, size_t buflen);
+
+/* Read the keys of a batch request (see NSLCD_BATCH_MAXKEYS) from the
+   stream. The keys are strings or, if numeric is set, 32-bit numbers that
+   are returned as decimal strings (of at most BUFLEN_NAME bytes). Returns
+   the number of keys or -1 on errors. The returned list should be freed
+   with free(). */
+int read_batch(TFILE *fp, int numeric, char ***keys);
+
 /* return the fully qualified domain name of the current host
    the returned value does not need to be freed but is re-used for every
    call */
@@ -118,9 +135,24 @@ MUST_USE char *lookup_dn2uid(MYLDAP_SESSION *session, const char *dn,
 MUST_USE char *dn2uid(MYLDAP_SESSION *session, const char *dn, char *buf,
                       size_t buflen);
 
+/* transforms a number of DNs into uids, the DNs that need an LDAP lookup
+   are looked up with several searches outstanding at the same time; for
+   each DN either NULL or a strdup()ed uid is stored in uids */
+void dn2uids(MYLDAP_SESSION *session, const char **dns, int numdns,
+             char **uids);
+
+/* get the number of hits, misses and evicted entries of the cache that is
+   used by dn2uid() */
+void dn2uid_cache_stats(unsigned long *hits, unsigned long *misses,
+                        unsigned long *evictions);
+
 /* use the user id to lookup an LDAP entry */
 MYLDAP_ENTRY *uid2entry(MYLDAP_SESSION *session, const char *uid, int *rcp);
 
+/* remove the cached responses for the user (as returned by uid2entry())
+   from the cache, this is done after the user entry is modified */
+void passwd_invalidate(MYLDAP_ENTRY *entry, const char *username);
+
 /* transforms the uid into a DN by doing an LDAP lookup */
 MUST_USE char *uid2dn(MYLDAP_SESSION *session, const char *uid, char *buf,
                       size_t buflen);
@@ -137,6 +169,9 @@ void get_shadow_properties(MYLDAP_ENTRY *entry, long *lastchangedate,
                            unsigned long *flag);
 
 
+/* remove all netgroup closures that are kept between requests */
+void netgroup_cache_clear(void);
+
 /* check whether the nsswitch file should be reloaded */
 void nsswitch_check_reload(void);
 
@@ -150,6 +185,94 @@ int invalidator_start(void);
 /* signal invalidator to invalidate the selected external cache */
 void invalidator_do(enum ldap_map_selector map);
 
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+/* the shared cache that is published for the NSS module (NULL if the
+   shared cache is not used) */
+extern SHMCACHE *nslcd_shmcache;
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+
+/* the maximum combined size of the request key and the result entry that
+   is published in the shared cache (what fits in a slot of the cache
+   file), callers should not write larger entries to the memory stream */
+#define SHARED_MAXENTRY     SHMCACHE_MAXDATA
+
+/* Open a memory stream for writing a single result entry that is to be
+   published in the shared cache. Returns NULL if the shared cache is not
+   used. */
+TFILE *shared_open(void);
+
+/* Publish the result entry that was written to the memory stream in the
+   shared cache for the request (action and key), write the entry to fp
+   and close the memory stream. */
+int shared_write(TFILE *fp, TFILE *mfp, int32_t action,
+                 const void *key, size_t keylen);
+
+/* Remove the result entry for the request (action and key) from the
+   shared cache. */
+void shared_invalidate(int32_t action, const void *key, size_t keylen);
+
+/* Build the key that is used to look up the response to a request in the
+   cache. The key should uniquely identify the request parameters (and the
+   caller if that influences the response). Returns NULL if responses to
+   the request are never cached or shared between concurrent requests. */
+const char *cache_key(char *buffer, size_t buflen, int32_t action,
+                      const char *format, ...)
+  LIKE_PRINTF(4, 5);
+
+/* Write the cached response for the request to the stream. Returns 1 if
+   the response was written, 0 if it was not found in the cache and -1 on
+   write errors. If the response was not found, the response that is
+   written next to the stream should be passed to cache_store(). If
+   another thread is already looking up the same key this waits for that
+   thread and writes the same response (or returns -1 if it failed). */
+int cache_write(TFILE *fp, const char *key);
+
+/* Store the response that was written to the stream since cache_write()
+   in the cache and pass it to the threads that are waiting for it. */
+void cache_store(TFILE *fp, int32_t action, const char *key);
+
+/* Pass the response that was written to the stream since cache_write()
+   to the threads that are waiting for it without storing it in the cache
+   (e.g. because it is incomplete). */
+void cache_share(TFILE *fp);
+
+/* Mark the search that was started by cache_write() on the stream as
+   failed if cache_store() was not called. This should be called after
+   handling each request. */
+void cache_done(TFILE *fp);
+
+/* Return a copy of the data that was stored with cache_put() or NULL if
+   it was not found or has expired. The caller should free() the data. */
+void *cache_get(const char *key, size_t *len)
+  MUST_USE;
+
+/* Store arbitrary data in the cache for the specified number of
+   seconds. */
+void cache_put(const char *key, const void *data, size_t len, time_t ttl);
+
+/* Remove the cached passwd, shadow and group membership responses for
+   the user with the specified name (if not NULL) and the passwd responses
+   for the specified uid (if not (uid_t)-1). */
+void cache_invalidate(const char *name, uid_t uid);
+
+/* Get the statistics of the response cache. */
+void cache_stats(unsigned long *hits, unsigned long *misses,
+                 unsigned long *shared, unsigned long *evictions,
+                 unsigned long *used);
+
+/* Record the time the server was started for the statistics. */
+void stats_init(void);
+
+/* Record the start time of a request. */
+void stats_request_start(struct timespec *start);
+
+/* Count the handled request and its latency (rc is the return value of
+   the request handler). */
+void stats_request_done(int32_t action, int rc, const struct timespec *start);
+
+/* Count an LDAP search with the specified result code. */
+void stats_search(int rc);
+
 /* common buffer lengths */
 #define BUFLEN_NAME         256  /* user, group names and such */
 #define BUFLEN_SAFENAME     300  /* escaped name */
@@ -160,6 +283,7 @@ void invalidator_do(enum ldap_map_selector map);
 #define BUFLEN_FILTER      4096  /* search filters */
 #define BUFLEN_HOSTNAME     256  /* host names or FQDN (and safe version) */
 #define BUFLEN_MESSAGE     1024  /* message strings */
+#define BUFLEN_CACHEKEY     600  /* keys for the response cache */
 
 /* provide strtouid() function alias */
 #if SIZEOF_UID_T == SIZEOF_UNSIGNED_LONG_INT
@@ -209,6 +333,7 @@ void shadow_init(void);
 /* these are the different functions that handle the database
    specific actions, see nslcd.h for the action descriptions */
 int nslcd_config_get(TFILE *fp, MYLDAP_SESSION *session);
+int nslcd_stats(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_alias_byname(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_alias_all(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_ether_byname(TFILE *fp, MYLDAP_SESSION *session);
@@ -216,18 +341,24 @@ int nslcd_ether_byether(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_ether_all(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_group_byname(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_group_bygid(TFILE *fp, MYLDAP_SESSION *session);
+int nslcd_group_bynames(TFILE *fp, MYLDAP_SESSION *session);
+int nslcd_group_bygids(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_group_all(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_host_byname(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_host_byaddr(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_host_all(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_netgroup_byname(TFILE *fp, MYLDAP_SESSION *session);
+int nslcd_netgroup_expand(TFILE *fp, MYLDAP_SESSION *session);
+int nslcd_netgroup_innetgr(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_netgroup_all(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_network_byname(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_network_byaddr(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_network_all(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_passwd_byname(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
 int nslcd_passwd_byuid(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
+int nslcd_passwd_bynames(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
+int nslcd_passwd_byuids(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
 int nslcd_passwd_all(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
 int nslcd_protocol_byname(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_protocol_bynumber(TFILE *fp, MYLDAP_SESSION *session);
@@ -247,23 +378,42 @@ int nslcd_pam_sess_c(TFILE *fp, MYLDAP_SESSION *session);
 int nslcd_pam_pwmod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
 int nslcd_usermod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
 
+/* the amount of output that may be buffered while going over search
+   results, when more output is pending the results are not processed
+   further until the client has read it (this limits the memory that is
+   used by enumerations and means that the next page of results is only
+   requested from the LDAP server when the client keeps up) */
+#define NSLCD_WRITE_BACKLOG (64 * 1024)
+
 /* macros for generating service handling code */
 #define NSLCD_HANDLE(db, fn, action, readfn, mkfilter, writefn)             \
   int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session)                 \
-  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn)
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, NULL, mkfilter, writefn)
 #define NSLCD_HANDLE_UID(db, fn, action, readfn, mkfilter, writefn)         \
   int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid) \
-  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn)
-#define NSLCD_HANDLE_BODY(db, fn, action, readfn, mkfilter, writefn)        \
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, NULL, mkfilter, writefn)
+/* variants of the above where the response may be cached, the mkkey
+   expression should return a key with cache_key() */
+#define NSLCD_HANDLE_CACHED(db, fn, action, readfn, mkkey, mkfilter, writefn) \
+  int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session)                 \
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkkey, mkfilter, writefn)
+#define NSLCD_HANDLE_UID_CACHED(db, fn, action, readfn, mkkey, mkfilter, writefn) \
+  int nslcd_##db##_##fn(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid) \
+  NSLCD_HANDLE_BODY(db, fn, action, readfn, mkkey, mkfilter, writefn)
+#define NSLCD_HANDLE_BODY(db, fn, action, readfn, mkkey, mkfilter, writefn) \
   {                                                                         \
     /* define common variables */                                           \
     int32_t tmpint32;                                                       \
     MYLDAP_SEARCH *search;                                                  \
     MYLDAP_ENTRY *entry;                                                    \
     const char *base;                                                       \
+    const char *cachekey;                                                   \
     int rc, i;                                                              \
     /* read request parameters */                                           \
     readfn;                                                                 \
+    /* write the response from the cache if we have it */                   \
+    if (((cachekey = mkkey) != NULL) && ((rc = cache_write(fp, cachekey)) != 0)) \
+      return (rc > 0) ? 0 : -1;                                             \
     /* write the response header */                                         \
     WRITE_INT32(fp, NSLCD_VERSION);                                         \
     WRITE_INT32(fp, action);                                                \
@@ -287,13 +437,19 @@ int nslcd_usermod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid);
       {                                                                     \
         if (writefn)                                                        \
           return -1;                                                        \
+        /* wait for the client to catch up before getting more results */   \
+        if ((cachekey == NULL) && (tio_wpending(fp) > NSLCD_WRITE_BACKLOG) && \
+            (tio_flush(fp)))                                                \
+          return -1;                                                        \
       }                                                                     \
     }                                                                       \
     /* write the final result code */                                       \
-    if (rc == LDAP_SUCCESS)                                                 \
-    {                                                                       \
-      WRITE_INT32(fp, NSLCD_RESULT_END);                                    \
-    }                                                                       \
+    if (rc != LDAP_SUCCESS)                                                 \
+      return -1;                                                            \
+    WRITE_INT32(fp, NSLCD_RESULT_END);                                      \
+    /* store the complete response in the cache */                          \
+    if (cachekey != NULL)                                                   \
+      cache_store(fp, action, cachekey);                                    \
     return 0;                                                               \
   }
 
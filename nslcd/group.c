@@ -33,6 +33,7 @@
 #include <grp.h>
 
 #include "common/set.h"
+#include "common/dict.h"
 #include "common.h"
 #include "log.h"
 #include "myldap.h"
@@ -86,6 +87,10 @@ static const char **group_attrs = NULL;
 /* the attribute list for bymember searches (without member attributes) */
 static const char **group_bymember_attrs = NULL;
 
+/* the attribute list for searches for the parents of a number of groups
+   (the member attribute is used to find the groups that they belong to) */
+static const char **group_parents_attrs = NULL;
+
 /* create a search filter for searching a group entry
    by name, return -1 on errors */
 static int mkfilter_group_byname(const char *name,
@@ -162,22 +167,6 @@ static int mkfilter_group_bymember(MYLDAP_SESSION *session,
                     attmap_group_member, safedn);
 }
 
-static int mkfilter_group_bymemberdn(const char *dn,
-                                     char *buffer, size_t buflen)
-{
-  char safedn[BUFLEN_SAFEDN];
-  /* escape DN */
-  if (myldap_escape(dn, safedn, sizeof(safedn)))
-  {
-    log_log(LOG_ERR, "mkfilter_group_bymemberdn(): safedn buffer too small");
-    return -1;
-  }
-  return mysnprintf(buffer, buflen,
-                    "(&%s(%s=%s))",
-                    group_filter,
-                    attmap_group_member, safedn);
-}
-
 void group_init(void)
 {
   int i;
@@ -224,16 +213,52 @@ void group_init(void)
     log_log(LOG_CRIT, "malloc() failed to allocate memory");
     exit(EXIT_FAILURE);
   }
+  /* set up the attribute list for parent searches */
+  attmap_add_attributes(set, attmap_group_member);
+  group_parents_attrs = set_tolist(set);
+  if (group_parents_attrs == NULL)
+  {
+    log_log(LOG_CRIT, "malloc() failed to allocate memory");
+    exit(EXIT_FAILURE);
+  }
   set_free(set);
 }
 
+/* write a single group entry (without the NSLCD_RESULT_BEGIN) */
+static int write_group_entry(TFILE *fp, const char *name, const char *passwd,
+                             gid_t gid, const char **members)
+{
+  int32_t tmpint32, tmp2int32, tmp3int32;
+  WRITE_STRING(fp, name);
+  WRITE_STRING(fp, passwd);
+  WRITE_INT32(fp, gid);
+  WRITE_STRINGLIST(fp, members);
+  return 0;
+}
+
+/* return the size of the group entry that would be written */
+static size_t group_entry_size(const char *name, const char *passwd,
+                               const char **members)
+{
+  size_t size;
+  int i;
+  size = 4 * sizeof(int32_t) + strlen(name) + strlen(passwd);
+  if (members != NULL)
+    for (i = 0; members[i] != NULL; i++)
+      size += sizeof(int32_t) + strlen(members[i]);
+  return size;
+}
+
 static int do_write_group(TFILE *fp, MYLDAP_ENTRY *entry,
                           const char **names, gid_t gids[], int numgids,
                           const char *passwd, const char **members,
-                          const char *reqname)
+                          const char *reqname, const gid_t *reqgid)
 {
-  int32_t tmpint32, tmp2int32, tmp3int32;
+  int32_t tmpint32;
+  TFILE *mfp;
   int i, j;
+  /* only single entry lookups are published in the shared cache */
+  int shared = (members != NULL) && ((reqname != NULL) || (reqgid != NULL));
   /* write entries for all names and gids */
   for (i = 0; names[i] != NULL; i++)
   {
@@ -247,10 +272,31 @@ static int do_write_group(TFILE *fp, MYLDAP_ENTRY *entry,
       for (j = 0; j < numgids; j++)
       {
         WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
-        WRITE_STRING(fp, names[i]);
-        WRITE_STRING(fp, passwd);
-        WRITE_INT32(fp, gids[j]);
-        WRITE_STRINGLIST(fp, members);
+        /* publish the first entry in the shared cache if it is small */
+        if ((shared) &&
+            ((group_entry_size(names[i], passwd, members) +
+              ((reqname != NULL) ? strlen(reqname) : sizeof(gid_t))) <=
+             SHARED_MAXENTRY) &&
+            ((mfp = shared_open()) != NULL))
+        {
+          shared = 0;
+          if (write_group_entry(mfp, names[i], passwd, gids[j], members))
+          {
+            (void)tio_close(mfp);
+            return -1;
+          }
+          if (reqname != NULL)
+          {
+            if (shared_write(fp, mfp, NSLCD_ACTION_GROUP_BYNAME,
+                             reqname, strlen(reqname)))
+              return -1;
+          }
+          else if (shared_write(fp, mfp, NSLCD_ACTION_GROUP_BYGID,
+                                reqgid, sizeof(gid_t)))
+            return -1;
+        }
+        else if (write_group_entry(fp, names[i], passwd, gids[j], members))
+          return -1;
       }
     }
   }
@@ -260,9 +306,9 @@ static int do_write_group(TFILE *fp, MYLDAP_ENTRY *entry,
 static void getmembers(MYLDAP_ENTRY *entry, MYLDAP_SESSION *session,
                        SET *members, SET *seen, SET *subgroups)
 {
-  char buf[BUFLEN_NAME];
-  int i;
-  const char **values;
+  int i, num;
+  const char **values, **dns;
+  char **uids;
   const char ***derefs;
   /* add the memberUid values */
   values = myldap_get_values(entry, attmap_group_memberUid);
@@ -298,21 +344,47 @@ static void getmembers(MYLDAP_ENTRY *entry, MYLDAP_SESSION *session,
   }
   /* add the member values */
   values = myldap_get_values(entry, attmap_group_member);
-  if (values != NULL)
-    for (i = 0; values[i] != NULL; i++)
+  if (values == NULL)
+    return;
+  for (num = 0; values[num] != NULL; num++)
+    /* nothing */ ;
+  dns = (const char **)malloc((num > 0 ? num : 1) * sizeof(char *));
+  uids = (char **)malloc((num > 0 ? num : 1) * sizeof(char *));
+  if ((dns == NULL) || (uids == NULL))
+  {
+    log_log(LOG_CRIT, "getmembers(): malloc() failed to allocate memory");
+    if (dns != NULL)
+      free(dns);
+    if (uids != NULL)
+      free(uids);
+    return;
+  }
+  /* collect the values that have not been seen before */
+  num = 0;
+  for (i = 0; values[i] != NULL; i++)
+  {
+    if ((seen == NULL) || (!set_contains(seen, values[i])))
     {
-      if ((seen == NULL) || (!set_contains(seen, values[i])))
-      {
-        if (seen != NULL)
-          set_add(seen, values[i]);
-        /* transform the DN into a uid (dn2uid() already checks validity) */
-        if (dn2uid(session, values[i], buf, sizeof(buf)) != NULL)
-          set_add(members, buf);
-        /* wasn't a UID - try handling it as a nested group */
-        else if (subgroups != NULL)
-          set_add(subgroups, values[i]);
-      }
+      if (seen != NULL)
+        set_add(seen, values[i]);
+      dns[num++] = values[i];
+    }
+  }
+  /* transform the DNs into uids (dn2uids() already checks validity) */
+  dn2uids(session, dns, num, uids);
+  for (i = 0; i < num; i++)
+  {
+    if (uids[i] != NULL)
+    {
+      set_add(members, uids[i]);
+      free(uids[i]);
     }
+    /* wasn't a UID - try handling it as a nested group */
+    else if (subgroups != NULL)
+      set_add(subgroups, dns[i]);
+  }
+  free(dns);
+  free(uids);
 }
 
 /* the maximum number of gidNumber attributes per entry */
@@ -388,13 +460,13 @@ static int write_group(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname,
   /* get group members (memberUid&member) */
   if (wantmembers)
   {
-    set = set_new();
+    set = set_new_flags(nslcd_cfg->ignorecase ? SET_IGNORECASE : 0);
     if (set != NULL)
     {
       if (nslcd_cfg->nss_nested_groups)
       {
-        seen = set_new();
-        subgroups = set_new();
+        seen = set_new_flags(SET_DN);
+        subgroups = set_new_flags(SET_DN);
       }
       /* collect the members from this group */
       getmembers(entry, session, set, seen, subgroups);
@@ -421,17 +493,18 @@ static int write_group(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname,
   /* write entries (split to a separate function so we can ensure the call
      to free() below in case a write fails) */
   rc = do_write_group(fp, entry, names, gids, numgids, passwd, members,
-                      reqname);
+                      reqname, reqgid);
   /* free and return */
   if (members != NULL)
     free(members);
   return rc;
 }
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_CACHED(
   group, byname, NSLCD_ACTION_GROUP_BYNAME,
   char name[BUFLEN_NAME];
   char filter[BUFLEN_FILTER];
+  char keybuf[BUFLEN_CACHEKEY];
   READ_STRING(fp, name);
   log_setrequest("group=\"%s\"", name);
   if (!isvalidname(name))
@@ -439,20 +512,521 @@ NSLCD_HANDLE(
     log_log(LOG_WARNING, "request denied by validnames option");
     return -1;
   },
+  cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_GROUP_BYNAME, "%s", name),
   mkfilter_group_byname(name, filter, sizeof(filter)),
   write_group(fp, entry, name, NULL, 1, session)
 )
 
-NSLCD_HANDLE(
+NSLCD_HANDLE_CACHED(
   group, bygid, NSLCD_ACTION_GROUP_BYGID,
   gid_t gid;
   char filter[BUFLEN_FILTER];
+  char keybuf[BUFLEN_CACHEKEY];
   READ_INT32(fp, gid);
   log_setrequest("group=%lu", (unsigned long int)gid);,
+  cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_GROUP_BYGID,
+            "%lu", (unsigned long int)gid),
   mkfilter_group_bygid(gid, filter, sizeof(filter)),
   write_group(fp, entry, NULL, &gid, 1, session)
 )
 
+/* check whether the entry has the name as cn value */
+static int entry_has_name(MYLDAP_ENTRY *entry, const char *name)
+{
+  const char **values;
+  int i;
+  values = myldap_get_values(entry, attmap_group_cn);
+  for (i = 0; (values != NULL) && (values[i] != NULL); i++)
+    if (STR_CMP(name, values[i]) == 0)
+      return 1;
+  return 0;
+}
+
+/* check whether the entry has a gidNumber value that matches the gid
+   (with nss_gid_offset applied) */
+static int entry_has_gid(MYLDAP_ENTRY *entry, gid_t gid)
+{
+  const char **values;
+  char *tmp;
+  gid_t value;
+  int i;
+  values = myldap_get_values_len(entry, attmap_group_gidNumber);
+  for (i = 0; (values != NULL) && (values[i] != NULL); i++)
+  {
+    if (gidSid != NULL)
+      value = (gid_t)binsid2id(values[i]);
+    else
+    {
+      errno = 0;
+      value = strtogid(values[i], &tmp, 10);
+      if ((*(values[i]) == '\0') || (*tmp != '\0') || (errno != 0))
+        continue;
+    }
+    if ((value + nslcd_cfg->nss_gid_offset) == gid)
+      return 1;
+  }
+  return 0;
+}
+
+/* write the group entries of the entry for each of the names or gids of
+   the batch request that the entry matches, other names and gids of the
+   entry are left out as with single lookups */
+static int write_group_requested(TFILE *fp, MYLDAP_ENTRY *entry,
+                                 int32_t action, const char **values,
+                                 int num, MYLDAP_SESSION *session)
+{
+  gid_t gid;
+  int i;
+  for (i = 0; i < num; i++)
+  {
+    if (action == NSLCD_ACTION_GROUP_BYNAMES)
+    {
+      if ((entry_has_name(entry, values[i])) &&
+          (write_group(fp, entry, values[i], NULL, 1, session)))
+        return -1;
+    }
+    else
+    {
+      /* the gid offset was removed from the values for the filter */
+      gid = strtogid(values[i], NULL, 10);
+      if (gidSid == NULL)
+        gid += nslcd_cfg->nss_gid_offset;
+      if ((entry_has_gid(entry, gid)) &&
+          (write_group(fp, entry, NULL, &gid, 1, session)))
+        return -1;
+    }
+  }
+  return 0;
+}
+
+/* write the group entries for a batch request, the values are searched
+   for in as few searches as possible */
+static int write_group_batch(TFILE *fp, MYLDAP_SESSION *session,
+                             int32_t action, const char *attr,
+                             const char **values, int num)
+{
+  int32_t tmpint32;
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  const char *base;
+  char filter[BUFLEN_FILTER];
+  int i, j, n, rc = LDAP_SUCCESS;
+  /* write the response header */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, action);
+  for (i = 0; i < num; i += n)
+  {
+    /* binary objectSid values are built by mkfilter_group_bygid() and
+       cannot be combined */
+    if ((action == NSLCD_ACTION_GROUP_BYGIDS) && (gidSid != NULL))
+    {
+      n = 1;
+      if (mkfilter_group_bygid(strtogid(values[i], NULL, 10),
+                               filter, sizeof(filter)))
+        n = -1;
+    }
+    else
+      n = mkfilter_anyof(group_filter, attr, values + i, num - i,
+                         filter, sizeof(filter));
+    if (n < 0)
+    {
+      log_log(LOG_ERR, "write_group_batch(): filter buffer too small");
+      return -1;
+    }
+    /* perform a search for each search base */
+    for (j = 0; (base = group_bases[j]) != NULL; j++)
+    {
+      search = myldap_search(session, base, group_scope, filter,
+                             group_attrs, NULL);
+      if (search == NULL)
+        return -1;
+      while ((entry = myldap_get_entry(search, &rc)) != NULL)
+      {
+        if (write_group_requested(fp, entry, action, values + i, n,
+                                  session))
+          return -1;
+        if ((tio_wpending(fp) > NSLCD_WRITE_BACKLOG) && (tio_flush(fp)))
+          return -1;
+      }
+    }
+    if (rc != LDAP_SUCCESS)
+      return -1;
+  }
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
+
+int nslcd_group_bynames(TFILE *fp, MYLDAP_SESSION *session)
+{
+  char **names;
+  int num, i, n, rc;
+  /* read request parameters */
+  num = read_batch(fp, 0, &names);
+  if (num < 0)
+    return -1;
+  log_setrequest("group(%d names)", num);
+  /* leave out names that are denied by the validnames option */
+  for (i = n = 0; i < num; i++)
+  {
+    if (isvalidname(names[i]))
+      names[n++] = names[i];
+    else
+      log_log(LOG_WARNING, "\"%s\": request denied by validnames option",
+              names[i]);
+  }
+  /* write the entries (split to a separate function so we can ensure the
+     call to free() below in case a write fails) */
+  rc = write_group_batch(fp, session, NSLCD_ACTION_GROUP_BYNAMES,
+                         attmap_group_cn, (const char **)names, n);
+  free(names);
+  return rc;
+}
+
+int nslcd_group_bygids(TFILE *fp, MYLDAP_SESSION *session)
+{
+  char **gids;
+  gid_t gid;
+  int num, i, rc;
+  /* read request parameters */
+  num = read_batch(fp, 1, &gids);
+  if (num < 0)
+    return -1;
+  log_setrequest("group(%d gids)", num);
+  /* apply the gid offset (mkfilter_group_bygid() does that for
+     objectSid) */
+  if ((gidSid == NULL) && (nslcd_cfg->nss_gid_offset != 0))
+  {
+    for (i = 0; i < num; i++)
+    {
+      gid = strtogid(gids[i], NULL, 10) - nslcd_cfg->nss_gid_offset;
+      (void)mysnprintf(gids[i], BUFLEN_NAME, "%lu", (unsigned long int)gid);
+    }
+  }
+  /* write the entries (split to a separate function so we can ensure the
+     call to free() below in case a write fails) */
+  rc = write_group_batch(fp, session, NSLCD_ACTION_GROUP_BYGIDS,
+                         attmap_group_gidNumber, (const char **)gids, num);
+  free(gids);
+  return rc;
+}
+
+/* the maximum size of the data that is kept for the parents of a group */
+#define PARENTS_MAXSIZE (64 * 1024)
+
+/* Write the parent groups that were not seen before from the data that was
+   stored in the cache by write_parents(). For each parent group the data
+   contains the DN followed by the entries as written by write_group(). */
+static int write_cached_parents(TFILE *fp, const uint8_t *data, size_t len,
+                                SET *seen, SET *tocheck)
+{
+  const uint8_t *end = data + len;
+  const char *dn;
+  int32_t dnlen, datalen;
+  while (data < end)
+  {
+    memcpy(&dnlen, data, sizeof(int32_t));
+    data += sizeof(int32_t);
+    dn = (const char *)data;
+    data += dnlen;
+    memcpy(&datalen, data, sizeof(int32_t));
+    data += sizeof(int32_t);
+    if (!set_contains(seen, dn))
+    {
+      set_add(seen, dn);
+      set_add(tocheck, dn);
+      if (tio_write(fp, data, (size_t)datalen))
+        return -1;
+    }
+    data += datalen;
+  }
+  return 0;
+}
+
+/* Write the parent groups of the group with the specified DN from the
+   cache. Returns 1 if the parents were found in the cache, 0 if they were
+   not and -1 on write errors. */
+static int write_parents_cached(TFILE *fp, const char *dn,
+                                SET *seen, SET *tocheck)
+{
+  char keybuf[BUFLEN_CACHEKEY];
+  const char *key;
+  void *cached;
+  size_t len;
+  int rc;
+  key = cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_GROUP_BYMEMBER,
+                  "p %s", dn);
+  if ((key == NULL) || ((cached = cache_get(key, &len)) == NULL))
+    return 0;
+  rc = write_cached_parents(fp, (const uint8_t *)cached, len, seen, tocheck);
+  free(cached);
+  return (rc == 0) ? 1 : -1;
+}
+
+/* Add the parent group to the data that is stored in the cache for a
+   group. On errors (too many parents) the stream is closed and set to
+   NULL so that nothing is stored for the group. */
+static void add_cached_parent(TFILE **mfp, const char *parentdn,
+                              const void *data, size_t len)
+{
+  int32_t dnlen, datalen;
+  if (*mfp == NULL)
+    return;
+  dnlen = (int32_t)strlen(parentdn) + 1;
+  datalen = (int32_t)len;
+  if (tio_write(*mfp, &dnlen, sizeof(int32_t)) ||
+      tio_write(*mfp, parentdn, (size_t)dnlen) ||
+      tio_write(*mfp, &datalen, sizeof(int32_t)) ||
+      tio_write(*mfp, data, len))
+  {
+    /* too many parents to cache */
+    (void)tio_close(*mfp);
+    *mfp = NULL;
+  }
+}
+
+/* Set up the streams to collect the parents of each of the groups for the
+   cache. When looking up the parents of a number of groups in one search
+   the found parents are mapped back to the groups by their member values
+   (through the returned dictionary). Returns NULL if nothing is cached. */
+static TFILE **parents_cache_open(const char **dns, int numdns, DICT **dnidx)
+{
+  TFILE **mfps;
+  int i;
+  *dnidx = NULL;
+  if ((nslcd_cfg->cache_size == 0) ||
+      ((nslcd_cfg->cache_positive[LM_GROUP] == 0) &&
+       (nslcd_cfg->cache_negative[LM_GROUP] == 0)))
+    return NULL;
+  mfps = (TFILE **)calloc((size_t)numdns, sizeof(TFILE *));
+  if (mfps == NULL)
+    return NULL;
+  if (numdns > 1)
+  {
+    *dnidx = dict_new_flags(DICT_DN);
+    if (*dnidx == NULL)
+    {
+      free(mfps);
+      return NULL;
+    }
+  }
+  for (i = 0; i < numdns; i++)
+  {
+    mfps[i] = tio_memopen(NULL, 0, PARENTS_MAXSIZE);
+    if ((*dnidx != NULL) && (dict_put(*dnidx, dns[i], &(mfps[i]))))
+    {
+      log_log(LOG_CRIT, "parents_cache_open(): malloc() failed to allocate memory");
+      if (mfps[i] != NULL)
+        (void)tio_close(mfps[i]);
+      mfps[i] = NULL;
+    }
+  }
+  return mfps;
+}
+
+/* Add the parent group to the cached parents of the groups that are in
+   its member values. Returns -1 if the parent group could not be matched
+   to any of the groups. */
+static int parents_cache_add(TFILE **mfps, DICT *dnidx, MYLDAP_ENTRY *entry,
+                             const char *parentdn, const void *data, size_t len)
+{
+  const char **values;
+  TFILE **mfp;
+  int i, found = 0;
+  if (dnidx == NULL)
+  {
+    add_cached_parent(&(mfps[0]), parentdn, data, len);
+    return 0;
+  }
+  values = myldap_get_values(entry, attmap_group_member);
+  for (i = 0; (values != NULL) && (values[i] != NULL); i++)
+  {
+    mfp = (TFILE **)dict_get(dnidx, values[i]);
+    if (mfp != NULL)
+    {
+      add_cached_parent(mfp, parentdn, data, len);
+      found = 1;
+    }
+  }
+  return found ? 0 : -1;
+}
+
+/* Store the collected parents of each of the groups in the cache (if
+   store is set) and free the streams. */
+static void parents_cache_close(TFILE **mfps, DICT *dnidx,
+                                const char **dns, int numdns, int store)
+{
+  char keybuf[BUFLEN_CACHEKEY];
+  const char *key;
+  const void *data;
+  size_t len;
+  int i;
+  for (i = 0; i < numdns; i++)
+  {
+    if (mfps[i] == NULL)
+      continue;
+    key = cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_GROUP_BYMEMBER,
+                    "p %s", dns[i]);
+    if ((store) && (key != NULL))
+    {
+      data = tio_memdata(mfps[i], &len);
+      cache_put(key, data, len, (len > 0) ?
+                nslcd_cfg->cache_positive[LM_GROUP] :
+                nslcd_cfg->cache_negative[LM_GROUP]);
+    }
+    (void)tio_close(mfps[i]);
+  }
+  free(mfps);
+  if (dnidx != NULL)
+    dict_free(dnidx);
+}
+
+/* Write the groups that have any of the groups with the specified DNs as
+   member that were not seen before. The groups are searched for with as
+   few searches as possible. The parents of each of the groups are kept in
+   the cache so other lookups that encounter the same group do not need to
+   search for them again. Returns 0 on success, 1 if not all parents could
+   be searched for and -1 on errors. */
+static int write_parents(TFILE *fp, MYLDAP_SESSION *session,
+                         const char **dns, int numdns,
+                         SET *seen, SET *tocheck)
+{
+  char filter[BUFLEN_FILTER];
+  const char *base, *parentdn;
+  const char **attrs;
+  const void *data;
+  size_t len;
+  TFILE **mfps, *gfp;
+  DICT *dnidx;
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  int i, n, off, rc, complete = 1, store = 1;
+  /* collect the found groups to store them in the cache, the member
+     values are only needed to map the parents to the groups */
+  mfps = parents_cache_open(dns, numdns, &dnidx);
+  attrs = (dnidx != NULL) ? group_parents_attrs : group_bymember_attrs;
+  for (off = 0; off < numdns; off += n)
+  {
+    /* make filter for finding groups with any of our groups as member */
+    n = mkfilter_anyof(group_filter, attmap_group_member, dns + off,
+                       numdns - off, filter, sizeof(filter));
+    if (n < 0)
+    {
+      log_log(LOG_WARNING, "nslcd_group_bymember(): filter buffer too small");
+      if (mfps != NULL)
+        parents_cache_close(mfps, dnidx, dns, numdns, 0);
+      return -1;
+    }
+    /* do the LDAP searches */
+    for (i = 0; (base = group_bases[i]) != NULL; i++)
+    {
+      search = myldap_search(session, base, group_scope, filter, attrs, &rc);
+      if (search == NULL)
+      {
+        complete = 0;
+        continue;
+      }
+      while ((entry = myldap_get_entry(search, &rc)) != NULL)
+      {
+        parentdn = myldap_get_dn(entry);
+        /* write the entries for the group to a buffer */
+        gfp = tio_memopen(NULL, 0, PARENTS_MAXSIZE);
+        if ((gfp == NULL) || (write_group(gfp, entry, NULL, NULL, 0, session)))
+        {
+          log_log(LOG_WARNING, "%s: unable to write group", parentdn);
+          if (gfp != NULL)
+            (void)tio_close(gfp);
+          if (mfps != NULL)
+            parents_cache_close(mfps, dnidx, dns, numdns, 0);
+          return -1;
+        }
+        data = tio_memdata(gfp, &len);
+        /* add the group to the data for the cache (do not cache anything
+           if the group cannot be mapped to the groups it was found for) */
+        if ((mfps != NULL) &&
+            (parents_cache_add(mfps, dnidx, entry, parentdn, data, len)))
+        {
+          log_log(LOG_DEBUG, "%s: parent group not found in member values", parentdn);
+          store = 0;
+        }
+        /* write the group if we have not seen it yet */
+        if (!set_contains(seen, parentdn))
+        {
+          set_add(seen, parentdn);
+          set_add(tocheck, parentdn);
+          if (tio_write(fp, data, len))
+          {
+            (void)tio_close(gfp);
+            if (mfps != NULL)
+              parents_cache_close(mfps, dnidx, dns, numdns, 0);
+            return -1;
+          }
+        }
+        (void)tio_close(gfp);
+      }
+      if (rc != LDAP_SUCCESS)
+        complete = 0;
+    }
+  }
+  /* only store complete results in the cache */
+  if (mfps != NULL)
+    parents_cache_close(mfps, dnidx, dns, numdns, complete && store);
+  return complete ? 0 : 1;
+}
+
+/* Write all the parent groups of the groups in tocheck (and their parents)
+   that were not seen before. The groups are handled in batches of
+   nss_nested_groups_batch groups. Returns 0 on success, 1 if some parents
+   could not be searched for and -1 on errors. */
+static int write_nested_parents(TFILE *fp, MYLDAP_SESSION *session,
+                                SET *seen, SET *tocheck)
+{
+  char **dns;
+  char *dn;
+  int i, n, rc = 0, complete = 1;
+  dns = (char **)malloc(nslcd_cfg->nss_nested_groups_batch * sizeof(char *));
+  if (dns == NULL)
+  {
+    log_log(LOG_CRIT, "write_nested_parents(): malloc() failed to allocate memory");
+    return -1;
+  }
+  while (rc == 0)
+  {
+    /* collect the next groups for which the parents are not cached */
+    n = 0;
+    while ((n < nslcd_cfg->nss_nested_groups_batch) &&
+           ((dn = set_pop(tocheck)) != NULL))
+    {
+      rc = write_parents_cached(fp, dn, seen, tocheck);
+      if (rc == 0)
+        dns[n++] = dn;
+      else
+      {
+        free(dn);
+        if (rc < 0)
+          break;
+        rc = 0;
+      }
+    }
+    if (n == 0)
+      break;
+    /* search for the parents */
+    if (rc == 0)
+      rc = write_parents(fp, session, (const char **)dns, n, seen, tocheck);
+    for (i = 0; i < n; i++)
+      free(dns[i]);
+    /* keep going with the other groups if a search failed */
+    if (rc > 0)
+    {
+      complete = 0;
+      rc = 0;
+    }
+  }
+  free(dns);
+  if (rc < 0)
+    return -1;
+  return complete ? 0 : 1;
+}
+
 int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
 {
   /* define common variables */
@@ -464,7 +1038,10 @@ int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
   int rc, i;
   char name[BUFLEN_NAME];
   char filter[BUFLEN_FILTER];
+  char keybuf[BUFLEN_CACHEKEY];
+  const char *cachekey;
   SET *seen=NULL, *tocheck=NULL;
+  int nested = 0;
   /* read request parameters */
   READ_STRING(fp, name);
   log_setrequest("group/member=\"%s\"", name);
@@ -484,6 +1061,11 @@ int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
     WRITE_INT32(fp, NSLCD_RESULT_END);
     return 0;
   }
+  /* write the response from the cache if we have it */
+  cachekey = cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_GROUP_BYMEMBER,
+                       "u %s", name);
+  if ((cachekey != NULL) && ((rc = cache_write(fp, cachekey)) != 0))
+    return (rc > 0) ? 0 : -1;
   /* write the response header */
   WRITE_INT32(fp, NSLCD_VERSION);
   WRITE_INT32(fp, NSLCD_ACTION_GROUP_BYMEMBER);
@@ -495,8 +1077,8 @@ int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
   }
   if ((nslcd_cfg->nss_nested_groups) && (strcasecmp(attmap_group_member, "\"\"") != 0))
   {
-    seen = set_new();
-    tocheck = set_new();
+    seen = set_new_flags(SET_DN);
+    tocheck = set_new_flags(SET_DN);
     if ((seen != NULL) && (tocheck == NULL))
     {
       set_free(seen);
@@ -548,50 +1130,22 @@ int nslcd_group_bymember(TFILE *fp, MYLDAP_SESSION *session)
   /* write possible parent groups */
   if (tocheck != NULL)
   {
-    while ((dn = set_pop(tocheck)) != NULL)
-    {
-      /* make filter for finding groups with our group as member */
-      if (mkfilter_group_bymemberdn(dn, filter, sizeof(filter)))
-      {
-        log_log(LOG_WARNING, "nslcd_group_bymember(): filter buffer too small");
-        free((void *)dn);
-        set_free(seen);
-        set_free(tocheck);
-        return -1;
-      }
-      free((void *)dn);
-      /* do the LDAP searches */
-      for (i = 0; (base = group_bases[i]) != NULL; i++)
-      {
-        search = myldap_search(session, base, group_scope, filter, group_bymember_attrs, NULL);
-        if (search != NULL)
-        {
-          while ((entry = myldap_get_entry(search, NULL)) != NULL)
-          {
-            dn = myldap_get_dn(entry);
-            if (!set_contains(seen, dn))
-            {
-              set_add(seen, dn);
-              set_add(tocheck, dn);
-              if (write_group(fp, entry, NULL, NULL, 0, session))
-              {
-                set_free(seen);
-                set_free(tocheck);
-                return -1;
-              }
-            }
-          }
-        }
-      }
-    }
+    nested = write_nested_parents(fp, session, seen, tocheck);
     set_free(seen);
     set_free(tocheck);
+    if (nested < 0)
+      return -1;
   }
   /* write the final result code */
-  if (rc == LDAP_SUCCESS)
-  {
-    WRITE_INT32(fp, NSLCD_RESULT_END);
-  }
+  if (rc != LDAP_SUCCESS)
+    return -1;
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  /* store the complete response in the cache (a response that misses some
+     nested groups is only passed to concurrent requests) */
+  if ((cachekey != NULL) && (nested == 0))
+    cache_store(fp, NSLCD_ACTION_GROUP_BYMEMBER, cachekey);
+  else if (cachekey != NULL)
+    cache_share(fp);
   return 0;
 }
 
@@ -248,8 +248,6 @@ void invalidator_do(enum ldap_map_selector map)
 {
   uint8_t c;
   int rc;
-  if (signalfd < 0)
-    return;
   /* LM_NONE is used to signal all maps condigured in reconnect_invalidate */
   if (map == LM_NONE)
   {
@@ -258,6 +256,11 @@ void invalidator_do(enum ldap_map_selector map)
         invalidator_do(map);
     return;
   }
+  /* nslcd keeps the netgroup closures itself */
+  if (map == LM_NETGROUP)
+    netgroup_cache_clear();
+  if (signalfd < 0)
+    return;
   /* write a single byte which should be atomic and not fill the PIPE
      buffer too soon on most platforms
      (nslcd should already ignore SIGPIPE) */
@@ -50,8 +50,52 @@ static struct log_cfg {
 /* default loglevel when no logging is configured */
 static int prelogging_loglevel = LOG_INFO;
 
+/* the highest loglevel of any of the logging methods, messages above this
+   level are discarded before they are formatted */
+static int log_maxlevel = LOG_INFO;
+
 #define MAX_REQUESTID_LENGTH 40
 
+/* the maximum length of a log line (without the program name) */
+#define MAX_LINE_LENGTH 600
+
+/*
+   When the logger thread is running threads that log a message format it
+   and add it to a single queue from which it is written by the logger
+   thread so threads do not block on writing log files or syslog. The
+   logger thread writes the queued messages without holding the mutex and
+   only then frees the slots. If the queue is full threads wait for the
+   logger thread (writing the message directly would mix up the order of
+   the messages).
+*/
+
+/* the number of messages that can be queued */
+#define LOG_QUEUE_SIZE 256
+
+/* a formatted message in the queue */
+struct log_msg {
+  int pri;
+  char line[MAX_LINE_LENGTH];
+};
+
+/* the queue of messages, head and tail are protected by the mutex */
+static struct log_msg log_msgs[LOG_QUEUE_SIZE];
+static unsigned int log_head = 0; /* the number of messages added */
+static unsigned int log_tail = 0; /* the number of messages written */
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* the logger thread waits on the condition when it has nothing to do and
+   sets log_waiting so threads know to signal it, threads that find the
+   queue full wait for log_space (also protected by the mutex) */
+static pthread_cond_t log_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t log_space = PTHREAD_COND_INITIALIZER;
+static int log_waiting = 0;
+
+/* whether messages are queued for the logger thread (only changed with
+   the mutex held) */
+static volatile int log_async = 0;
+static pthread_t log_thread;
+
 #ifdef TLS
 
 /* the session id that is set for this thread */
@@ -74,10 +118,26 @@ static void tls_init_keys(void)
 
 #endif /* no TLS, use pthreads */
 
+/* update the highest loglevel that is logged */
+static void updatemaxlevel(void)
+{
+  struct log_cfg *lst;
+  if (prelogging_loglevel >= 0)
+  {
+    log_maxlevel = prelogging_loglevel;
+    return;
+  }
+  log_maxlevel = -1;
+  for (lst = loglist; lst != NULL; lst = lst->next)
+    if (lst->loglevel > log_maxlevel)
+      log_maxlevel = lst->loglevel;
+}
+
 /* set loglevel when no logging is configured */
 void log_setdefaultloglevel(int loglevel)
 {
   prelogging_loglevel = loglevel;
+  updatemaxlevel();
 }
 
 /* add logging method to configuration list */
@@ -103,6 +163,7 @@ static void addlogging(int loglevel, const char *scheme, FILE *fp)
     for (lst = loglist; lst->next != NULL; lst = lst->next);
     lst->next = tmp;
   }
+  updatemaxlevel();
 }
 
 /* configure logging to a file */
@@ -146,6 +207,7 @@ void log_startlogging(void)
   if (loglist == NULL)
     log_addlogging_syslog(LOG_INFO);
   prelogging_loglevel = -1;
+  updatemaxlevel();
 }
 
 /* indicate that we should clear any session identifiers set by
@@ -225,15 +287,126 @@ void log_setrequest(const char *format, ...)
   va_end(ap);
 }
 
+/* write the formatted line using the configured logging methods */
+static void log_write(int pri, const char *line)
+{
+  struct log_cfg *lst;
+  if (prelogging_loglevel >= 0)
+  {
+    /* if logging is not yet defined, log to stderr */
+    if (pri <= prelogging_loglevel)
+      fprintf(stderr, "%s: %s\n", PACKAGE, line);
+    return;
+  }
+  for (lst = loglist; lst != NULL; lst = lst->next)
+  {
+    if (pri <= lst->loglevel)
+    {
+      if (lst->fp == NULL)
+        syslog(pri, "%s", line);
+      else
+      {
+        fprintf(lst->fp, "%s: %s\n", PACKAGE, line);
+        fflush(lst->fp);
+      }
+    }
+  }
+}
+
+/* the logger thread that writes all queued messages */
+static void *log_run(void UNUSED(*arg))
+{
+  unsigned int pos, end;
+  pthread_mutex_lock(&log_mutex);
+  while (1)
+  {
+    if (log_tail == log_head)
+    {
+      /* stop only after all messages have been written */
+      if (!log_async)
+        break;
+      log_waiting = 1;
+      pthread_cond_wait(&log_cond, &log_mutex);
+      log_waiting = 0;
+      continue;
+    }
+    /* write the queued messages without holding the mutex (the slots are
+       not reused until log_tail is updated) */
+    end = log_head;
+    pthread_mutex_unlock(&log_mutex);
+    for (pos = log_tail; pos != end; pos++)
+      log_write(log_msgs[pos % LOG_QUEUE_SIZE].pri,
+                log_msgs[pos % LOG_QUEUE_SIZE].line);
+    pthread_mutex_lock(&log_mutex);
+    /* give the slots back to the threads */
+    log_tail = end;
+    pthread_cond_broadcast(&log_space);
+  }
+  pthread_mutex_unlock(&log_mutex);
+  return NULL;
+}
+
+/* queue the line for the logger thread, returns 0 if the line was
+   queued */
+static int log_queue(int pri, const char *line)
+{
+  struct log_msg *msg;
+  if (!log_async)
+    return -1;
+  pthread_mutex_lock(&log_mutex);
+  /* if the queue is full wait for the logger thread to catch up */
+  while ((log_async) && ((log_head - log_tail) >= LOG_QUEUE_SIZE))
+  {
+    if (log_waiting)
+      pthread_cond_signal(&log_cond);
+    pthread_cond_wait(&log_space, &log_mutex);
+  }
+  if (!log_async)
+  {
+    pthread_mutex_unlock(&log_mutex);
+    return -1;
+  }
+  msg = &log_msgs[log_head % LOG_QUEUE_SIZE];
+  msg->pri = pri;
+  strcpy(msg->line, line);
+  log_head++;
+  /* wake up the logger thread if it is waiting */
+  if (log_waiting)
+    pthread_cond_signal(&log_cond);
+  pthread_mutex_unlock(&log_mutex);
+  return 0;
+}
+
+/* format the line with the session and request and log it */
+static void log_line(int pri, const char *format, ...)
+  LIKE_PRINTF(2, 3);
+static void log_line(int pri, const char *format, ...)
+{
+  char line[MAX_LINE_LENGTH];
+  va_list ap;
+  /* vsnprintf() truncates the line */
+  va_start(ap, format);
+  vsnprintf(line, sizeof(line), format, ap);
+  va_end(ap);
+  /* pass it to the logger thread or write it directly */
+  if (log_queue(pri, line) == 0)
+    return;
+  log_write(pri, line);
+}
+
 /* log the given message using the configured logging method */
 void log_log(int pri, const char *format, ...)
 {
   int res;
-  struct log_cfg *lst;
   char buffer[512];
   va_list ap;
 #ifndef TLS
   char *sessionid, *requestid;
+#endif /* no TLS */
+  /* skip formatting messages that are not logged anyway */
+  if (pri > log_maxlevel)
+    return;
+#ifndef TLS
   pthread_once(&tls_init_once, tls_init_keys);
   sessionid = pthread_getspecific(sessionid_key);
   requestid = pthread_getspecific(requestid_key);
@@ -251,58 +424,47 @@ void log_log(int pri, const char *format, ...)
   buffer[sizeof(buffer) - 1] = '\0';
   va_end(ap);
   /* do the logging */
-  if (prelogging_loglevel >= 0)
-  {
-    /* if logging is not yet defined, log to stderr */
-    if (pri <= prelogging_loglevel)
-    {
-      if ((requestid != NULL) && (requestid[0] != '\0'))
-        fprintf(stderr, "%s: [%s] <%s> %s%s\n", PACKAGE, sessionid, requestid,
-                pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-      else if ((sessionid != NULL) && (sessionid[0] != '\0'))
-        fprintf(stderr, "%s: [%s] %s%s\n", PACKAGE, sessionid,
-                pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-      else
-        fprintf(stderr, "%s: %s%s\n", PACKAGE,
-                pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-    }
-  }
+  if ((requestid != NULL) && (requestid[0] != '\0'))
+    log_line(pri, "[%s] <%s> %s%s", sessionid, requestid,
+             pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
+  else if ((sessionid != NULL) && (sessionid[0] != '\0'))
+    log_line(pri, "[%s] %s%s", sessionid,
+             pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
   else
+    log_line(pri, "%s%s", pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
+}
+
+void log_startthread(void)
+{
+  /* messages are written directly until logging is started */
+  if ((prelogging_loglevel >= 0) || (log_async))
+    return;
+  pthread_mutex_lock(&log_mutex);
+  log_async = 1;
+  pthread_mutex_unlock(&log_mutex);
+  if (pthread_create(&log_thread, NULL, log_run, NULL))
   {
-    for (lst = loglist; lst != NULL; lst = lst->next)
-    {
-      if (pri <= lst->loglevel)
-      {
-        if (lst->fp == NULL)
-        {
-          if ((requestid != NULL) && (requestid[0] != '\0'))
-            syslog(pri, "[%s] <%s> %s%s", sessionid, requestid,
-                   pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-          else if ((sessionid != NULL) && (sessionid[0] != '\0'))
-            syslog(pri, "[%s] %s%s", sessionid,
-                   pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-          else
-            syslog(pri, "%s%s",
-                   pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-        }
-        else
-        {
-          if ((requestid != NULL) && (requestid[0] != '\0'))
-            fprintf(lst->fp, "%s: [%s] <%s> %s%s\n", PACKAGE, sessionid, requestid,
-                    pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-          else if ((sessionid != NULL) && (sessionid[0] != '\0'))
-            fprintf(lst->fp, "%s: [%s] %s%s\n", PACKAGE, sessionid,
-                    pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-          else
-            fprintf(lst->fp, "%s: %s%s\n", PACKAGE,
-                    pri == LOG_DEBUG ? "DEBUG: " : "", buffer);
-          fflush(lst->fp);
-        }
-      }
-    }
+    pthread_mutex_lock(&log_mutex);
+    log_async = 0;
+    pthread_mutex_unlock(&log_mutex);
+    log_log(LOG_WARNING, "unable to start logger thread (ignored): %s",
+            strerror(errno));
   }
 }
 
+void log_stopthread(void)
+{
+  if (!log_async)
+    return;
+  /* the logger thread writes the queued messages before stopping */
+  pthread_mutex_lock(&log_mutex);
+  log_async = 0;
+  pthread_cond_signal(&log_cond);
+  pthread_cond_broadcast(&log_space);
+  pthread_mutex_unlock(&log_mutex);
+  (void)pthread_join(log_thread, NULL);
+}
+
 static const char *loglevel2str(int loglevel)
 {
   switch (loglevel)
@@ -55,10 +55,20 @@ void log_clearsession(void);
 void log_setrequest(const char *format, ...)
   LIKE_PRINTF(1, 2);
 
-/* log the given message using the configured logging method */
+/* log the given message using the configured logging method, messages
+   with a level that is not logged by any method are not formatted */
 void log_log(int pri, const char *format, ...)
   LIKE_PRINTF(2, 3);
 
+/* start a thread that writes the log messages so that other threads do
+   not wait for writing to log files or syslog (this should be called
+   after log_startlogging() and after any fork()) */
+void log_startthread(void);
+
+/* stop the logger thread after writing all pending messages, messages are
+   written directly after this */
+void log_stopthread(void);
+
 /* log the logging configuration on DEBUG loglevel */
 void log_log_config(void);
 
@@ -45,6 +45,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <errno.h>
+#include <poll.h>
 #include <lber.h>
 #include <ldap.h>
 #ifdef HAVE_LDAP_SSL_H
@@ -71,30 +72,89 @@
 #include "log.h"
 #include "cfg.h"
 #include "common/set.h"
+#include "common/arena.h"
 #include "compat/ldap_compat.h"
 #include "attmap.h"
 
-/* the maximum number of searches per session */
-#define MAX_SEARCHES_IN_SESSION 4
+/* the maximum number of searches per session (this leaves room for the
+   searches that dn2uids() keeps outstanding) */
+#define MAX_SEARCHES_IN_SESSION 24
 
 /* the maximum number of dn's to log to the debug log for each search */
 #define MAX_DEBUG_LOG_DNS 10
 
+/* the number of results that are queued for a search on a shared
+   connection after which other sessions stop reading from the connection
+   until the thread doing the search has picked up some of them */
+#define MAX_QUEUED_RESULTS 1024
+
 /* a fake scope that is used to not perform an actual search but only
    simulate the handling of the search (used for authentication) */
 #define MYLDAP_SCOPE_BINDONLY 0x1972  /* magic number: should never be a real scope */
 
+/* the size of the chunks of the arena that is used for searches (the first
+   chunk is kept between requests) */
+#define SESSION_ARENA_SIZE 8192
+
+/* the size of the chunks of the arena that is used for values of entries */
+#define ENTRY_ARENA_SIZE 1024
+
+/* A result message that was read for a search by another thread. */
+struct myldap_msgqueue {
+  LDAPMessage *msg;
+  struct myldap_msgqueue *next;
+};
+
+/* An LDAP connection that is shared between sessions (see the connections
+   option). Sessions borrow a connection from the pool for the duration of
+   a request. One thread at a time reads results from the connection and
+   queues results for searches of other sessions. */
+struct myldap_conn {
+  /* the connection (NULL if it has not been opened yet) */
+  LDAP *ld;
+  /* index into the list of shared connections */
+  int idx;
+  /* index into uris: the connected LDAP uri */
+  int current_uri;
+  /* the number of sessions that use the connection (protected by
+     conns_mutex) */
+  int users;
+  /* the mutex protects all of the below */
+  pthread_mutex_t mutex;
+  /* signalled after a thread finished reading a result */
+  pthread_cond_t cond;
+  /* whether a thread is currently reading from the connection */
+  int reading;
+  /* whether reading from the connection failed */
+  int failed;
+  /* timestamp of last activity */
+  time_t lastactivity;
+  /* the searches with a request outstanding on the connection */
+  struct myldap_search *searches;
+  /* the number of searches with MAX_QUEUED_RESULTS or more queued */
+  int full;
+};
+
 /* This refers to a current LDAP session that contains the connection
    information. */
 struct ldap_session {
   /* the connection */
   LDAP *ld;
+  /* the shared connection that ld refers to (NULL if ld is private) */
+  struct myldap_conn *conn;
   /* timestamp of last activity */
   time_t lastactivity;
   /* index into uris: currently connected LDAP uri */
   int current_uri;
   /* a list of searches registered with this session */
   struct myldap_search *searches[MAX_SEARCHES_IN_SESSION];
+  /* memory for searches that is released when the request is done */
+  ARENA *arena;
+  /* searches that were closed and whose memory can be reused */
+  struct myldap_search *freesearches;
+  /* arenas for entry values that are kept between requests */
+  ARENA *entryarenas[MAX_SEARCHES_IN_SESSION];
+  int numentryarenas;
   /* the username to bind with */
   char binddn[BUFLEN_DN];
   /* the password to bind with if any */
@@ -105,6 +165,30 @@ struct ldap_session {
   char policy_message[BUFLEN_MESSAGE];
 };
 
+/* The maximum number of calls to myldap_get_values() that may be
+   done per returned entry. */
+#define MAX_ATTRIBUTES_PER_ENTRY 16
+
+/* The maximum number of buffers (used for ranged attribute values) that
+   may be stored per entry. */
+#define MAX_BUFFERS_PER_ENTRY 8
+
+/* A single entry from the LDAP database as returned by
+   myldap_get_entry(). */
+struct myldap_entry {
+  /* reference to the search to be used to get parameters
+     (e.g. LDAP connection) for other calls */
+  MYLDAP_SEARCH *search;
+  /* the DN */
+  const char *dn;
+  /* a cached version of the exploded rdn */
+  char **exploded_rdn;
+  /* a cache of attribute to value list */
+  char **attributevalues[MAX_ATTRIBUTES_PER_ENTRY];
+  /* a reference to buffers so we can free() them later on */
+  char **buffers[MAX_BUFFERS_PER_ENTRY];
+};
+
 /* A search description set as returned by myldap_search(). */
 struct myldap_search {
   /* reference to the session */
@@ -116,9 +200,12 @@ struct myldap_search {
   int scope;
   const char *filter;
   char **attrs;
-  /* a pointer to the current result entry, used for
+  /* a pointer to the current result entry (entrybuf), used for
      freeing resource allocated with that entry */
   MYLDAP_ENTRY *entry;
+  struct myldap_entry entrybuf;
+  /* memory for values of the current entry (allocated when needed) */
+  ARENA *entryarena;
   /* LDAP message id for the search, -1 indicates absense of an active search */
   int msgid;
   /* the last result that was returned by ldap_result() */
@@ -129,30 +216,17 @@ struct myldap_search {
   int may_retry_search;
   /* the number of resutls returned so far */
   int count;
-};
-
-/* The maximum number of calls to myldap_get_values() that may be
-   done per returned entry. */
-#define MAX_ATTRIBUTES_PER_ENTRY 16
-
-/* The maximum number of buffers (used for ranged attribute values and
-   values returned by bervalues_to_values()) that may be stored per entry. */
-#define MAX_BUFFERS_PER_ENTRY 8
-
-/* A single entry from the LDAP database as returned by
-   myldap_get_entry(). */
-struct myldap_entry {
-  /* reference to the search to be used to get parameters
-     (e.g. LDAP connection) for other calls */
-  MYLDAP_SEARCH *search;
-  /* the DN */
-  const char *dn;
-  /* a cached version of the exploded rdn */
-  char **exploded_rdn;
-  /* a cache of attribute to value list */
-  char **attributevalues[MAX_ATTRIBUTES_PER_ENTRY];
-  /* a reference to buffers so we can free() them later on */
-  char **buffers[MAX_BUFFERS_PER_ENTRY];
+  /* results that were read by other threads (shared connections only) */
+  struct myldap_msgqueue *queue;
+  struct myldap_msgqueue **queuetail;
+  /* the number of queued results */
+  int queued;
+  /* the next search in the list of the shared connection */
+  struct myldap_search *conn_next;
+  /* the size of the memory that was allocated for the search */
+  size_t size;
+  /* the next search in the list of closed searches of the session */
+  struct myldap_search *free_next;
 };
 
 /* Flag to record first search operation */
@@ -196,15 +270,9 @@ static MYLDAP_ENTRY *myldap_entry_new(MYLDAP_SEARCH *search)
 {
   MYLDAP_ENTRY *entry;
   int i;
-  /* Note: as an alternative we could embed the myldap_entry into the
-     myldap_search struct to save on malloc() and free() calls. */
-  /* allocate new entry */
-  entry = (MYLDAP_ENTRY *)malloc(sizeof(struct myldap_entry));
-  if (entry == NULL)
-  {
-    log_log(LOG_CRIT, "myldap_entry_new(): malloc() failed to allocate memory");
-    exit(EXIT_FAILURE);
-  }
+  /* the entry is embedded in the search to save on malloc() and free()
+     calls */
+  entry = &(search->entrybuf);
   /* fill in fields */
   entry->search = search;
   entry->dn = NULL;
@@ -234,11 +302,25 @@ static void myldap_entry_free(MYLDAP_ENTRY *entry)
   for (i = 0; i < MAX_BUFFERS_PER_ENTRY; i++)
     if (entry->buffers[i] != NULL)
       free(entry->buffers[i]);
+  if (entry->search->entryarena != NULL)
+    arena_reset(entry->search->entryarena);
   /* we don't need the result anymore, ditch it. */
   ldap_msgfree(entry->search->msg);
   entry->search->msg = NULL;
-  /* free the actual memory for the struct */
-  free(entry);
+}
+
+/* allocate memory that is valid until the next entry is retrieved */
+static void *myldap_entry_alloc(MYLDAP_ENTRY *entry, size_t size)
+{
+  MYLDAP_SEARCH *search = entry->search;
+  MYLDAP_SESSION *session = search->session;
+  if ((search->entryarena == NULL) && (session->numentryarenas > 0))
+    search->entryarena = session->entryarenas[--session->numentryarenas];
+  else if (search->entryarena == NULL)
+    search->entryarena = arena_new(ENTRY_ARENA_SIZE);
+  if (search->entryarena == NULL)
+    return NULL;
+  return arena_alloc(search->entryarena, size);
 }
 
 static MYLDAP_SEARCH *myldap_search_new(MYLDAP_SESSION *session,
@@ -247,26 +329,44 @@ static MYLDAP_SEARCH *myldap_search_new(MYLDAP_SESSION *session,
                                         const char **attrs)
 {
   char *buffer;
-  MYLDAP_SEARCH *search;
+  MYLDAP_SEARCH *search, **prev;
+  ARENA *entryarena = NULL;
   int i;
   size_t sz;
   /* figure out size for new memory block to allocate
-     this has the advantage that we can free the whole lot with one call */
+     this has the advantage that we can reuse the whole lot */
   sz = sizeof(struct myldap_search);
   sz += strlen(base) + 1 + strlen(filter) + 1;
   for (i = 0; attrs[i] != NULL; i++)
     sz += strlen(attrs[i]) + 1;
   sz += (i + 1) * sizeof(char *);
-  /* allocate new results memory region */
-  buffer = (char *)malloc(sz);
-  if (buffer == NULL)
+  /* reuse the memory of a closed search if it is large enough */
+  for (prev = &(session->freesearches); *prev != NULL; prev = &((*prev)->free_next))
+    if ((*prev)->size >= sz)
+      break;
+  if (*prev != NULL)
   {
-    log_log(LOG_CRIT, "myldap_search_new(): malloc() failed to allocate memory");
-    exit(EXIT_FAILURE);
+    search = *prev;
+    *prev = search->free_next;
+    sz = search->size;
+    entryarena = search->entryarena;
+  }
+  else
+  {
+    /* allocate a new memory region from the session arena */
+    search = (MYLDAP_SEARCH *)arena_alloc(session->arena, sz);
+    if (search == NULL)
+    {
+      log_log(LOG_CRIT, "myldap_search_new(): malloc() failed to allocate memory");
+      exit(EXIT_FAILURE);
+    }
   }
   /* initialize struct */
-  search = (MYLDAP_SEARCH *)(void *)(buffer);
+  buffer = (char *)search;
   buffer += sizeof(struct myldap_search);
+  search->size = sz;
+  search->free_next = NULL;
+  search->entryarena = entryarena;
   /* save pointer to session */
   search->session = session;
   /* flag as valid search */
@@ -296,6 +396,10 @@ static MYLDAP_SEARCH *myldap_search_new(MYLDAP_SESSION *session,
   search->cookie = NULL;
   search->msg = NULL;
   search->msgid = -1;
+  search->queue = NULL;
+  search->queuetail = &(search->queue);
+  search->queued = 0;
+  search->conn_next = NULL;
   search->may_retry_search = 1;
   /* clear result entry */
   search->entry = NULL;
@@ -317,6 +421,7 @@ static MYLDAP_SESSION *myldap_session_new(void)
   }
   /* initialize the session */
   session->ld = NULL;
+  session->conn = NULL;
   session->lastactivity = 0;
   session->current_uri = 0;
   for (i = 0; i < MAX_SEARCHES_IN_SESSION; i++)
@@ -326,6 +431,14 @@ static MYLDAP_SESSION *myldap_session_new(void)
   session->bindpw[0] = '\0';
   session->policy_response = NSLCD_PAM_SUCCESS;
   session->policy_message[0] = '\0';
+  session->freesearches = NULL;
+  session->numentryarenas = 0;
+  session->arena = arena_new(SESSION_ARENA_SIZE);
+  if (session->arena == NULL)
+  {
+    log_log(LOG_CRIT, "myldap_session_new(): malloc() failed to allocate memory");
+    exit(EXIT_FAILURE);
+  }
   /* return the new session */
   return session;
 }
@@ -663,33 +776,16 @@ static int do_ppolicy_bind(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
 }
 #endif /* no SASL, so no ppolicy */
 
-/* This function performs the authentication phase of opening a connection.
-   The binddn and bindpw parameters may be used to override the authentication
-   mechanism defined in the configuration.  This returns an LDAP result
-   code. */
-static int do_bind(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
+/* This function binds with the credentials of the session or the
+   configured credentials on a connection that was already set up. This
+   returns an LDAP result code. */
+static int do_bind_creds(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
 {
-  int rc;
 #ifdef HAVE_LDAP_SASL_INTERACTIVE_BIND_S
 #ifndef HAVE_SASL_INTERACT_T
   struct berval cred;
 #endif /* not HAVE_SASL_INTERACT_T */
 #endif /* HAVE_LDAP_SASL_INTERACTIVE_BIND_S */
-#ifdef LDAP_OPT_X_TLS
-  /* check if StartTLS is requested */
-  if (nslcd_cfg->ssl == SSL_START_TLS)
-  {
-    log_log(LOG_DEBUG, "ldap_start_tls_s()");
-    errno = 0;
-    rc = ldap_start_tls_s(ld, NULL, NULL);
-    if (rc != LDAP_SUCCESS)
-    {
-      myldap_err(LOG_WARNING, ld, rc, "ldap_start_tls_s() failed (uri=%s)",
-                 uri);
-      return rc;
-    }
-  }
-#endif /* LDAP_OPT_X_TLS */
   /* check if the binddn and bindpw are overwritten in the session */
   if (session->binddn[0] != '\0')
   {
@@ -762,6 +858,31 @@ static int do_bind(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
   return ldap_simple_bind_s(ld, nslcd_cfg->binddn, nslcd_cfg->bindpw);
 }
 
+/* This function performs the authentication phase of opening a connection.
+   The binddn and bindpw parameters may be used to override the authentication
+   mechanism defined in the configuration.  This returns an LDAP result
+   code. */
+static int do_bind(MYLDAP_SESSION *session, LDAP *ld, const char *uri)
+{
+#ifdef LDAP_OPT_X_TLS
+  int rc;
+  /* check if StartTLS is requested */
+  if (nslcd_cfg->ssl == SSL_START_TLS)
+  {
+    log_log(LOG_DEBUG, "ldap_start_tls_s()");
+    errno = 0;
+    rc = ldap_start_tls_s(ld, NULL, NULL);
+    if (rc != LDAP_SUCCESS)
+    {
+      myldap_err(LOG_WARNING, ld, rc, "ldap_start_tls_s() failed (uri=%s)",
+                 uri);
+      return rc;
+    }
+  }
+#endif /* LDAP_OPT_X_TLS */
+  return do_bind_creds(session, ld, uri);
+}
+
 #ifdef HAVE_LDAP_SET_REBIND_PROC
 /* This function is called by the LDAP library when chasing referrals.
    It is configured with the ldap_set_rebind_proc() below. */
@@ -930,6 +1051,30 @@ static int do_set_options(MYLDAP_SESSION *session)
                   nslcd_cfg->referrals ? LDAP_OPT_ON : LDAP_OPT_OFF);
   log_log(LOG_DEBUG, "ldap_set_option(LDAP_OPT_RESTART,LDAP_OPT_ON)");
   LDAP_SET_OPTION(session->ld, LDAP_OPT_RESTART, LDAP_OPT_ON);
+#ifdef LDAP_OPT_X_KEEPALIVE_IDLE
+  /* configure TCP keepalive probes (the library enables SO_KEEPALIVE) */
+  if (nslcd_cfg->tcp_keepalive_idle > 0)
+  {
+    log_log(LOG_DEBUG, "ldap_set_option(LDAP_OPT_X_KEEPALIVE_IDLE,%d)",
+            nslcd_cfg->tcp_keepalive_idle);
+    LDAP_SET_OPTION(session->ld, LDAP_OPT_X_KEEPALIVE_IDLE,
+                    &nslcd_cfg->tcp_keepalive_idle);
+    if (nslcd_cfg->tcp_keepalive_interval > 0)
+    {
+      log_log(LOG_DEBUG, "ldap_set_option(LDAP_OPT_X_KEEPALIVE_INTERVAL,%d)",
+              nslcd_cfg->tcp_keepalive_interval);
+      LDAP_SET_OPTION(session->ld, LDAP_OPT_X_KEEPALIVE_INTERVAL,
+                      &nslcd_cfg->tcp_keepalive_interval);
+    }
+    if (nslcd_cfg->tcp_keepalive_probes > 0)
+    {
+      log_log(LOG_DEBUG, "ldap_set_option(LDAP_OPT_X_KEEPALIVE_PROBES,%d)",
+              nslcd_cfg->tcp_keepalive_probes);
+      LDAP_SET_OPTION(session->ld, LDAP_OPT_X_KEEPALIVE_PROBES,
+                      &nslcd_cfg->tcp_keepalive_probes);
+    }
+  }
+#endif /* LDAP_OPT_X_KEEPALIVE_IDLE */
 #ifdef LDAP_OPT_CONNECT_CB
   /* register a connection callback */
   cb.lc_add = connect_cb;
@@ -961,6 +1106,356 @@ static int do_set_options(MYLDAP_SESSION *session)
   return LDAP_SUCCESS;
 }
 
+/* the list of shared connections (nslcd_cfg->connections long), the mutex
+   protects the list and the users field of the connections */
+static pthread_mutex_t conns_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct myldap_conn **conns = NULL;
+
+/* Update the number of results that are queued for the search on the
+   shared connection and wake up the threads that stopped reading if the
+   queue is no longer full. The caller should hold the mutex of the
+   connection. */
+static void do_set_queued(struct myldap_conn *conn, MYLDAP_SEARCH *search,
+                          int queued)
+{
+  if ((search->queued < MAX_QUEUED_RESULTS) && (queued >= MAX_QUEUED_RESULTS))
+    conn->full++;
+  else if ((search->queued >= MAX_QUEUED_RESULTS) && (queued < MAX_QUEUED_RESULTS))
+  {
+    conn->full--;
+    pthread_cond_broadcast(&(conn->cond));
+  }
+  search->queued = queued;
+}
+
+/* Free the results that were queued for the search. The caller should hold
+   the mutex of the connection. */
+static void do_free_queue(struct myldap_conn *conn, MYLDAP_SEARCH *search)
+{
+  struct myldap_msgqueue *q;
+  while ((q = search->queue) != NULL)
+  {
+    search->queue = q->next;
+    ldap_msgfree(q->msg);
+    free(q);
+  }
+  search->queuetail = &(search->queue);
+  do_set_queued(conn, search, 0);
+}
+
+/* Set the message id of the outstanding request of the search (-1 if there
+   is none). For shared connections the caller should hold the mutex of the
+   connection. */
+static void do_set_msgid(MYLDAP_SEARCH *search, int msgid)
+{
+  struct myldap_conn *conn = search->session->conn;
+  struct myldap_search **sp;
+  if ((conn != NULL) && (search->msgid != -1))
+  {
+    /* remove the search from the connection */
+    for (sp = &(conn->searches); *sp != NULL; sp = &((*sp)->conn_next))
+      if (*sp == search)
+      {
+        *sp = search->conn_next;
+        break;
+      }
+    /* free any results that were not handled yet */
+    do_free_queue(conn, search);
+  }
+  search->msgid = msgid;
+  if ((conn != NULL) && (msgid != -1))
+  {
+    /* register the search with the connection */
+    search->conn_next = conn->searches;
+    conn->searches = search;
+    time(&(conn->lastactivity));
+  }
+}
+
+/* Clear the message id of the search, taking care of locking. */
+static void do_clear_msgid(MYLDAP_SEARCH *search)
+{
+  struct myldap_conn *conn = search->session->conn;
+  if (conn != NULL)
+    pthread_mutex_lock(&(conn->mutex));
+  do_set_msgid(search, -1);
+  if (conn != NULL)
+    pthread_mutex_unlock(&(conn->mutex));
+}
+
+/* Abandon the search on the server and clear the message id. On a shared
+   connection this is done with the connection mutex held, like sending the
+   search. Returns the result of ldap_abandon(). */
+static int do_abandon(MYLDAP_SEARCH *search)
+{
+  struct myldap_conn *conn = search->session->conn;
+  int rc;
+  if (conn != NULL)
+    pthread_mutex_lock(&(conn->mutex));
+  rc = ldap_abandon(search->session->ld, search->msgid);
+  do_set_msgid(search, -1);
+  if (conn != NULL)
+    pthread_mutex_unlock(&(conn->mutex));
+  return rc;
+}
+
+/* Check whether the session should stop reading from the shared connection
+   because too many results are queued for a search of another session.
+   Sessions that have a full queue themselves keep reading because they may
+   need results of other searches before picking up the queued results. The
+   caller should hold the mutex of the connection. */
+static int do_conn_stalled(struct myldap_conn *conn, MYLDAP_SESSION *session)
+{
+  struct myldap_search *search;
+  int stalled = 0;
+  if (conn->full == 0)
+    return 0;
+  for (search = conn->searches; search != NULL; search = search->conn_next)
+  {
+    if (search->queued >= MAX_QUEUED_RESULTS)
+    {
+      if (search->session == session)
+        return 0;
+      stalled = 1;
+    }
+  }
+  return stalled;
+}
+
+/* Get the next result for the search. For shared connections the thread
+   that finds that no other thread is reading from the connection reads the
+   next result for any search and queues it if it is for another search.
+   Reading stops while the thread doing a search of another session does
+   not keep up with picking up the results that were queued for it. */
+static int do_get_result(MYLDAP_SEARCH *search, struct timeval *tvp,
+                         LDAPMessage **msg)
+{
+  struct myldap_conn *conn = search->session->conn;
+  struct myldap_search *other;
+  struct myldap_msgqueue *q;
+  struct timespec deadline;
+  struct timeval tv;
+  LDAPMessage *res;
+  time_t t;
+  int rc, stalled;
+  if (conn == NULL)
+    return ldap_result(search->session->ld, search->msgid, LDAP_MSG_ONE,
+                       tvp, msg);
+  if (tvp != NULL)
+  {
+    deadline.tv_sec = time(NULL) + tvp->tv_sec;
+    deadline.tv_nsec = 0;
+  }
+  pthread_mutex_lock(&(conn->mutex));
+  while (1)
+  {
+    /* see if another thread already read a result for us */
+    if ((q = search->queue) != NULL)
+    {
+      search->queue = q->next;
+      if (search->queue == NULL)
+        search->queuetail = &(search->queue);
+      do_set_queued(conn, search, search->queued - 1);
+      pthread_mutex_unlock(&(conn->mutex));
+      *msg = q->msg;
+      free(q);
+      return ldap_msgtype(*msg);
+    }
+    /* the connection is broken */
+    if (conn->failed)
+    {
+      pthread_mutex_unlock(&(conn->mutex));
+      return -1;
+    }
+    t = time(NULL);
+    /* the time spent waiting for another session to pick up its results
+       does not count towards the time limit of the search */
+    stalled = (!conn->reading) && do_conn_stalled(conn, search->session);
+    if ((tvp != NULL) && (stalled))
+      deadline.tv_sec = t + tvp->tv_sec;
+    if ((tvp != NULL) && (t >= deadline.tv_sec))
+    {
+      pthread_mutex_unlock(&(conn->mutex));
+      return 0;
+    }
+    /* wait for the thread that is reading to hand us a result or for
+       other sessions to pick up their results */
+    if ((conn->reading) || (stalled))
+    {
+      if (tvp != NULL)
+        (void)pthread_cond_timedwait(&(conn->cond), &(conn->mutex), &deadline);
+      else
+        (void)pthread_cond_wait(&(conn->cond), &(conn->mutex));
+      continue;
+    }
+    /* read the next result from the connection ourselves */
+    conn->reading = 1;
+    pthread_mutex_unlock(&(conn->mutex));
+    if (tvp != NULL)
+    {
+      tv.tv_sec = deadline.tv_sec - t;
+      tv.tv_usec = 0;
+    }
+    rc = ldap_result(conn->ld, LDAP_RES_ANY, LDAP_MSG_ONE,
+                     (tvp != NULL) ? &tv : NULL, &res);
+    pthread_mutex_lock(&(conn->mutex));
+    conn->reading = 0;
+    pthread_cond_broadcast(&(conn->cond));
+    if (rc < 0)
+      conn->failed = 1;
+    else if (rc > 0)
+    {
+      time(&(conn->lastactivity));
+      if (ldap_msgid(res) == search->msgid)
+      {
+        pthread_mutex_unlock(&(conn->mutex));
+        *msg = res;
+        return rc;
+      }
+      /* find the search that the result belongs to */
+      for (other = conn->searches; other != NULL; other = other->conn_next)
+        if (other->msgid == ldap_msgid(res))
+          break;
+      if (other == NULL)
+      {
+        /* the search was abandoned */
+        ldap_msgfree(res);
+        continue;
+      }
+      q = (struct myldap_msgqueue *)malloc(sizeof(struct myldap_msgqueue));
+      if (q == NULL)
+      {
+        log_log(LOG_CRIT, "do_get_result(): malloc() failed to allocate memory");
+        exit(EXIT_FAILURE);
+      }
+      q->msg = res;
+      q->next = NULL;
+      *(other->queuetail) = q;
+      other->queuetail = &(q->next);
+      do_set_queued(conn, other, other->queued + 1);
+    }
+  }
+}
+
+/* close the shared connection and free it, no session should use it */
+static void do_free_conn(struct myldap_conn *conn)
+{
+  int rc;
+  if (conn->ld != NULL)
+  {
+    log_log(LOG_DEBUG, "ldap_unbind()");
+    rc = ldap_unbind(conn->ld);
+    if (rc != LDAP_SUCCESS)
+      myldap_err(LOG_WARNING, NULL, rc, "ldap_unbind() failed");
+  }
+  pthread_cond_destroy(&(conn->cond));
+  pthread_mutex_destroy(&(conn->mutex));
+  free(conn);
+}
+
+/* Stop using the shared connection of the session. If retire is set the
+   connection will not be used for new sessions. The connection is closed
+   when it is retired and no session uses it any more. */
+static void do_release_conn(MYLDAP_SESSION *session, int retire)
+{
+  struct myldap_conn *conn = session->conn;
+  int unused;
+  pthread_mutex_lock(&conns_mutex);
+  if ((retire) && (conns[conn->idx] == conn))
+    conns[conn->idx] = NULL;
+  conn->users--;
+  unused = (conn->users == 0) && (conns[conn->idx] != conn);
+  pthread_mutex_unlock(&conns_mutex);
+  session->conn = NULL;
+  session->ld = NULL;
+  if (unused)
+    do_free_conn(conn);
+}
+
+/* Check whether a shared connection that is not in use was closed. */
+static int do_conn_broken(struct myldap_conn *conn)
+{
+  struct pollfd pfd;
+  int sd;
+  if (conn->failed)
+    return 1;
+  if ((ldap_get_option(conn->ld, LDAP_OPT_DESC, &sd) != LDAP_SUCCESS) ||
+      (sd < 0))
+    return 1;
+  /* there are no outstanding requests so anything to read means that the
+     server closed the connection (or sent a notice of disconnection) */
+  pfd.fd = sd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  return poll(&pfd, 1, 0) != 0;
+}
+
+/* Connections are reopened by myldap_session_refresh() in a single thread
+   at a time. refresh_pending is set when a connection should be reopened
+   and refresh_failed holds the time of the last failed attempt (0 if the
+   last attempt succeeded). These are protected by refresh_mutex. */
+static pthread_mutex_t refresh_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int refresh_pending = 0;
+static int refresh_busy = 0;
+static time_t refresh_failed = 0;
+
+/* indicate that a connection should be reopened by an idle thread */
+static void do_request_refresh(int refresh)
+{
+  if (!refresh)
+    return;
+  pthread_mutex_lock(&refresh_mutex);
+  refresh_pending = 1;
+  pthread_mutex_unlock(&refresh_mutex);
+}
+
+/* Close the shared connections that are not in use and are broken or
+   have reached the idle_timelimit. This returns whether fewer than
+   connections_min shared connections are open. */
+static int do_check_conns(void)
+{
+  static time_t nextcheck = 0;
+  struct myldap_conn *conn;
+  time_t now;
+  int i, numopen = 0;
+  now = time(NULL);
+  pthread_mutex_lock(&conns_mutex);
+  if (conns == NULL)
+  {
+    pthread_mutex_unlock(&conns_mutex);
+    return nslcd_cfg->connections_min > 0;
+  }
+  for (i = 0; i < nslcd_cfg->connections; i++)
+    if (conns[i] != NULL)
+      numopen++;
+  /* check the connections at most once a second */
+  if (now >= nextcheck)
+  {
+    nextcheck = now + 1;
+    for (i = 0; i < nslcd_cfg->connections; i++)
+    {
+      conn = conns[i];
+      if ((conn == NULL) || (conn->users > 0) || (conn->ld == NULL))
+        continue;
+      if (do_conn_broken(conn))
+        log_log(LOG_DEBUG, "do_check_conns(): shared connection %d was closed", i);
+      else if ((nslcd_cfg->idle_timelimit > 0) &&
+               ((conn->lastactivity + nslcd_cfg->idle_timelimit) < now))
+        log_log(LOG_DEBUG, "do_check_conns(): shared connection %d reached idle_timelimit", i);
+      else
+        continue;
+      /* nobody uses the connection so it can be closed right away */
+      conns[i] = NULL;
+      numopen--;
+      pthread_mutex_unlock(&conns_mutex);
+      do_free_conn(conn);
+      pthread_mutex_lock(&conns_mutex);
+    }
+  }
+  pthread_mutex_unlock(&conns_mutex);
+  return numopen < nslcd_cfg->connections_min;
+}
+
 /* close the connection to the server and invalidate any running searches */
 static void do_close(MYLDAP_SESSION *session)
 {
@@ -973,7 +1468,7 @@ static void do_close(MYLDAP_SESSION *session)
     /* set timeout options on socket to avoid hang in some cases
        (we set a short timeout because we don't care too much about properly
        shutting down the connection) */
-    if (nslcd_cfg->timelimit)
+    if ((nslcd_cfg->timelimit) && (session->conn == NULL))
     {
       sec = nslcd_cfg->timelimit / 2;
       if (!sec)
@@ -995,19 +1490,24 @@ static void do_close(MYLDAP_SESSION *session)
         if (session->searches[i]->msgid != -1)
         {
           log_log(LOG_DEBUG, "ldap_abandon()");
-          if (ldap_abandon(session->searches[i]->session->ld, session->searches[i]->msgid))
+          if (do_abandon(session->searches[i]))
           {
             if (ldap_get_option(session->ld, LDAP_OPT_ERROR_NUMBER, &rc) != LDAP_SUCCESS)
               rc = LDAP_OTHER;
             myldap_err(LOG_WARNING, session->ld, rc,
                        "ldap_abandon() failed to abandon search");
           }
-          session->searches[i]->msgid = -1;
         }
         /* flag the search as invalid */
         session->searches[i]->valid = 0;
       }
     }
+    /* other sessions may still be using a shared connection */
+    if (session->conn != NULL)
+    {
+      do_release_conn(session, 1);
+      return;
+    }
     /* close the connection to the server */
     log_log(LOG_DEBUG, "ldap_unbind()");
     rc = ldap_unbind(session->ld);
@@ -1021,6 +1521,8 @@ void myldap_session_check(MYLDAP_SESSION *session)
 {
   int i;
   time_t current_time;
+  time_t lastactivity;
+  int retired;
   int sd;
   int rc;
   struct sockaddr sa;
@@ -1049,10 +1551,38 @@ void myldap_session_check(MYLDAP_SESSION *session)
         {
           log_log(LOG_DEBUG, "myldap_session_check(): connection reset by peer");
           do_close(session);
+          do_request_refresh(nslcd_cfg->idle_reconnect);
           return;
         }
       }
     }
+    /* check if the shared connection should no longer be used */
+    if (session->conn != NULL)
+    {
+      /* if we have any running searches, keep using it */
+      for (i = 0; i < MAX_SEARCHES_IN_SESSION; i++)
+        if ((session->searches[i] != NULL) && (session->searches[i]->valid))
+          return;
+      pthread_mutex_lock(&conns_mutex);
+      retired = (conns[session->conn->idx] != session->conn);
+      pthread_mutex_unlock(&conns_mutex);
+      pthread_mutex_lock(&(session->conn->mutex));
+      lastactivity = session->conn->lastactivity;
+      pthread_mutex_unlock(&(session->conn->mutex));
+      if (retired)
+      {
+        log_log(LOG_DEBUG, "myldap_session_check(): shared connection was closed");
+        do_release_conn(session, 0);
+      }
+      else if ((nslcd_cfg->idle_timelimit > 0) &&
+               ((lastactivity + nslcd_cfg->idle_timelimit) < time(NULL)))
+      {
+        log_log(LOG_DEBUG, "myldap_session_check(): idle_timelimit reached");
+        do_release_conn(session, 1);
+        do_request_refresh(nslcd_cfg->idle_reconnect);
+      }
+      return;
+    }
     /* check if we should time out the connection */
     if (nslcd_cfg->idle_timelimit > 0)
     {
@@ -1066,20 +1596,25 @@ void myldap_session_check(MYLDAP_SESSION *session)
       {
         log_log(LOG_DEBUG, "myldap_session_check(): idle_timelimit reached");
         do_close(session);
+        do_request_refresh(nslcd_cfg->idle_reconnect);
       }
     }
   }
+  /* check the shared connections that are not in use */
+  else if ((nslcd_cfg->connections > 0) && (session->binddn[0] == '\0'))
+  {
+    if (do_check_conns())
+      do_request_refresh(1);
+  }
 }
 
 /* This opens connection to an LDAP server, sets all connection options
    and binds to the server. This returns an LDAP status code. */
-static int do_open(MYLDAP_SESSION *session)
+static int do_connect(MYLDAP_SESSION *session)
 {
   int rc;
-  /* if the connection is still there (ie. ldap_unbind() wasn't
-     called) then we can return the cached connection */
-  if (session->ld != NULL)
-    return LDAP_SUCCESS;
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
   /* we should build a new session now */
   session->ld = NULL;
   session->lastactivity = 0;
@@ -1122,9 +1657,229 @@ static int do_open(MYLDAP_SESSION *session)
   }
   /* update last activity and finish off state */
   time(&(session->lastactivity));
+  /* a connection was opened so no refresh is needed */
+  pthread_mutex_lock(&refresh_mutex);
+  refresh_pending = 0;
+  refresh_failed = 0;
+  pthread_mutex_unlock(&refresh_mutex);
+  gettimeofday(&end, NULL);
+  log_log(LOG_DEBUG, "connected to %s in %ld ms",
+          nslcd_cfg->uris[session->current_uri].uri,
+          (long)((end.tv_sec - start.tv_sec) * 1000 +
+                 (end.tv_usec - start.tv_usec) / 1000));
   return LDAP_SUCCESS;
 }
 
+/* Start using one of the shared connections, opening a new one if all
+   connections are in use and the limits allow it. This returns an LDAP
+   status code. */
+static int do_open_shared(MYLDAP_SESSION *session)
+{
+  struct myldap_conn *conn = NULL;
+  int i, freeidx = -1, numopen = 0, numuri = 0;
+  int rc = LDAP_SUCCESS;
+  pthread_mutex_lock(&conns_mutex);
+  if (conns == NULL)
+  {
+    conns = (struct myldap_conn **)calloc((size_t)nslcd_cfg->connections,
+                                          sizeof(struct myldap_conn *));
+    if (conns == NULL)
+    {
+      log_log(LOG_CRIT, "do_open_shared(): malloc() failed to allocate memory");
+      exit(EXIT_FAILURE);
+    }
+  }
+  /* find the connection with the fewest users and a free slot */
+  for (i = 0; i < nslcd_cfg->connections; i++)
+  {
+    if (conns[i] == NULL)
+    {
+      if (freeidx < 0)
+        freeidx = i;
+      continue;
+    }
+    numopen++;
+    if (conns[i]->current_uri == session->current_uri)
+      numuri++;
+    if ((conn == NULL) || (conns[i]->users < conn->users))
+      conn = conns[i];
+  }
+  /* open a new connection if all connections are in use or fewer than
+     connections_min are open (unless the limit for the URI is reached) */
+  if ((freeidx >= 0) &&
+      ((nslcd_cfg->connections_per_uri == 0) ||
+       (numuri < nslcd_cfg->connections_per_uri)) &&
+      ((conn == NULL) || (conn->users > 0) ||
+       (numopen < nslcd_cfg->connections_min)))
+  {
+    conn = (struct myldap_conn *)malloc(sizeof(struct myldap_conn));
+    if (conn == NULL)
+    {
+      log_log(LOG_CRIT, "do_open_shared(): malloc() failed to allocate memory");
+      exit(EXIT_FAILURE);
+    }
+    conn->ld = NULL;
+    conn->idx = freeidx;
+    conn->current_uri = session->current_uri;
+    conn->users = 0;
+    pthread_mutex_init(&(conn->mutex), NULL);
+    pthread_cond_init(&(conn->cond), NULL);
+    conn->reading = 0;
+    conn->failed = 0;
+    conn->lastactivity = 0;
+    conn->searches = NULL;
+    conn->full = 0;
+    conns[freeidx] = conn;
+  }
+  conn->users++;
+  pthread_mutex_unlock(&conns_mutex);
+  /* the first session to use the connection opens it */
+  pthread_mutex_lock(&(conn->mutex));
+  if (conn->ld == NULL)
+  {
+    rc = do_connect(session);
+    if (rc == LDAP_SUCCESS)
+    {
+      conn->ld = session->ld;
+      conn->current_uri = session->current_uri;
+      conn->lastactivity = session->lastactivity;
+    }
+  }
+  else
+  {
+    session->ld = conn->ld;
+    session->current_uri = conn->current_uri;
+    time(&(session->lastactivity));
+  }
+  pthread_mutex_unlock(&(conn->mutex));
+  session->conn = conn;
+  if (rc != LDAP_SUCCESS)
+    do_release_conn(session, 1);
+  return rc;
+}
+
+/* Ensure that the session has an open connection. Sessions that bind with
+   their own credentials always get a private connection. This returns an
+   LDAP status code. */
+static int do_open(MYLDAP_SESSION *session)
+{
+  /* if the connection is still there (ie. ldap_unbind() wasn't
+     called) then we can return the cached connection */
+  if (session->ld != NULL)
+    return LDAP_SUCCESS;
+  if ((nslcd_cfg->connections > 0) && (session->binddn[0] == '\0'))
+    return do_open_shared(session);
+  return do_connect(session);
+}
+
+void myldap_session_refresh(MYLDAP_SESSION *session)
+{
+  MYLDAP_SEARCH *search;
+  static const char *attrs[2] = { "dn", NULL };
+  int rc;
+  time_t now;
+  if ((session->ld != NULL) || (session->binddn[0] != '\0'))
+    return;
+  now = time(NULL);
+  pthread_mutex_lock(&refresh_mutex);
+  /* only one thread reopens a connection and we do not try again soon
+     after a failed attempt */
+  if ((!refresh_pending) || (refresh_busy) ||
+      ((refresh_failed > 0) &&
+       (now < refresh_failed + nslcd_cfg->reconnect_retrytime)))
+  {
+    pthread_mutex_unlock(&refresh_mutex);
+    return;
+  }
+  refresh_pending = 0;
+  refresh_busy = 1;
+  pthread_mutex_unlock(&refresh_mutex);
+  log_log(LOG_DEBUG, "myldap_session_refresh(): reopening connection");
+  /* a search that only binds goes through the normal failover logic */
+  search = myldap_search(session, "", MYLDAP_SCOPE_BINDONLY,
+                         "(objectClass=*)", attrs, &rc);
+  if (search != NULL)
+    myldap_search_close(search);
+  else
+    myldap_err(LOG_DEBUG, NULL, rc, "myldap_session_refresh(): failed to reopen connection");
+  /* release the memory that was used for the search */
+  myldap_session_cleanup(session);
+  pthread_mutex_lock(&refresh_mutex);
+  refresh_busy = 0;
+  if (search == NULL)
+    refresh_failed = time(NULL);
+  pthread_mutex_unlock(&refresh_mutex);
+}
+
+/* the sessions with open connections that are kept for binding as users
+   (at most pam_bind_connections), protected by the mutex */
+static pthread_mutex_t bindpool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static MYLDAP_SESSION **bindpool = NULL;
+static int bindpool_num = 0;
+
+MYLDAP_SESSION *myldap_create_bind_session(void)
+{
+  MYLDAP_SESSION *session = NULL;
+  pthread_mutex_lock(&bindpool_mutex);
+  if (bindpool_num > 0)
+    session = bindpool[--bindpool_num];
+  pthread_mutex_unlock(&bindpool_mutex);
+  if (session == NULL)
+    return myldap_create_session();
+  log_log(LOG_DEBUG, "myldap_create_bind_session(): using pooled connection");
+  /* the connection may have been closed while it was in the pool */
+  myldap_session_check(session);
+  return session;
+}
+
+void myldap_bind_session_close(MYLDAP_SESSION *session)
+{
+  int rc;
+  if (session == NULL)
+    return;
+  myldap_session_cleanup(session);
+  /* forget the user credentials */
+  memset(session->binddn, 0, sizeof(session->binddn));
+  memset(session->bindpw, 0, sizeof(session->bindpw));
+  session->policy_response = NSLCD_PAM_SUCCESS;
+  session->policy_message[0] = '\0';
+  if ((nslcd_cfg->pam_bind_connections > 0) && (session->ld != NULL) &&
+      (session->conn == NULL))
+  {
+    /* bind with the normal credentials so the connection is no longer
+       authenticated as the user */
+    rc = do_bind_creds(session, session->ld,
+                       nslcd_cfg->uris[session->current_uri].uri);
+    if (rc == LDAP_SUCCESS)
+    {
+      pthread_mutex_lock(&bindpool_mutex);
+      if (bindpool == NULL)
+      {
+        bindpool = (MYLDAP_SESSION **)calloc((size_t)nslcd_cfg->pam_bind_connections,
+                                             sizeof(MYLDAP_SESSION *));
+        if (bindpool == NULL)
+        {
+          pthread_mutex_unlock(&bindpool_mutex);
+          log_log(LOG_CRIT, "myldap_bind_session_close(): malloc() failed to allocate memory");
+          myldap_session_close(session);
+          return;
+        }
+      }
+      if (bindpool_num < nslcd_cfg->pam_bind_connections)
+      {
+        bindpool[bindpool_num++] = session;
+        session = NULL;
+      }
+      pthread_mutex_unlock(&bindpool_mutex);
+      if (session == NULL)
+        return;
+    }
+    else
+      myldap_err(LOG_DEBUG, session->ld, rc, "failed to rebind connection for pool");
+  }
+  myldap_session_close(session);
+}
+
 /* Perform a simple bind operation and return the ppolicy results. */
 int myldap_bind(MYLDAP_SESSION *session, const char *dn, const char *password,
                 int *response, const char **message)
@@ -1150,6 +1905,27 @@ int myldap_bind(MYLDAP_SESSION *session, const char *dn, const char *password,
   session->binddn[sizeof(session->binddn) - 1] = '\0';
   strncpy(session->bindpw, password, sizeof(session->bindpw));
   session->bindpw[sizeof(session->bindpw) - 1] = '\0';
+  session->policy_response = NSLCD_PAM_SUCCESS;
+  session->policy_message[0] = '\0';
+  /* bind on the connection that is already open (from the pool of bind
+     sessions), reconnecting if this fails with anything other than a
+     credentials problem */
+  if ((session->ld != NULL) && (session->conn == NULL))
+  {
+    rc = do_bind_creds(session, session->ld,
+                       nslcd_cfg->uris[session->current_uri].uri);
+    if ((rc == LDAP_SUCCESS) || (rc == LDAP_INVALID_CREDENTIALS))
+    {
+      time(&(session->lastactivity));
+      if (response != NULL)
+        *response = session->policy_response;
+      if (message != NULL)
+        *message = session->policy_message;
+      return rc;
+    }
+    myldap_err(LOG_DEBUG, session->ld, rc, "bind on open connection failed, reconnecting");
+    do_close(session);
+  }
   /* construct a fake search to trigger the BIND operation */
   attrs[0] = "dn";
   attrs[1] = NULL;
@@ -1230,11 +2006,18 @@ static int do_try_search(MYLDAP_SEARCH *search)
     if (ldap_set_option(search->session->ld, LDAP_OPT_ERROR_NUMBER, &rc) != LDAP_SUCCESS)
       log_log(LOG_WARNING, "failed to clear the error flag");
   }
-  /* perform the search */
+  /* perform the search (on a shared connection the search is registered
+     before another thread can read the results) */
+  if (search->session->conn != NULL)
+    pthread_mutex_lock(&(search->session->conn->mutex));
   rc = ldap_search_ext(search->session->ld, search->base, search->scope,
                        search->filter, (char **)(search->attrs),
                        0, serverctrls[0] == NULL ? NULL : serverctrls,
                        NULL, NULL, LDAP_NO_LIMIT, &msgid);
+  if (rc == LDAP_SUCCESS)
+    do_set_msgid(search, msgid);
+  if (search->session->conn != NULL)
+    pthread_mutex_unlock(&(search->session->conn->mutex));
   /* free the controls if we had them */
   for (ctrlidx = 0; serverctrls[ctrlidx] != NULL; ctrlidx++)
     ldap_control_free(serverctrls[ctrlidx]);
@@ -1246,8 +2029,6 @@ static int do_try_search(MYLDAP_SEARCH *search)
   }
   /* update the last activity on the connection */
   time(&(search->session->lastactivity));
-  /* save msgid */
-  search->msgid = msgid;
   /* return the new search */
   return LDAP_SUCCESS;
 }
@@ -1259,6 +2040,7 @@ MYLDAP_SESSION *myldap_create_session(void)
 
 void myldap_session_cleanup(MYLDAP_SESSION *session)
 {
+  MYLDAP_SEARCH *search;
   int i;
   /* check parameter */
   if (session == NULL)
@@ -1275,6 +2057,24 @@ void myldap_session_cleanup(MYLDAP_SESSION *session)
       session->searches[i] = NULL;
     }
   }
+  /* release the memory that was used for the searches in bulk */
+  for (search = session->freesearches; search != NULL; search = search->free_next)
+  {
+    if (search->entryarena == NULL)
+      continue;
+    if (session->numentryarenas < MAX_SEARCHES_IN_SESSION)
+    {
+      arena_reset(search->entryarena);
+      session->entryarenas[session->numentryarenas++] = search->entryarena;
+    }
+    else
+      arena_free(search->entryarena);
+  }
+  session->freesearches = NULL;
+  arena_reset(session->arena);
+  /* return the shared connection to the pool */
+  if (session->conn != NULL)
+    do_release_conn(session, 0);
 }
 
 void myldap_session_close(MYLDAP_SESSION *session)
@@ -1287,9 +2087,15 @@ void myldap_session_close(MYLDAP_SESSION *session)
   }
   /* close pending searches */
   myldap_session_cleanup(session);
+  /* stop using the shared connection */
+  if (session->conn != NULL)
+    do_release_conn(session, 0);
   /* close any open connections */
   do_close(session);
   /* free allocated memory */
+  while (session->numentryarenas > 0)
+    arena_free(session->entryarenas[--session->numentryarenas]);
+  arena_free(session->arena);
   memset(session->bindpw, 0, sizeof(session->bindpw));
   free(session);
 }
@@ -1485,6 +2291,7 @@ MYLDAP_SEARCH *myldap_search(MYLDAP_SESSION *session,
   session->searches[i] = search;
   /* do the search with retries to all configured servers */
   rc = do_retry_search(search);
+  stats_search(rc);
   if (rc != LDAP_SUCCESS)
   {
     myldap_search_close(search);
@@ -1510,10 +2317,7 @@ void myldap_search_close(MYLDAP_SEARCH *search)
   }
   /* abandon the search if there were more results to fetch */
   if ((search->session->ld != NULL) && (search->msgid != -1))
-  {
-    ldap_abandon(search->session->ld, search->msgid);
-    search->msgid = -1;
-  }
+    (void)do_abandon(search);
   /* find the reference to this search in the session */
   for (i = 0; i < MAX_SEARCHES_IN_SESSION; i++)
   {
@@ -1529,8 +2333,9 @@ void myldap_search_close(MYLDAP_SEARCH *search)
   /* free read messages */
   if (search->msg != NULL)
     ldap_msgfree(search->msg);
-  /* free the storage we allocated */
-  free(search);
+  /* keep the storage for another search in the same request */
+  search->free_next = search->session->freesearches;
+  search->session->freesearches = search;
 }
 
 MYLDAP_ENTRY *myldap_get_entry(MYLDAP_SEARCH *search, int *rcp)
@@ -1591,8 +2396,7 @@ MYLDAP_ENTRY *myldap_get_entry(MYLDAP_SEARCH *search, int *rcp)
       search->msg = NULL;
     }
     /* get the next result */
-    rc = ldap_result(search->session->ld, search->msgid, LDAP_MSG_ONE, tvp,
-                     &(search->msg));
+    rc = do_get_result(search, tvp, &(search->msg));
     /* handle result */
     switch (rc)
     {
@@ -1665,7 +2469,7 @@ MYLDAP_ENTRY *myldap_get_entry(MYLDAP_SEARCH *search, int *rcp)
           /* TODO: handle the above return code?? */
           ldap_controls_free(resultcontrols);
         }
-        search->msgid = -1;
+        do_clear_msgid(search);
         /* check if there are more pages to come */
         if ((search->cookie == NULL) || (search->cookie->bv_len == 0))
         {
@@ -1877,7 +2681,11 @@ static char **myldap_get_ranged_values(MYLDAP_ENTRY *entry, const char *attr)
       break;
     entry = myldap_get_entry(search, NULL);
     if (entry == NULL)
+    {
+      /* myldap_get_entry() already closed the search */
+      search = NULL;
       break;
+    }
   }
   /* close any started searches */
   if (search != NULL)
@@ -1964,9 +2772,10 @@ const char **myldap_get_values(MYLDAP_ENTRY *entry, const char *attr)
   return NULL;
 }
 
-/* Convert the bervalues to a simple list of strings that can be freed
-   with one call to free(). */
-static const char **bervalues_to_values(struct berval **bvalues)
+/* Convert the bervalues to a simple list of strings that is allocated
+   with the entry. */
+static const char **bervalues_to_values(MYLDAP_ENTRY *entry,
+                                        struct berval **bvalues)
 {
   int num_values;
   int i;
@@ -1979,7 +2788,7 @@ static const char **bervalues_to_values(struct berval **bvalues)
   for (i = 0; i < num_values; i++)
     sz += bvalues[i]->bv_len + 1;
   /* allocate the needed memory */
-  values = (char **)malloc(sz);
+  values = (char **)myldap_entry_alloc(entry, sz);
   if (values == NULL)
   {
     log_log(LOG_CRIT, "bervalues_to_values(): malloc() failed to allocate memory");
@@ -2051,8 +2860,10 @@ const char **myldap_get_values_len(MYLDAP_ENTRY *entry, const char *attr)
   }
   else
   {
-    values = bervalues_to_values(bvalues);
+    /* these values are freed with the entry */
+    values = bervalues_to_values(entry, bvalues);
     ldap_value_free_len(bvalues);
+    return values;
   }
   /* check if we got allocated memory */
   if (values == NULL)
@@ -2315,10 +3126,12 @@ const char ***myldap_get_deref_values(MYLDAP_ENTRY *entry,
         size += sizeof(char *) * (counts[i] + 1);
       for (i = 0; i < 2; i++)
         size += sizeof(char) * sizes[i];
-      buffer = (char *)malloc(size);
+      buffer = (char *)myldap_entry_alloc(entry, size);
       if (buffer == NULL)
       {
         log_log(LOG_CRIT, "myldap_get_deref_values(): malloc() failed to allocate memory");
+        ldap_derefresponse_free(deref);
+        ldap_controls_free(entryctrls);
         return NULL;
       }
       /* allocate the list of lists */
@@ -2339,18 +3152,8 @@ const char ***myldap_get_deref_values(MYLDAP_ENTRY *entry,
   /* free control data */
   ldap_derefresponse_free(deref);
   ldap_controls_free(entryctrls);
-  /* store results so we can free it later on */
-  for (i = 0; i < MAX_BUFFERS_PER_ENTRY; i++)
-    if (entry->buffers[i] == NULL)
-    {
-      entry->buffers[i] = (void *)results;
-      return (const char ***)results;
-    }
-  /* we found no room to store the values */
-  log_log(LOG_ERR, "myldap_get_deref_values() couldn't store results, "
-          "increase MAX_BUFFERS_PER_ENTRY");
-  free(results);
-  return NULL;
+  /* the results are freed with the entry */
+  return (const char ***)results;
 }
 #else /* not HAVE_LDAP_PARSE_DEREF_CONTROL */
 const char ***myldap_get_deref_values(MYLDAP_ENTRY UNUSED(*entry),
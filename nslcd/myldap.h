@@ -68,6 +68,16 @@ typedef struct myldap_entry MYLDAP_ENTRY;
    uses the configuration to find the URLs to attempt connections to. */
 MUST_USE MYLDAP_SESSION *myldap_create_session(void);
 
+/* Get a session for binding as a user with myldap_bind(). If
+   pam_bind_connections is set, the session may already have an open
+   connection from an earlier bind. */
+MUST_USE MYLDAP_SESSION *myldap_create_bind_session(void);
+
+/* Release a session that was returned by myldap_create_bind_session(). The
+   connection is bound again with the normal credentials and kept for
+   another bind, or the session is closed. */
+void myldap_bind_session_close(MYLDAP_SESSION *session);
+
 /* Perform a simple bind operation and return the ppolicy results.
    This function returns an LDAP status code while response is an NSLCD_PAM_*
    code with accompanying message. */
@@ -76,14 +86,25 @@ MUST_USE int myldap_bind(MYLDAP_SESSION *session, const char *dn,
                          int *response, const char **message);
 
 /* Closes all pending searches and deallocates any memory that is allocated
-   with these searches. This does not close the session. */
+   with these searches. A shared connection is returned to the pool of
+   connections. This does not close the session. */
 void myldap_session_cleanup(MYLDAP_SESSION *session);
 
 /* This checks the timeout value of the session and closes the connection
    to the LDAP server if the timeout has expired and there are no pending
-   searches. */
+   searches. Shared connections that are not in use are closed if they were
+   closed by the server or reached the timeout. */
 void myldap_session_check(MYLDAP_SESSION *session);
 
+/* Reopen a connection to the LDAP server (and bind) if a connection was
+   closed by myldap_session_check() and idle_reconnect is enabled or if
+   fewer shared connections are open than configured with connections_min.
+   This can be called by idle threads so the next search does not have to
+   wait for a new connection to be set up. Only one thread at a time
+   reopens a connection and no new attempt is made within
+   reconnect_retrytime of a failed attempt. */
+void myldap_session_refresh(MYLDAP_SESSION *session);
+
 /* Close the session and free all the resources allocated for the session.
    After a call to this function the referenced handle is invalid. */
 void myldap_session_close(MYLDAP_SESSION *session);
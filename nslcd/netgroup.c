@@ -32,12 +32,16 @@
 #include <sys/types.h>
 #include <sys/param.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "common.h"
 #include "log.h"
 #include "myldap.h"
 #include "cfg.h"
 #include "attmap.h"
+#include "common/dict.h"
+#include "common/set.h"
 
 /* ( nisSchema.2.8 NAME 'nisNetgroup' SUP top STRUCTURAL
  *   DESC 'Abstraction of a netgroup. May refer to other netgroups'
@@ -123,12 +127,13 @@ static int write_string_stripspace_len(TFILE *fp, const char *str, int len)
 #define WRITE_STRING_STRIPSPACE(fp, str)                                    \
   WRITE_STRING_STRIPSPACE_LEN(fp, str, strlen(str))
 
-static int write_netgroup_triple(TFILE *fp, MYLDAP_ENTRY *entry,
-                                 const char *triple)
+/* find the host, user and domain parts of the triple, the begin and end
+   offsets of the parts are stored in pos, returns -1 if the triple is
+   invalid */
+static int split_netgroup_triple(MYLDAP_ENTRY *entry, const char *triple,
+                                 int pos[6])
 {
-  int32_t tmpint32;
   int i;
-  int hostb, hoste, userb, usere, domainb, domaine;
   /* skip leading spaces */
   for (i = 0; (triple[i] != '\0') && (isspace(triple[i])); i++)
     /* nothing */ ;
@@ -137,41 +142,41 @@ static int write_netgroup_triple(TFILE *fp, MYLDAP_ENTRY *entry,
   {
     log_log(LOG_WARNING, "%s: %s: does not begin with '('",
             myldap_get_dn(entry), attmap_netgroup_nisNetgroupTriple);
-    return 0;
+    return -1;
   }
   i++;
-  hostb = i;
+  pos[0] = i;
   /* find comma (end of host string) */
   for (; (triple[i] != '\0') && (triple[i] != ','); i++)
     /* nothing */ ;
-  hoste = i;
+  pos[1] = i;
   if (triple[i++] != ',')
   {
     log_log(LOG_WARNING, "%s: %s: missing ','",
             myldap_get_dn(entry), attmap_netgroup_nisNetgroupTriple);
-    return 0;
+    return -1;
   }
-  userb = i;
+  pos[2] = i;
   /* find comma (end of user string) */
   for (; (triple[i] != '\0') && (triple[i] != ','); i++)
     /* nothing */ ;
-  usere = i;
+  pos[3] = i;
   if (triple[i++] != ',')
   {
     log_log(LOG_WARNING, "%s: %s: missing ','",
             myldap_get_dn(entry), attmap_netgroup_nisNetgroupTriple);
-    return 0;
+    return -1;
   }
-  domainb = i;
+  pos[4] = i;
   /* find closing bracket (end of domain string) */
   for (; (triple[i] != '\0') && (triple[i] != ')'); i++)
     /* nothing */ ;
-  domaine=i;
+  pos[5] = i;
   if (triple[i++] != ')')
   {
     log_log(LOG_WARNING, "%s: %s: missing ')'",
             myldap_get_dn(entry), attmap_netgroup_nisNetgroupTriple);
-    return 0;
+    return -1;
   }
   /* skip trailing spaces */
   for (; (triple[i] != '\0') && (isspace(triple[i])); i++)
@@ -181,13 +186,23 @@ static int write_netgroup_triple(TFILE *fp, MYLDAP_ENTRY *entry,
   {
     log_log(LOG_WARNING, "%s: %s: contains trailing data",
             myldap_get_dn(entry), attmap_netgroup_nisNetgroupTriple);
-    return 0;
+    return -1;
   }
+  return 0;
+}
+
+static int write_netgroup_triple(TFILE *fp, MYLDAP_ENTRY *entry,
+                                 const char *triple)
+{
+  int32_t tmpint32;
+  int pos[6];
+  if (split_netgroup_triple(entry, triple, pos))
+    return 0;
   /* write strings */
   WRITE_INT32(fp, NSLCD_NETGROUP_TYPE_TRIPLE);
-  WRITE_STRING_STRIPSPACE_LEN(fp, triple + hostb, hoste - hostb)
-  WRITE_STRING_STRIPSPACE_LEN(fp, triple + userb, usere - userb)
-  WRITE_STRING_STRIPSPACE_LEN(fp, triple + domainb, domaine - domainb)
+  WRITE_STRING_STRIPSPACE_LEN(fp, triple + pos[0], pos[1] - pos[0])
+  WRITE_STRING_STRIPSPACE_LEN(fp, triple + pos[2], pos[3] - pos[2])
+  WRITE_STRING_STRIPSPACE_LEN(fp, triple + pos[4], pos[5] - pos[4])
   /* we're done */
   return 0;
 }
@@ -238,6 +253,444 @@ static int write_netgroup(TFILE *fp, MYLDAP_ENTRY *entry, const char *reqname)
   return 0;
 }
 
+/*
+   The closure of a netgroup holds the triples of the netgroup and of all
+   netgroups that are (indirectly) a member of it. Duplicate triples are
+   removed. Each triple is stored as the host, user and domain strings
+   (without surrounding spaces) in a single allocation. The index contains
+   the triples with lower-case host and domain for quick lookups.
+
+   Closures are kept in netgroup_cache for the time that is configured
+   with the netgroup cache option. Cached closures are also kept in one of
+   two queues (for found and not found netgroups) that are ordered by
+   expiry time so expired closures can be removed without going over the
+   whole cache. The queue holds a reference to the closure. The cache, the
+   queues and the reference counts are protected by netgroup_cache_mutex.
+*/
+struct netgroup_closure {
+  int refs;                 /* number of references */
+  time_t expire;            /* the time the closure is valid until */
+  int found;                /* whether the netgroup itself was found */
+  int num;                  /* number of triples */
+  int size;                 /* allocated size of triples */
+  char **triples;
+  SET *index;
+  char *name;               /* the name the closure is cached under */
+  struct netgroup_closure *next; /* the next closure in the queue */
+};
+
+static pthread_mutex_t netgroup_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DICT *netgroup_cache = NULL;
+static struct netgroup_closure *netgroup_queue[2] = { NULL, NULL };
+static struct netgroup_closure *netgroup_queuetail[2] = { NULL, NULL };
+
+/* copy the string without leading and trailing spaces,
+   returns -1 if it does not fit in the buffer */
+static int copy_stripspace(char *buf, size_t buflen, const char *str, int len)
+{
+  int i, j;
+  for (i = 0; (i < len) && (isspace(str[i])); i++)
+    /* nothing */ ;
+  for (j = len; (j > i) && (isspace(str[j - 1])); j--)
+    /* nothing */ ;
+  if ((size_t)(j - i) >= buflen)
+    return -1;
+  memcpy(buf, str + i, j - i);
+  buf[j - i] = '\0';
+  return 0;
+}
+
+/* build the key for the triple in the closure index, host names and domains
+   are compared case-insensitively */
+static int netgroup_index_key(char *buf, size_t buflen, const char *host,
+                              const char *user, const char *domain)
+{
+  int i;
+  if (mysnprintf(buf, buflen, "%s\n%s\n%s", host, user, domain))
+    return -1;
+  for (i = 0; buf[i] != '\n'; i++)
+    buf[i] = tolower((unsigned char)buf[i]);
+  for (i = strlen(buf) - strlen(domain); buf[i] != '\0'; i++)
+    buf[i] = tolower((unsigned char)buf[i]);
+  return 0;
+}
+
+static void netgroup_closure_free(struct netgroup_closure *closure)
+{
+  int i;
+  for (i = 0; i < closure->num; i++)
+    free(closure->triples[i]);
+  if (closure->triples != NULL)
+    free(closure->triples);
+  set_free(closure->index);
+  if (closure->name != NULL)
+    free(closure->name);
+  free(closure);
+}
+
+/* drop a reference to the closure, the caller should hold
+   netgroup_cache_mutex */
+static void netgroup_closure_unref(struct netgroup_closure *closure)
+{
+  closure->refs--;
+  if (closure->refs <= 0)
+    netgroup_closure_free(closure);
+}
+
+static void netgroup_closure_release(struct netgroup_closure *closure)
+{
+  pthread_mutex_lock(&netgroup_cache_mutex);
+  netgroup_closure_unref(closure);
+  pthread_mutex_unlock(&netgroup_cache_mutex);
+}
+
+/* remove the first closure in the queue from the cache, the caller should
+   hold netgroup_cache_mutex */
+static void netgroup_cache_pop(int queue)
+{
+  struct netgroup_closure *closure = netgroup_queue[queue];
+  netgroup_queue[queue] = closure->next;
+  if (netgroup_queue[queue] == NULL)
+    netgroup_queuetail[queue] = NULL;
+  /* the name may refer to a newer closure */
+  if (dict_get(netgroup_cache, closure->name) == closure)
+    (void)dict_del(netgroup_cache, closure->name);
+  netgroup_closure_unref(closure);
+}
+
+void netgroup_cache_clear(void)
+{
+  int queue;
+  pthread_mutex_lock(&netgroup_cache_mutex);
+  for (queue = 0; queue < 2; queue++)
+    while (netgroup_queue[queue] != NULL)
+      netgroup_cache_pop(queue);
+  pthread_mutex_unlock(&netgroup_cache_mutex);
+}
+
+/* add the triple to the closure if it is not already present,
+   returns -1 on memory allocation errors */
+static int netgroup_closure_add(struct netgroup_closure *closure,
+                                MYLDAP_ENTRY *entry, const char *triple)
+{
+  int pos[6];
+  char host[BUFLEN_HOSTNAME], user[BUFLEN_NAME], domain[BUFLEN_HOSTNAME];
+  char key[BUFLEN_HOSTNAME * 2 + BUFLEN_NAME];
+  size_t hostlen, userlen, domainlen;
+  char **tmp;
+  char *value;
+  if (split_netgroup_triple(entry, triple, pos))
+    return 0;
+  if (copy_stripspace(host, sizeof(host), triple + pos[0], pos[1] - pos[0]) ||
+      copy_stripspace(user, sizeof(user), triple + pos[2], pos[3] - pos[2]) ||
+      copy_stripspace(domain, sizeof(domain), triple + pos[4], pos[5] - pos[4]) ||
+      netgroup_index_key(key, sizeof(key), host, user, domain))
+  {
+    log_log(LOG_WARNING, "%s: %s: value too long",
+            myldap_get_dn(entry), attmap_netgroup_nisNetgroupTriple);
+    return 0;
+  }
+  /* skip duplicate triples */
+  if (set_contains(closure->index, key))
+    return 0;
+  /* grow the list of triples if needed */
+  if (closure->num >= closure->size)
+  {
+    tmp = (char **)realloc(closure->triples,
+                           (closure->size * 2 + 16) * sizeof(char *));
+    if (tmp == NULL)
+      return -1;
+    closure->triples = tmp;
+    closure->size = closure->size * 2 + 16;
+  }
+  hostlen = strlen(host) + 1;
+  userlen = strlen(user) + 1;
+  domainlen = strlen(domain) + 1;
+  value = (char *)malloc(hostlen + userlen + domainlen);
+  if (value == NULL)
+    return -1;
+  memcpy(value, host, hostlen);
+  memcpy(value + hostlen, user, userlen);
+  memcpy(value + hostlen + userlen, domain, domainlen);
+  if (set_add(closure->index, key))
+  {
+    free(value);
+    return -1;
+  }
+  closure->triples[closure->num++] = value;
+  return 0;
+}
+
+/* add the triples of the entry to the closure and the member netgroups to
+   tocheck, returns -1 on memory allocation errors */
+static int netgroup_closure_entry(struct netgroup_closure *closure,
+                                  MYLDAP_ENTRY *entry, const char *name,
+                                  SET *seen, SET *tocheck)
+{
+  int i;
+  const char **values;
+  char member[BUFLEN_NAME];
+  /* check that the entry is really for the netgroup */
+  values = myldap_get_values(entry, attmap_netgroup_cn);
+  if (values == NULL)
+    return 0;
+  for (i = 0; values[i] != NULL; i++)
+    if (STR_CMP(name, values[i]) == 0)
+      break;
+  if (values[i] == NULL)
+    return 0;
+  /* add the triples */
+  values = myldap_get_values(entry, attmap_netgroup_nisNetgroupTriple);
+  if (values != NULL)
+    for (i = 0; values[i] != NULL; i++)
+      if (netgroup_closure_add(closure, entry, values[i]))
+        return -1;
+  /* queue the member netgroups */
+  values = myldap_get_values(entry, attmap_netgroup_memberNisNetgroup);
+  if (values != NULL)
+    for (i = 0; values[i] != NULL; i++)
+    {
+      if (copy_stripspace(member, sizeof(member), values[i], strlen(values[i])))
+      {
+        log_log(LOG_WARNING, "%s: %s: value too long",
+                myldap_get_dn(entry), attmap_netgroup_memberNisNetgroup);
+        continue;
+      }
+      if ((member[0] != '\0') && (!set_contains(seen, member)) &&
+          set_add(tocheck, member))
+        return -1;
+    }
+  return 1;
+}
+
+/* look up the netgroup and all netgroups that are (indirectly) a member of
+   it, returns NULL on errors */
+static struct netgroup_closure *netgroup_expand(MYLDAP_SESSION *session,
+                                                const char *name)
+{
+  struct netgroup_closure *closure;
+  SET *seen, *tocheck;
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  char filter[BUFLEN_FILTER];
+  const char *base;
+  char *group;
+  int i, rc, res;
+  int failed = 0;
+  /* allocate the closure and the sets used for walking the netgroups */
+  closure = (struct netgroup_closure *)malloc(sizeof(struct netgroup_closure));
+  if (closure == NULL)
+  {
+    log_log(LOG_CRIT, "netgroup_expand(): malloc() failed to allocate memory");
+    return NULL;
+  }
+  closure->refs = 1;
+  closure->expire = 0;
+  closure->found = 0;
+  closure->num = 0;
+  closure->size = 0;
+  closure->triples = NULL;
+  closure->name = NULL;
+  closure->next = NULL;
+  closure->index = set_new();
+  seen = set_new();
+  tocheck = set_new();
+  if ((closure->index == NULL) || (seen == NULL) || (tocheck == NULL) ||
+      set_add(tocheck, name))
+  {
+    log_log(LOG_CRIT, "netgroup_expand(): malloc() failed to allocate memory");
+    if (closure->index != NULL)
+      set_free(closure->index);
+    free(closure);
+    if (seen != NULL)
+      set_free(seen);
+    if (tocheck != NULL)
+      set_free(tocheck);
+    return NULL;
+  }
+  /* go over all netgroups that need to be looked up */
+  while ((!failed) && ((group = set_pop(tocheck)) != NULL))
+  {
+    if (set_contains(seen, group))
+    {
+      free(group);
+      continue;
+    }
+    if (set_add(seen, group))
+    {
+      log_log(LOG_CRIT, "netgroup_expand(): malloc() failed to allocate memory");
+      free(group);
+      failed = 1;
+      break;
+    }
+    if (mkfilter_netgroup_byname(group, filter, sizeof(filter)))
+    {
+      log_log(LOG_ERR, "netgroup_expand(): filter buffer too small");
+      failed = 1;
+    }
+    /* perform a search for each search base */
+    for (i = 0; (!failed) && ((base = netgroup_bases[i]) != NULL); i++)
+    {
+      search = myldap_search(session, base, netgroup_scope, filter,
+                             netgroup_attrs, &rc);
+      if (search == NULL)
+      {
+        failed = 1;
+        break;
+      }
+      while ((entry = myldap_get_entry(search, &rc)) != NULL)
+      {
+        res = netgroup_closure_entry(closure, entry, group, seen, tocheck);
+        if (res < 0)
+        {
+          log_log(LOG_CRIT, "netgroup_expand(): malloc() failed to allocate memory");
+          myldap_search_close(search);
+          failed = 1;
+          break;
+        }
+        else if ((res > 0) && (STR_CMP(group, name) == 0))
+          closure->found = 1;
+      }
+      if (rc != LDAP_SUCCESS)
+        failed = 1;
+    }
+    free(group);
+  }
+  set_free(seen);
+  set_free(tocheck);
+  if (failed)
+  {
+    netgroup_closure_free(closure);
+    return NULL;
+  }
+  return closure;
+}
+
+/* return the closure of the netgroup from the cache or look it up, the
+   closure should be released with netgroup_closure_release() */
+static struct netgroup_closure *netgroup_closure_get(MYLDAP_SESSION *session,
+                                                    const char *name)
+{
+  struct netgroup_closure *closure;
+  time_t now, ttl;
+  int queue;
+  now = time(NULL);
+  /* see if we have a valid closure in the cache (expired closures are
+     removed from the cache when a new closure is added) */
+  pthread_mutex_lock(&netgroup_cache_mutex);
+  if ((netgroup_cache != NULL) &&
+      ((closure = (struct netgroup_closure *)dict_get(netgroup_cache, name)) != NULL) &&
+      (closure->expire > now))
+  {
+    closure->refs++;
+    pthread_mutex_unlock(&netgroup_cache_mutex);
+    log_log(LOG_DEBUG, "netgroup closure from cache");
+    return closure;
+  }
+  pthread_mutex_unlock(&netgroup_cache_mutex);
+  /* look up the netgroups */
+  closure = netgroup_expand(session, name);
+  if (closure == NULL)
+    return NULL;
+  /* store the closure in the cache */
+  ttl = closure->found ? nslcd_cfg->cache_positive[LM_NETGROUP]
+                       : nslcd_cfg->cache_negative[LM_NETGROUP];
+  if (ttl == 0)
+    return closure;
+  closure->expire = now + ttl;
+  closure->name = strdup(name);
+  if (closure->name == NULL)
+  {
+    log_log(LOG_CRIT, "netgroup_closure_get(): strdup() failed to allocate memory");
+    return closure;
+  }
+  pthread_mutex_lock(&netgroup_cache_mutex);
+  if (netgroup_cache == NULL)
+    netgroup_cache = dict_new();
+  if (netgroup_cache != NULL)
+  {
+    /* remove expired closures from the start of the queues (the closures
+       in each queue have the same time to live) */
+    for (queue = 0; queue < 2; queue++)
+      while ((netgroup_queue[queue] != NULL) &&
+             (netgroup_queue[queue]->expire <= now))
+        netgroup_cache_pop(queue);
+    /* a closure that is replaced stays queued until it expires */
+    if (dict_put(netgroup_cache, name, closure) == 0)
+    {
+      closure->refs++;
+      queue = closure->found ? 0 : 1;
+      if (netgroup_queuetail[queue] == NULL)
+        netgroup_queue[queue] = closure;
+      else
+        netgroup_queuetail[queue]->next = closure;
+      netgroup_queuetail[queue] = closure;
+    }
+  }
+  pthread_mutex_unlock(&netgroup_cache_mutex);
+  return closure;
+}
+
+/* check whether the host, user and domain match a triple in the closure
+   (empty values match any value) */
+static int netgroup_closure_contains(struct netgroup_closure *closure,
+                                     const char *host, const char *user,
+                                     const char *domain)
+{
+  char key[BUFLEN_HOSTNAME * 2 + BUFLEN_NAME];
+  const char *thost, *tuser, *tdomain;
+  int i;
+  /* if all values are specified the index can be used: a triple matches
+     if each part is either the same or empty */
+  if ((host[0] != '\0') && (user[0] != '\0') && (domain[0] != '\0'))
+  {
+    for (i = 0; i < 8; i++)
+      if ((netgroup_index_key(key, sizeof(key), (i & 1) ? "" : host,
+                              (i & 2) ? "" : user, (i & 4) ? "" : domain) == 0) &&
+          set_contains(closure->index, key))
+        return 1;
+    return 0;
+  }
+  /* otherwise check all triples */
+  for (i = 0; i < closure->num; i++)
+  {
+    thost = closure->triples[i];
+    tuser = thost + strlen(thost) + 1;
+    tdomain = tuser + strlen(tuser) + 1;
+    if (((host[0] == '\0') || (thost[0] == '\0') || (strcasecmp(host, thost) == 0)) &&
+        ((user[0] == '\0') || (tuser[0] == '\0') || (strcmp(user, tuser) == 0)) &&
+        ((domain[0] == '\0') || (tdomain[0] == '\0') || (strcasecmp(domain, tdomain) == 0)))
+      return 1;
+  }
+  return 0;
+}
+
+static int write_netgroup_closure(TFILE *fp, struct netgroup_closure *closure,
+                                  const char *name)
+{
+  int32_t tmpint32;
+  int i;
+  const char *host, *user, *domain;
+  if (closure->found)
+  {
+    WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
+    WRITE_STRING(fp, name);
+    for (i = 0; i < closure->num; i++)
+    {
+      host = closure->triples[i];
+      user = host + strlen(host) + 1;
+      domain = user + strlen(user) + 1;
+      WRITE_INT32(fp, NSLCD_NETGROUP_TYPE_TRIPLE);
+      WRITE_STRING(fp, host);
+      WRITE_STRING(fp, user);
+      WRITE_STRING(fp, domain);
+    }
+    WRITE_INT32(fp, NSLCD_NETGROUP_TYPE_END);
+  }
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
+
 NSLCD_HANDLE(
   netgroup, byname, NSLCD_ACTION_NETGROUP_BYNAME,
   char name[BUFLEN_NAME];
@@ -255,3 +708,58 @@ NSLCD_HANDLE(
   (filter = netgroup_filter, 0),
   write_netgroup(fp, entry, NULL)
 )
+
+int nslcd_netgroup_expand(TFILE *fp, MYLDAP_SESSION *session)
+{
+  int32_t tmpint32;
+  char name[BUFLEN_NAME];
+  struct netgroup_closure *closure;
+  int rc;
+  /* read request parameters */
+  READ_STRING(fp, name);
+  log_setrequest("netgroup=\"%s\"", name);
+  /* write the response header */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, NSLCD_ACTION_NETGROUP_EXPAND);
+  /* get the netgroup closure and write it */
+  closure = netgroup_closure_get(session, name);
+  if (closure == NULL)
+    return -1;
+  rc = write_netgroup_closure(fp, closure, name);
+  netgroup_closure_release(closure);
+  return rc;
+}
+
+int nslcd_netgroup_innetgr(TFILE *fp, MYLDAP_SESSION *session)
+{
+  int32_t tmpint32;
+  char name[BUFLEN_NAME];
+  char host[BUFLEN_HOSTNAME];
+  char user[BUFLEN_NAME];
+  char domain[BUFLEN_HOSTNAME];
+  struct netgroup_closure *closure;
+  int found;
+  /* read request parameters */
+  READ_STRING(fp, name);
+  READ_STRING(fp, host);
+  READ_STRING(fp, user);
+  READ_STRING(fp, domain);
+  log_setrequest("innetgr=\"%s\"", name);
+  /* write the response header */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, NSLCD_ACTION_NETGROUP_INNETGR);
+  /* check the netgroup closure */
+  closure = netgroup_closure_get(session, name);
+  if (closure == NULL)
+    return -1;
+  found = closure->found &&
+          netgroup_closure_contains(closure, host, user, domain);
+  netgroup_closure_release(closure);
+  if (found)
+  {
+    WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
+    WRITE_STRING(fp, name);
+  }
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
@@ -42,6 +42,7 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <poll.h>
 #include <grp.h>
 #ifdef HAVE_NSS_H
 #include <nss.h>
@@ -78,6 +79,27 @@
 #define WRITEBUFFER_MINSIZE 1024
 #define WRITEBUFFER_MAXSIZE 1 * 1024 * 1024
 
+/* the number of seconds an idle connection is kept open and the maximum
+   number of connections that are kept open between requests */
+#define KEEPALIVE_TIMEOUT 10
+#define KEEPALIVE_MAXCONN 64
+
+/* the maximum number of connections for which the acceptor thread waits
+   until the client is ready to read the rest of the response */
+#define DRAIN_MAXCONN 64
+
+/* the upper limit of outstanding requests on a pipelined connection (the
+   limit is also kept well below the number of threads) and the maximum
+   sizes of a single pipelined request and response (a response including
+   the header always fits in the write buffer) */
+#define PIPELINE_MAXREQUESTS 64
+#define PIPELINE_MAXREQUESTSIZE 64 * 1024
+#define PIPELINE_MAXRESPONSESIZE (WRITEBUFFER_MAXSIZE - 2 * 4)
+
+/* the number of bytes of pipelined responses that are waiting for the
+   client after which no new requests are read from the connection */
+#define PIPELINE_MAXBACKLOG (WRITEBUFFER_MAXSIZE / 2)
+
 /* adjust the oom killer score */
 #define OOM_SCORE_ADJ_FILE "/proc/self/oom_score_adj"
 #define OOM_SCORE_ADJ "-1000"
@@ -100,6 +122,9 @@ static int nslcd_serversocket = -1;
 /* thread ids of all running threads */
 static pthread_t *nslcd_threads;
 
+/* thread id of the thread that accepts connections */
+static pthread_t nslcd_acceptor;
+
 /* if we don't have clearenv() we have to do this the hard way */
 #ifndef HAVE_CLEARENV
 
@@ -200,6 +225,8 @@ static void sig_handler(int signum)
 /* do some cleaning up before terminating */
 static void exithandler(void)
 {
+  /* write pending log messages and log directly from here on */
+  log_stopthread();
   /* close socket if it's still in use */
   if (nslcd_serversocket >= 0)
   {
@@ -213,6 +240,11 @@ static void exithandler(void)
     log_log(LOG_DEBUG, "unlink() of " NSLCD_SOCKET " failed (ignored): %s",
             strerror(errno));
   }
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  /* invalidate the shared cache */
+  if (nslcd_shmcache != NULL)
+    shmcache_remove(NSLCD_SHMCACHE);
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
   /* remove pidfile */
   if (unlink(NSLCD_PIDFILE) < 0)
   {
@@ -329,6 +361,401 @@ static int create_socket(const char *filename)
   return sock;
 }
 
+/* a response to a pipelined request that does not fit in the write buffer
+   of the connection yet */
+struct pipeline_response {
+  int32_t id;
+  TFILE *mfp;       /* the memory stream that holds the response */
+  const void *data;
+  size_t len;
+  struct pipeline_response *next;
+};
+
+/* information about a client connection */
+struct nslcd_conn {
+  int fd;
+  TFILE *fp;        /* the stream, set up when the first request is read */
+  uid_t uid;        /* the uid of the client */
+  int keepalive;    /* whether the connection is kept open between requests */
+  time_t lastused;  /* time the last request on the connection finished */
+  int draining;     /* whether the response is still being written */
+  int pipeline;     /* whether the connection is in pipelined mode */
+  /* the following are only used in pipelined mode, the mutex serialises
+     writing responses and protects the queued responses, the other fields
+     are protected by nslcd_connqueue_mutex */
+  pthread_mutex_t wmutex;
+  struct pipeline_response *wqueue;
+  struct pipeline_response **wqueuetail;
+  size_t wqueued;   /* the size of the queued responses */
+  int outstanding;  /* the number of requests that are being handled */
+  int parked;       /* reading stopped because of too many requests */
+  int closed;       /* the connection is closed after the last request */
+  int wblocked;     /* responses are waiting for the client to read them */
+  size_t wbacklog;  /* the size of the responses the client did not read */
+};
+
+/* the queue of connections that are waiting to be handled */
+static pthread_mutex_t nslcd_connqueue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t nslcd_connqueue_notempty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t nslcd_connqueue_notfull = PTHREAD_COND_INITIALIZER;
+static struct nslcd_conn **nslcd_connqueue = NULL;
+static int nslcd_connqueue_size = 0;
+static int nslcd_connqueue_start = 0;
+static int nslcd_connqueue_len = 0;
+
+/* the connections that are kept open and are waiting for a new request
+   or for the client to read the response (protected by
+   nslcd_connqueue_mutex) */
+static struct nslcd_conn *nslcd_idleconns[KEEPALIVE_MAXCONN + DRAIN_MAXCONN];
+static int nslcd_idleconns_num = 0;
+
+/* the number of idle connections that are draining */
+static int nslcd_draining_num = 0;
+
+/* the number of connections that have keepalive set */
+static int nslcd_keepalive_num = 0;
+
+/* pipe that is used to wake up the acceptor thread */
+static int nslcd_wakeuppipe[2] = {-1, -1};
+
+/* allocate the queue of accepted connections */
+static void connqueue_init(int size)
+{
+  int i;
+  nslcd_connqueue = (struct nslcd_conn **)malloc(size * sizeof(struct nslcd_conn *));
+  if (nslcd_connqueue == NULL)
+  {
+    log_log(LOG_CRIT, "connqueue_init(): malloc() failed to allocate memory");
+    daemonize_ready(EXIT_FAILURE, "malloc() failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  nslcd_connqueue_size = size;
+  /* set up the pipe to wake up the acceptor thread */
+  if (pipe(nslcd_wakeuppipe))
+  {
+    log_log(LOG_ERR, "pipe() failed: %s", strerror(errno));
+    daemonize_ready(EXIT_FAILURE, "pipe() failed\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < 2; i++)
+  {
+    if (fcntl(nslcd_wakeuppipe[i], F_SETFL, O_NONBLOCK) < 0)
+    {
+      log_log(LOG_ERR, "fctnl(F_SETFL,O_NONBLOCK) failed: %s", strerror(errno));
+      daemonize_ready(EXIT_FAILURE, "fctnl(F_SETFL,O_NONBLOCK) failed\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+static void connqueue_unlock(void UNUSED(*arg))
+{
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+}
+
+/* add the connection to the queue, blocks while the queue is full */
+static void connqueue_push(struct nslcd_conn *conn)
+{
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  pthread_cleanup_push(connqueue_unlock, NULL);
+  while (nslcd_connqueue_len >= nslcd_connqueue_size)
+    pthread_cond_wait(&nslcd_connqueue_notfull, &nslcd_connqueue_mutex);
+  nslcd_connqueue[(nslcd_connqueue_start + nslcd_connqueue_len) % nslcd_connqueue_size] = conn;
+  nslcd_connqueue_len++;
+  /* wake up exactly one worker */
+  pthread_cond_signal(&nslcd_connqueue_notempty);
+  pthread_cleanup_pop(1);
+}
+
+/* get a connection from the queue, this returns NULL if no connection
+   became available within the timeout (in seconds, 0 waits forever) */
+static struct nslcd_conn *connqueue_pop(int timeout)
+{
+  struct timespec ts;
+  struct nslcd_conn *conn = NULL;
+  int rc = 0;
+  ts.tv_sec = time(NULL) + timeout;
+  ts.tv_nsec = 0;
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  pthread_cleanup_push(connqueue_unlock, NULL);
+  while ((nslcd_connqueue_len == 0) && (rc != ETIMEDOUT))
+  {
+    if (timeout > 0)
+      rc = pthread_cond_timedwait(&nslcd_connqueue_notempty,
+                                  &nslcd_connqueue_mutex, &ts);
+    else
+      rc = pthread_cond_wait(&nslcd_connqueue_notempty, &nslcd_connqueue_mutex);
+  }
+  if (nslcd_connqueue_len > 0)
+  {
+    conn = nslcd_connqueue[nslcd_connqueue_start];
+    nslcd_connqueue_start = (nslcd_connqueue_start + 1) % nslcd_connqueue_size;
+    nslcd_connqueue_len--;
+    pthread_cond_signal(&nslcd_connqueue_notfull);
+  }
+  pthread_cleanup_pop(1);
+  return conn;
+}
+
+/* wake up the acceptor thread (a full pipe means that the acceptor will
+   wake up anyway) */
+static void acceptor_wakeup(void)
+{
+  if ((write(nslcd_wakeuppipe[1], "", 1) < 0) && (errno != EAGAIN))
+    log_log(LOG_WARNING, "write() to wakeup pipe failed: %s", strerror(errno));
+}
+
+/* hand the connection back to the acceptor thread to wait for the next
+   request on the connection */
+static void connidle_add(struct nslcd_conn *conn)
+{
+  conn->lastused = time(NULL);
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  nslcd_idleconns[nslcd_idleconns_num++] = conn;
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  acceptor_wakeup();
+}
+
+/* remove the connection from the list of idle connections */
+static void connidle_remove(struct nslcd_conn *conn)
+{
+  int i;
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  for (i = 0; i < nslcd_idleconns_num; i++)
+  {
+    if (nslcd_idleconns[i] == conn)
+    {
+      nslcd_idleconns[i] = nslcd_idleconns[--nslcd_idleconns_num];
+      if (conn->draining)
+        nslcd_draining_num--;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+}
+
+/* hand the connection to the acceptor thread to wait until the client is
+   ready to read more of the response, returns -1 if too many connections
+   are already waiting */
+static int conndrain_add(struct nslcd_conn *conn)
+{
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  if (nslcd_draining_num >= DRAIN_MAXCONN)
+  {
+    pthread_mutex_unlock(&nslcd_connqueue_mutex);
+    return -1;
+  }
+  nslcd_draining_num++;
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  conn->draining = 1;
+  connidle_add(conn);
+  return 0;
+}
+
+/* return the time at which the idle connection is closed, this should be
+   called with nslcd_connqueue_mutex held */
+static time_t connidle_expire(struct nslcd_conn *conn)
+{
+  if ((conn->draining) || (conn->wblocked))
+    return conn->lastused + (WRITE_TIMEOUT) / 1000;
+  /* pipelined connections are kept while requests are being handled */
+  if (conn->outstanding > 0)
+    return time(NULL) + KEEPALIVE_TIMEOUT;
+  return conn->lastused + KEEPALIVE_TIMEOUT;
+}
+
+/* whether reading new requests from the pipelined connection is held back
+   because the client does not read the responses, this should be called
+   with nslcd_connqueue_mutex held */
+static int pipeline_held(struct nslcd_conn *conn)
+{
+  return (conn->pipeline) && (conn->wbacklog > PIPELINE_MAXBACKLOG);
+}
+
+/* free the first queued pipelined response, this should be called with the
+   wmutex of the connection held */
+static void pipeline_dequeue(struct nslcd_conn *conn)
+{
+  struct pipeline_response *response = conn->wqueue;
+  conn->wqueue = response->next;
+  if (conn->wqueue == NULL)
+    conn->wqueuetail = &(conn->wqueue);
+  conn->wqueued -= 2 * sizeof(int32_t) + response->len;
+  if (response->mfp != NULL)
+    (void)tio_close(response->mfp);
+  free(response);
+}
+
+/* close the connection and free all associated resources, pipelined
+   connections are closed when the last outstanding request is done */
+static void conn_close(struct nslcd_conn *conn)
+{
+  int busy;
+  if (conn->pipeline)
+  {
+    pthread_mutex_lock(&nslcd_connqueue_mutex);
+    conn->closed = 1;
+    busy = (conn->outstanding > 0);
+    pthread_mutex_unlock(&nslcd_connqueue_mutex);
+    if (busy)
+      return;
+    while (conn->wqueue != NULL)
+      pipeline_dequeue(conn);
+    pthread_mutex_destroy(&conn->wmutex);
+  }
+  if (conn->fp != NULL)
+    (void)tio_close(conn->fp);
+  else if (close(conn->fd))
+    log_log(LOG_WARNING, "problem closing socket: %s", strerror(errno));
+  if (conn->keepalive)
+  {
+    pthread_mutex_lock(&nslcd_connqueue_mutex);
+    nslcd_keepalive_num--;
+    pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  }
+  free(conn);
+}
+
+/* close the connection without waiting for the client to read any
+   pending response */
+static void conn_abort(void *arg)
+{
+  struct nslcd_conn *conn = (struct nslcd_conn *)arg;
+  (void)shutdown(conn->fd, SHUT_RDWR);
+  conn_close(conn);
+}
+
+/* close all connections that are queued for the workers or are waiting
+   in the acceptor thread, this is called on shutdown after the acceptor
+   thread has stopped */
+static void conn_closeall(void)
+{
+  struct nslcd_conn *conn;
+  int num = 0;
+  while (1)
+  {
+    pthread_mutex_lock(&nslcd_connqueue_mutex);
+    conn = NULL;
+    if (nslcd_connqueue_len > 0)
+    {
+      conn = nslcd_connqueue[nslcd_connqueue_start];
+      nslcd_connqueue_start = (nslcd_connqueue_start + 1) % nslcd_connqueue_size;
+      nslcd_connqueue_len--;
+    }
+    else if (nslcd_idleconns_num > 0)
+    {
+      conn = nslcd_idleconns[--nslcd_idleconns_num];
+      if (conn->draining)
+        nslcd_draining_num--;
+    }
+    pthread_mutex_unlock(&nslcd_connqueue_mutex);
+    if (conn == NULL)
+      break;
+    conn_abort(conn);
+    num++;
+  }
+  log_log(LOG_DEBUG, "closed %d client connections", num);
+}
+
+/* the request on the connection was handled successfully, the rest of the
+   response is written without tying up the worker if the client is slow
+   to read it */
+static void conn_finish(struct nslcd_conn *conn)
+{
+  if (tio_wpending(conn->fp) > 0)
+  {
+    if (tio_flush_nonblock(conn->fp))
+    {
+      conn_close(conn);
+      return;
+    }
+    if ((tio_wpending(conn->fp) > 0) && (conndrain_add(conn) == 0))
+      return;
+  }
+  /* wait for the next request if the connection is kept open */
+  if ((conn->keepalive) && (tio_flush(conn->fp) == 0))
+  {
+    connidle_add(conn);
+    return;
+  }
+  conn_close(conn);
+}
+
+/* handle the request to keep the connection open */
+static int nslcd_keepalive(TFILE *fp, struct nslcd_conn *conn)
+{
+  int32_t tmpint32;
+  log_setrequest("keepalive");
+  /* see if we may keep another connection open */
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  if ((!conn->keepalive) && (nslcd_keepalive_num < KEEPALIVE_MAXCONN))
+  {
+    conn->keepalive = 1;
+    nslcd_keepalive_num++;
+  }
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  log_log(LOG_DEBUG, "nslcd_keepalive(): %s",
+          conn->keepalive ? "keeping connection open" : "too many connections");
+  /* write the response */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, NSLCD_ACTION_KEEPALIVE);
+  WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
+  WRITE_INT32(fp, conn->keepalive ? KEEPALIVE_TIMEOUT : 0);
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
+
+/* return the maximum number of outstanding requests on a pipelined
+   connection, this is kept well below the number of threads so that a
+   single client cannot tie up all workers */
+static int pipeline_maxrequests(void)
+{
+  int max = nslcd_cfg->threads / 2;
+  if (max > PIPELINE_MAXREQUESTS)
+    max = PIPELINE_MAXREQUESTS;
+  if (max < 1)
+    max = 1;
+  return max;
+}
+
+/* handle the request to switch the connection to pipelined mode */
+static int nslcd_pipeline(TFILE *fp, struct nslcd_conn *conn)
+{
+  int32_t tmpint32;
+  log_setrequest("pipeline");
+  /* pipelined connections are always kept open */
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  if ((!conn->keepalive) && (nslcd_keepalive_num < KEEPALIVE_MAXCONN))
+  {
+    conn->keepalive = 1;
+    nslcd_keepalive_num++;
+  }
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  /* the next request is read in pipelined mode */
+  if ((conn->keepalive) && (!conn->pipeline))
+  {
+    pthread_mutex_init(&conn->wmutex, NULL);
+    conn->wqueue = NULL;
+    conn->wqueuetail = &(conn->wqueue);
+    conn->wqueued = 0;
+    conn->outstanding = 0;
+    conn->parked = 0;
+    conn->closed = 0;
+    conn->wblocked = 0;
+    conn->wbacklog = 0;
+    conn->pipeline = 1;
+  }
+  log_log(LOG_DEBUG, "nslcd_pipeline(): %s",
+          conn->pipeline ? "pipelining requests" : "too many connections");
+  /* write the response */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, NSLCD_ACTION_PIPELINE);
+  WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
+  WRITE_INT32(fp, conn->pipeline ? pipeline_maxrequests() : 0);
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
+
 /* read the version information and action from the stream
    this function returns the read action in location pointer to by action */
 static int read_header(TFILE *fp, int32_t *action)
@@ -347,104 +774,361 @@ static int read_header(TFILE *fp, int32_t *action)
   return 0;
 }
 
-/* read a request message, returns <0 in case of errors,
-   this function closes the socket */
-static void handleconnection(int sock, MYLDAP_SESSION *session)
+/* handle the request with the specified action, the request parameters are
+   read from and the response is written to the stream */
+static int handlerequest(TFILE *fp, int32_t action, struct nslcd_conn *conn,
+                         MYLDAP_SESSION *session, uid_t uid)
+{
+  int rc = -1;
+  struct timespec start;
+  stats_request_start(&start);
+  switch (action)
+  {
+    case NSLCD_ACTION_KEEPALIVE:        rc = nslcd_keepalive(fp, conn); break;
+    case NSLCD_ACTION_PIPELINE:         rc = nslcd_pipeline(fp, conn); break;
+    case NSLCD_ACTION_STATS:            rc = nslcd_stats(fp, session); break;
+    case NSLCD_ACTION_CONFIG_GET:       rc = nslcd_config_get(fp, session); break;
+    case NSLCD_ACTION_ALIAS_BYNAME:     rc = nslcd_alias_byname(fp, session); break;
+    case NSLCD_ACTION_ALIAS_ALL:        rc = nslcd_alias_all(fp, session); break;
+    case NSLCD_ACTION_ETHER_BYNAME:     rc = nslcd_ether_byname(fp, session); break;
+    case NSLCD_ACTION_ETHER_BYETHER:    rc = nslcd_ether_byether(fp, session); break;
+    case NSLCD_ACTION_ETHER_ALL:        rc = nslcd_ether_all(fp, session); break;
+    case NSLCD_ACTION_GROUP_BYNAME:     rc = nslcd_group_byname(fp, session); break;
+    case NSLCD_ACTION_GROUP_BYGID:      rc = nslcd_group_bygid(fp, session); break;
+    case NSLCD_ACTION_GROUP_BYNAMES:    rc = nslcd_group_bynames(fp, session); break;
+    case NSLCD_ACTION_GROUP_BYGIDS:     rc = nslcd_group_bygids(fp, session); break;
+    case NSLCD_ACTION_GROUP_BYMEMBER:   rc = nslcd_group_bymember(fp, session); break;
+    case NSLCD_ACTION_GROUP_ALL:
+      if (!nslcd_cfg->nss_disable_enumeration) rc = nslcd_group_all(fp, session);
+      break;
+    case NSLCD_ACTION_HOST_BYNAME:      rc = nslcd_host_byname(fp, session); break;
+    case NSLCD_ACTION_HOST_BYADDR:      rc = nslcd_host_byaddr(fp, session); break;
+    case NSLCD_ACTION_HOST_ALL:         rc = nslcd_host_all(fp, session); break;
+    case NSLCD_ACTION_NETGROUP_BYNAME:  rc = nslcd_netgroup_byname(fp, session); break;
+    case NSLCD_ACTION_NETGROUP_EXPAND:  rc = nslcd_netgroup_expand(fp, session); break;
+    case NSLCD_ACTION_NETGROUP_INNETGR: rc = nslcd_netgroup_innetgr(fp, session); break;
+    case NSLCD_ACTION_NETGROUP_ALL:     rc = nslcd_netgroup_all(fp, session); break;
+    case NSLCD_ACTION_NETWORK_BYNAME:   rc = nslcd_network_byname(fp, session); break;
+    case NSLCD_ACTION_NETWORK_BYADDR:   rc = nslcd_network_byaddr(fp, session); break;
+    case NSLCD_ACTION_NETWORK_ALL:      rc = nslcd_network_all(fp, session); break;
+    case NSLCD_ACTION_PASSWD_BYNAME:    rc = nslcd_passwd_byname(fp, session, uid); break;
+    case NSLCD_ACTION_PASSWD_BYUID:     rc = nslcd_passwd_byuid(fp, session, uid); break;
+    case NSLCD_ACTION_PASSWD_BYNAMES:   rc = nslcd_passwd_bynames(fp, session, uid); break;
+    case NSLCD_ACTION_PASSWD_BYUIDS:    rc = nslcd_passwd_byuids(fp, session, uid); break;
+    case NSLCD_ACTION_PASSWD_ALL:
+      if (!nslcd_cfg->nss_disable_enumeration) rc = nslcd_passwd_all(fp, session, uid);
+      break;
+    case NSLCD_ACTION_PROTOCOL_BYNAME:  rc = nslcd_protocol_byname(fp, session); break;
+    case NSLCD_ACTION_PROTOCOL_BYNUMBER:rc = nslcd_protocol_bynumber(fp, session); break;
+    case NSLCD_ACTION_PROTOCOL_ALL:     rc = nslcd_protocol_all(fp, session); break;
+    case NSLCD_ACTION_RPC_BYNAME:       rc = nslcd_rpc_byname(fp, session); break;
+    case NSLCD_ACTION_RPC_BYNUMBER:     rc = nslcd_rpc_bynumber(fp, session); break;
+    case NSLCD_ACTION_RPC_ALL:          rc = nslcd_rpc_all(fp, session); break;
+    case NSLCD_ACTION_SERVICE_BYNAME:   rc = nslcd_service_byname(fp, session); break;
+    case NSLCD_ACTION_SERVICE_BYNUMBER: rc = nslcd_service_bynumber(fp, session); break;
+    case NSLCD_ACTION_SERVICE_ALL:      rc = nslcd_service_all(fp, session); break;
+    case NSLCD_ACTION_SHADOW_BYNAME:    rc = nslcd_shadow_byname(fp, session, uid); break;
+    case NSLCD_ACTION_SHADOW_ALL:
+      if (!nslcd_cfg->nss_disable_enumeration) rc = nslcd_shadow_all(fp, session, uid);
+      break;
+    case NSLCD_ACTION_PAM_AUTHC:        rc = nslcd_pam_authc(fp, session, uid); break;
+    case NSLCD_ACTION_PAM_AUTHZ:        rc = nslcd_pam_authz(fp, session); break;
+    case NSLCD_ACTION_PAM_SESS_O:       rc = nslcd_pam_sess_o(fp, session); break;
+    case NSLCD_ACTION_PAM_SESS_C:       rc = nslcd_pam_sess_c(fp, session); break;
+    case NSLCD_ACTION_PAM_PWMOD:        rc = nslcd_pam_pwmod(fp, session, uid); break;
+    case NSLCD_ACTION_USERMOD:          rc = nslcd_usermod(fp, session, uid); break;
+    default:
+      log_log(LOG_WARNING, "invalid request id: 0x%08x", (unsigned int)action);
+      break;
+  }
+  /* release requests for the same key that are waiting for this one */
+  cache_done(fp);
+  stats_request_done(action, rc, &start);
+  return rc;
+}
+
+/* write the response to a pipelined request, this does not wait for the
+   client: the part of the response that cannot be written yet is left in
+   the write buffer for the acceptor thread (the caller ensures that the
+   response fits in the buffer) */
+static int write_pipelined(TFILE *fp, int32_t id, const void *data, size_t len)
+{
+  int32_t tmpint32;
+  WRITE_INT32(fp, id);
+  WRITE_INT32(fp, (int32_t)len);
+  WRITE(fp, data, len);
+  if (tio_flush_nonblock(fp) < 0)
+  {
+    ERROR_OUT_WRITEERROR(fp);
+  }
+  return 0;
+}
+
+/* move the queued pipelined responses to the write buffer as long as they
+   fit, this should be called with the wmutex of the connection held */
+static int pipeline_writequeued(struct nslcd_conn *conn)
+{
+  struct pipeline_response *response;
+  while ((response = conn->wqueue) != NULL)
+  {
+    if ((tio_wpending(conn->fp) + 2 * sizeof(int32_t) + response->len) > WRITEBUFFER_MAXSIZE)
+    {
+      /* see if the client read some of the buffer in the meantime */
+      if (tio_flush_nonblock(conn->fp) < 0)
+        return -1;
+      if ((tio_wpending(conn->fp) + 2 * sizeof(int32_t) + response->len) > WRITEBUFFER_MAXSIZE)
+        return 0;
+    }
+    if (write_pipelined(conn->fp, response->id, response->data, response->len))
+      return -1;
+    pipeline_dequeue(conn);
+  }
+  return 0;
+}
+
+/* update the state of the connection after writing pipelined responses,
+   this returns whether the acceptor thread should start waiting for the
+   client and should be called with the wmutex of the connection held */
+static int pipeline_writestate(struct nslcd_conn *conn, int rc)
+{
+  int wakeup;
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  wakeup = (rc == 0) && (!conn->wblocked);
+  conn->wblocked = (rc == 0) &&
+                   ((tio_wpending(conn->fp) > 0) || (conn->wqueue != NULL));
+  wakeup = wakeup && conn->wblocked;
+  conn->wbacklog = (rc == 0) ? tio_wpending(conn->fp) + conn->wqueued : 0;
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  return wakeup;
+}
+
+/* write the response to a pipelined request (the response is in the memory
+   stream, which is closed when it has been written) and let the acceptor
+   thread wait for the client if not everything could be written, on errors
+   the connection is shut down so the reading worker closes it */
+static void pipeline_write(struct nslcd_conn *conn, int32_t id, TFILE *mfp,
+                           const void *data, size_t len)
+{
+  struct pipeline_response *response;
+  int rc, wakeup;
+  response = (struct pipeline_response *)malloc(sizeof(struct pipeline_response));
+  if (response == NULL)
+  {
+    log_log(LOG_CRIT, "pipeline_write(): malloc() failed to allocate memory");
+    (void)tio_close(mfp);
+    (void)shutdown(conn->fd, SHUT_RDWR);
+    return;
+  }
+  response->id = id;
+  response->mfp = mfp;
+  response->data = data;
+  response->len = len;
+  response->next = NULL;
+  /* queue the response behind any responses that do not fit yet */
+  pthread_mutex_lock(&conn->wmutex);
+  *(conn->wqueuetail) = response;
+  conn->wqueuetail = &(response->next);
+  conn->wqueued += 2 * sizeof(int32_t) + len;
+  rc = pipeline_writequeued(conn);
+  wakeup = pipeline_writestate(conn, rc);
+  pthread_mutex_unlock(&conn->wmutex);
+  if (rc)
+    (void)shutdown(conn->fd, SHUT_RDWR);
+  else if (wakeup)
+    acceptor_wakeup();
+}
+
+/* write more of the pipelined responses now that the client is ready to
+   read them, this is called from the acceptor thread */
+static void pipeline_flush(struct nslcd_conn *conn)
+{
+  int rc;
+  pthread_mutex_lock(&conn->wmutex);
+  rc = tio_flush_nonblock(conn->fp);
+  if (rc == 0)
+    rc = pipeline_writequeued(conn);
+  (void)pipeline_writestate(conn, rc);
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  conn->lastused = time(NULL);
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  pthread_mutex_unlock(&conn->wmutex);
+  if (rc)
+  {
+    log_log(LOG_DEBUG, "error writing to client: %s", strerror(errno));
+    (void)shutdown(conn->fd, SHUT_RDWR);
+  }
+}
+
+/* read a request on a pipelined connection into a memory stream */
+static int read_pipelined(TFILE *fp, int32_t *id, TFILE **mfp)
+{
+  int32_t tmpint32;
+  int32_t len;
+  uint8_t *buf;
+  READ_INT32(fp, *id);
+  READ_INT32(fp, len);
+  if ((len < (int32_t)(2 * sizeof(int32_t))) || (len > PIPELINE_MAXREQUESTSIZE))
+  {
+    log_log(LOG_WARNING, "invalid pipelined request size: %d", (int)len);
+    return -1;
+  }
+  buf = (uint8_t *)malloc(len);
+  if (buf == NULL)
+  {
+    log_log(LOG_CRIT, "read_pipelined(): malloc() failed to allocate memory");
+    return -1;
+  }
+  if (tio_read(fp, buf, len))
+  {
+    log_log(LOG_WARNING, "error reading from client: %s", strerror(errno));
+    free(buf);
+    return -1;
+  }
+  *mfp = tio_memopen(buf, len, PIPELINE_MAXRESPONSESIZE);
+  free(buf);
+  if (*mfp == NULL)
+  {
+    log_log(LOG_CRIT, "read_pipelined(): malloc() failed to allocate memory");
+    return -1;
+  }
+  return 0;
+}
+
+/* the pipelined request is done, hand the connection back for reading if
+   reading was stopped and close it if it is no longer used */
+static void pipeline_done(struct nslcd_conn *conn)
+{
+  int resume, doclose;
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  conn->outstanding--;
+  conn->lastused = time(NULL);
+  resume = conn->parked;
+  conn->parked = 0;
+  doclose = (conn->closed) && (conn->outstanding == 0);
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  if (resume)
+    connidle_add(conn);
+  else if (doclose)
+    conn_close(conn);
+}
+
+/* read a single request on a pipelined connection and handle it, the
+   connection is handed back to the acceptor thread before the request is
+   handled so that further requests can be handled by other workers */
+static void handlepipelined(struct nslcd_conn *conn, MYLDAP_SESSION *session)
+{
+  TFILE *mfp;
+  int32_t id, action;
+  const void *data;
+  size_t len = 0;
+  int parked, rc = -1;
+  /* read the request */
+  if (read_pipelined(conn->fp, &id, &mfp))
+  {
+    conn_close(conn);
+    return;
+  }
+  /* wait for the next request unless too many requests are outstanding */
+  pthread_mutex_lock(&nslcd_connqueue_mutex);
+  conn->outstanding++;
+  parked = conn->parked = (conn->outstanding >= pipeline_maxrequests());
+  pthread_mutex_unlock(&nslcd_connqueue_mutex);
+  if (!parked)
+    connidle_add(conn);
+  /* handle the request */
+  if (read_header(mfp, &action) == 0)
+    rc = handlerequest(mfp, action, conn, session, conn->uid);
+  myldap_session_cleanup(session);
+  if (rc == 0)
+    data = tio_memdata(mfp, &len);
+  else
+    data = NULL;
+  /* write the response (this takes care of closing the stream) */
+  pipeline_write(conn, id, mfp, data, len);
+  pipeline_done(conn);
+}
+
+/* read and handle a request on the connection, the connection is either
+   handed back to the acceptor thread to wait for the next request or
+   closed */
+static void handleconnection(struct nslcd_conn *conn, MYLDAP_SESSION *session)
 {
   TFILE *fp;
   int32_t action;
+  int rc;
   pid_t pid = (pid_t)-1;
   uid_t uid = (uid_t)-1;
   gid_t gid = (gid_t)-1;
   char peerinfo[80];
-  /* log connection */
-  if (getpeercred(sock, &uid, &gid, &pid))
-    log_log(LOG_DEBUG, "connection from unknown client: %s", strerror(errno));
-  else
+  char c;
+  if (conn->draining)
   {
-    peerinfo[0] = '\0';
-    if (pid != (pid_t)-1)
-      mysnprintf(peerinfo + strlen(peerinfo), sizeof(peerinfo) - strlen(peerinfo) - 1,
-                 " pid=%lu", (unsigned long int)pid);
-    if (uid != (uid_t)-1)
-      mysnprintf(peerinfo + strlen(peerinfo), sizeof(peerinfo) - strlen(peerinfo) - 1,
-                 " uid=%lu", (unsigned long int)uid);
-    if (gid != (gid_t)-1)
-      mysnprintf(peerinfo + strlen(peerinfo), sizeof(peerinfo) - strlen(peerinfo) - 1,
-                 " gid=%lu", (unsigned long int)gid);
-    log_log(LOG_DEBUG, "connection from %s", (peerinfo[0] == '\0') ? "unknown" : peerinfo);
-  }
-  /* create a stream object */
-  if ((fp = tio_fdopen(sock, READ_TIMEOUT, WRITE_TIMEOUT,
-                       READBUFFER_MINSIZE, READBUFFER_MAXSIZE,
-                       WRITEBUFFER_MINSIZE, WRITEBUFFER_MAXSIZE)) == NULL)
-  {
-    log_log(LOG_WARNING, "cannot create stream for writing: %s",
-            strerror(errno));
-    (void)close(sock);
+    /* the client is ready to read more of the previous response */
+    conn->draining = 0;
+    if (tio_flush_nonblock(conn->fp))
+      conn_close(conn);
+    else
+      conn_finish(conn);
     return;
   }
-  /* read request */
-  if (read_header(fp, &action))
+  if (conn->fp == NULL)
+  {
+    /* log connection */
+    if (getpeercred(conn->fd, &uid, &gid, &pid))
+      log_log(LOG_DEBUG, "connection from unknown client: %s", strerror(errno));
+    else
+    {
+      peerinfo[0] = '\0';
+      if (pid != (pid_t)-1)
+        mysnprintf(peerinfo + strlen(peerinfo), sizeof(peerinfo) - strlen(peerinfo) - 1,
+                   " pid=%lu", (unsigned long int)pid);
+      if (uid != (uid_t)-1)
+        mysnprintf(peerinfo + strlen(peerinfo), sizeof(peerinfo) - strlen(peerinfo) - 1,
+                   " uid=%lu", (unsigned long int)uid);
+      if (gid != (gid_t)-1)
+        mysnprintf(peerinfo + strlen(peerinfo), sizeof(peerinfo) - strlen(peerinfo) - 1,
+                   " gid=%lu", (unsigned long int)gid);
+      log_log(LOG_DEBUG, "connection from %s", (peerinfo[0] == '\0') ? "unknown" : peerinfo);
+    }
+    conn->uid = uid;
+    /* create a stream object */
+    if ((conn->fp = tio_fdopen(conn->fd, READ_TIMEOUT, WRITE_TIMEOUT,
+                               READBUFFER_MINSIZE, READBUFFER_MAXSIZE,
+                               WRITEBUFFER_MINSIZE, WRITEBUFFER_MAXSIZE)) == NULL)
+    {
+      log_log(LOG_WARNING, "cannot create stream for writing: %s",
+              strerror(errno));
+      conn_close(conn);
+      return;
+    }
+  }
+  else if ((tio_rpending(conn->fp) == 0) &&
+           (recv(conn->fd, &c, 1, MSG_PEEK) == 0))
   {
-    (void)tio_close(fp);
+    /* the client closed the connection that was kept open */
+    conn_close(conn);
     return;
   }
-  /* handle request */
-  switch (action)
+  if (conn->pipeline)
   {
-    case NSLCD_ACTION_CONFIG_GET:       (void)nslcd_config_get(fp, session); break;
-    case NSLCD_ACTION_ALIAS_BYNAME:     (void)nslcd_alias_byname(fp, session); break;
-    case NSLCD_ACTION_ALIAS_ALL:        (void)nslcd_alias_all(fp, session); break;
-    case NSLCD_ACTION_ETHER_BYNAME:     (void)nslcd_ether_byname(fp, session); break;
-    case NSLCD_ACTION_ETHER_BYETHER:    (void)nslcd_ether_byether(fp, session); break;
-    case NSLCD_ACTION_ETHER_ALL:        (void)nslcd_ether_all(fp, session); break;
-    case NSLCD_ACTION_GROUP_BYNAME:     (void)nslcd_group_byname(fp, session); break;
-    case NSLCD_ACTION_GROUP_BYGID:      (void)nslcd_group_bygid(fp, session); break;
-    case NSLCD_ACTION_GROUP_BYMEMBER:   (void)nslcd_group_bymember(fp, session); break;
-    case NSLCD_ACTION_GROUP_ALL:
-      if (!nslcd_cfg->nss_disable_enumeration) (void)nslcd_group_all(fp, session);
-      break;
-    case NSLCD_ACTION_HOST_BYNAME:      (void)nslcd_host_byname(fp, session); break;
-    case NSLCD_ACTION_HOST_BYADDR:      (void)nslcd_host_byaddr(fp, session); break;
-    case NSLCD_ACTION_HOST_ALL:         (void)nslcd_host_all(fp, session); break;
-    case NSLCD_ACTION_NETGROUP_BYNAME:  (void)nslcd_netgroup_byname(fp, session); break;
-    case NSLCD_ACTION_NETGROUP_ALL:     (void)nslcd_netgroup_all(fp, session); break;
-    case NSLCD_ACTION_NETWORK_BYNAME:   (void)nslcd_network_byname(fp, session); break;
-    case NSLCD_ACTION_NETWORK_BYADDR:   (void)nslcd_network_byaddr(fp, session); break;
-    case NSLCD_ACTION_NETWORK_ALL:      (void)nslcd_network_all(fp, session); break;
-    case NSLCD_ACTION_PASSWD_BYNAME:    (void)nslcd_passwd_byname(fp, session, uid); break;
-    case NSLCD_ACTION_PASSWD_BYUID:     (void)nslcd_passwd_byuid(fp, session, uid); break;
-    case NSLCD_ACTION_PASSWD_ALL:
-      if (!nslcd_cfg->nss_disable_enumeration) (void)nslcd_passwd_all(fp, session, uid);
-      break;
-    case NSLCD_ACTION_PROTOCOL_BYNAME:  (void)nslcd_protocol_byname(fp, session); break;
-    case NSLCD_ACTION_PROTOCOL_BYNUMBER:(void)nslcd_protocol_bynumber(fp, session); break;
-    case NSLCD_ACTION_PROTOCOL_ALL:     (void)nslcd_protocol_all(fp, session); break;
-    case NSLCD_ACTION_RPC_BYNAME:       (void)nslcd_rpc_byname(fp, session); break;
-    case NSLCD_ACTION_RPC_BYNUMBER:     (void)nslcd_rpc_bynumber(fp, session); break;
-    case NSLCD_ACTION_RPC_ALL:          (void)nslcd_rpc_all(fp, session); break;
-    case NSLCD_ACTION_SERVICE_BYNAME:   (void)nslcd_service_byname(fp, session); break;
-    case NSLCD_ACTION_SERVICE_BYNUMBER: (void)nslcd_service_bynumber(fp, session); break;
-    case NSLCD_ACTION_SERVICE_ALL:      (void)nslcd_service_all(fp, session); break;
-    case NSLCD_ACTION_SHADOW_BYNAME:    (void)nslcd_shadow_byname(fp, session, uid); break;
-    case NSLCD_ACTION_SHADOW_ALL:
-      if (!nslcd_cfg->nss_disable_enumeration) (void)nslcd_shadow_all(fp, session, uid);
-      break;
-    case NSLCD_ACTION_PAM_AUTHC:        (void)nslcd_pam_authc(fp, session, uid); break;
-    case NSLCD_ACTION_PAM_AUTHZ:        (void)nslcd_pam_authz(fp, session); break;
-    case NSLCD_ACTION_PAM_SESS_O:       (void)nslcd_pam_sess_o(fp, session); break;
-    case NSLCD_ACTION_PAM_SESS_C:       (void)nslcd_pam_sess_c(fp, session); break;
-    case NSLCD_ACTION_PAM_PWMOD:        (void)nslcd_pam_pwmod(fp, session, uid); break;
-    case NSLCD_ACTION_USERMOD:          (void)nslcd_usermod(fp, session, uid); break;
-    default:
-      log_log(LOG_WARNING, "invalid request id: 0x%08x", (unsigned int)action);
-      break;
+    handlepipelined(conn, session);
+    return;
   }
+  fp = conn->fp;
+  uid = conn->uid;
+  /* read request */
+  if (read_header(fp, &action))
+  {
+    conn_close(conn);
+    return;
+  }
+  rc = handlerequest(fp, action, conn, session, uid);
   /* we're done with the request */
   myldap_session_cleanup(session);
-  (void)tio_close(fp);
-  return;
+  if (rc == 0)
+    conn_finish(conn);
+  else
+    conn_close(conn);
 }
 
 /* test to see if we can lock the specified file */
@@ -526,52 +1210,136 @@ static void install_sighandler(int signum, void (*handler) (int))
   }
 }
 
-static void worker_cleanup(void *arg)
+/* pass the connection to the workers, if the acceptor thread is cancelled
+   while waiting for room in the queue the connection is closed */
+static void acceptor_push(struct nslcd_conn *conn)
 {
-  MYLDAP_SESSION *session = (MYLDAP_SESSION *)arg;
-  myldap_session_close(session);
+  pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+  pthread_cleanup_push(conn_abort, conn);
+  connqueue_push(conn);
+  pthread_cleanup_pop(0);
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 }
 
-static void *worker(void UNUSED(*arg))
+/* the acceptor thread is the only one waiting on the server socket, it
+   hands off the accepted connections to the worker threads through the
+   connection queue (this avoids waking up all workers on every incoming
+   connection), it also waits for new requests on connections that are
+   kept open */
+static void *acceptor(void UNUSED(*arg))
 {
-  MYLDAP_SESSION *session;
   int csock;
-  int j;
+  int i, j;
+  int num;
+  int timeout;
+  int expired, writing, held;
+  time_t now;
   struct sockaddr_storage addr;
   socklen_t alen;
-  fd_set fds;
-  struct timeval tv;
-  /* create a new LDAP session */
-  session = myldap_create_session();
-  /* clean up the session if we're done */
-  pthread_cleanup_push(worker_cleanup, session);
-  /* start waiting for incoming connections */
+  struct pollfd fds[2 + KEEPALIVE_MAXCONN + DRAIN_MAXCONN];
+  struct nslcd_conn *conns[KEEPALIVE_MAXCONN + DRAIN_MAXCONN];
+  struct nslcd_conn *conn;
+  char buf[32];
+  /* the thread is only cancelled while waiting so that the connections
+     are always either handed off or in the list of idle connections */
+  pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
   while (1)
   {
-    /* time out connection to LDAP server if needed */
-    myldap_session_check(session);
-    /* set up the set of fds to wait on */
-    FD_ZERO(&fds);
-    FD_SET(nslcd_serversocket, &fds);
-    /* set up our timeout value */
-    tv.tv_sec = nslcd_cfg->idle_timelimit;
-    tv.tv_usec = 0;
-    /* wait for a new connection */
-    j = select(nslcd_serversocket + 1, &fds, NULL, NULL,
-               nslcd_cfg->idle_timelimit > 0 ? &tv : NULL);
-    /* check result of select() */
+    /* set up the file descriptors to wait on */
+    fds[0].fd = nslcd_serversocket;
+    fds[0].events = POLLIN;
+    fds[1].fd = nslcd_wakeuppipe[0];
+    fds[1].events = POLLIN;
+    /* wait for requests or for clients to be ready to read the response
+       on the idle connections until they expire */
+    timeout = -1;
+    now = time(NULL);
+    pthread_mutex_lock(&nslcd_connqueue_mutex);
+    num = nslcd_idleconns_num;
+    for (i = 0; i < num; i++)
+    {
+      conns[i] = nslcd_idleconns[i];
+      fds[2 + i].fd = conns[i]->fd;
+      /* pipelined connections may also wait for the client to read and
+         new requests are not read while too many responses are waiting */
+      held = pipeline_held(conns[i]);
+      if ((conns[i]->draining) || (held))
+        fds[2 + i].events = POLLOUT;
+      else if (conns[i]->wblocked)
+        fds[2 + i].events = POLLIN | POLLOUT;
+      else
+        fds[2 + i].events = POLLIN;
+      j = (int)(connidle_expire(conns[i]) - now);
+      /* pipelined requests may already have been read into the buffer */
+      if ((j < 0) ||
+          (conns[i]->pipeline && (!held) && (tio_rpending(conns[i]->fp) > 0)))
+        j = 0;
+      if ((timeout < 0) || (j * 1000 < timeout))
+        timeout = j * 1000;
+    }
+    pthread_mutex_unlock(&nslcd_connqueue_mutex);
+    /* wait for a new connection or request */
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    j = poll(fds, 2 + num, timeout);
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    /* check result of poll() */
     if (j < 0)
     {
       if (errno == EINTR)
-        log_log(LOG_DEBUG, "select() failed (ignored): %s", strerror(errno));
+        log_log(LOG_DEBUG, "poll() failed (ignored): %s", strerror(errno));
       else
-        log_log(LOG_ERR, "select() failed: %s", strerror(errno));
+        log_log(LOG_ERR, "poll() failed: %s", strerror(errno));
       continue;
     }
+    /* empty the wakeup pipe */
+    if (fds[1].revents & POLLIN)
+    {
+      while (read(nslcd_wakeuppipe[0], buf, sizeof(buf)) > 0)
+        /* nothing */ ;
+    }
+    /* pass connections with a new request or that are ready to write more
+       of the response to the workers and close connections that have been
+       idle too long */
+    now = time(NULL);
+    for (i = 0; i < num; i++)
+    {
+      /* write more of the pipelined responses */
+      if ((!conns[i]->draining) && (fds[2 + i].revents & POLLOUT))
+      {
+        pipeline_flush(conns[i]);
+        fds[2 + i].revents &= ~POLLOUT;
+      }
+      pthread_mutex_lock(&nslcd_connqueue_mutex);
+      held = pipeline_held(conns[i]);
+      pthread_mutex_unlock(&nslcd_connqueue_mutex);
+      if ((fds[2 + i].revents != 0) ||
+          (conns[i]->pipeline && (!held) && (tio_rpending(conns[i]->fp) > 0)))
+      {
+        connidle_remove(conns[i]);
+        acceptor_push(conns[i]);
+        continue;
+      }
+      /* workers may update pipelined connections while they are idle */
+      pthread_mutex_lock(&nslcd_connqueue_mutex);
+      expired = (connidle_expire(conns[i]) <= now);
+      writing = (conns[i]->draining) || (conns[i]->wblocked);
+      pthread_mutex_unlock(&nslcd_connqueue_mutex);
+      if (expired)
+      {
+        connidle_remove(conns[i]);
+        if (writing)
+        {
+          log_log(LOG_DEBUG, "client did not read response, closing connection");
+          /* ensure that closing the stream does not wait for the client */
+          (void)shutdown(conns[i]->fd, SHUT_RDWR);
+        }
+        conn_close(conns[i]);
+      }
+    }
     /* see if our file descriptor is actually ready */
-    if (!FD_ISSET(nslcd_serversocket, &fds))
+    if ((fds[0].revents & POLLIN) == 0)
       continue;
-    /* wait for a new connection */
+    /* accept the new connection */
     alen = (socklen_t)sizeof(struct sockaddr_storage);
     csock = accept(nslcd_serversocket, (struct sockaddr *)&addr, &alen);
     if (csock < 0)
@@ -597,10 +1365,58 @@ static void *worker(void UNUSED(*arg))
         log_log(LOG_WARNING, "problem closing socket: %s", strerror(errno));
       continue;
     }
+    /* pass the connection to a worker */
+    conn = (struct nslcd_conn *)malloc(sizeof(struct nslcd_conn));
+    if (conn == NULL)
+    {
+      log_log(LOG_CRIT, "acceptor(): malloc() failed to allocate memory");
+      exit(EXIT_FAILURE);
+    }
+    conn->fd = csock;
+    conn->fp = NULL;
+    conn->uid = (uid_t)-1;
+    conn->keepalive = 0;
+    conn->lastused = 0;
+    conn->draining = 0;
+    conn->pipeline = 0;
+    conn->outstanding = 0;
+    conn->parked = 0;
+    conn->closed = 0;
+    conn->wblocked = 0;
+    acceptor_push(conn);
+  }
+  return NULL;
+}
+
+static void worker_cleanup(void *arg)
+{
+  MYLDAP_SESSION *session = (MYLDAP_SESSION *)arg;
+  myldap_session_close(session);
+}
+
+static void *worker(void UNUSED(*arg))
+{
+  MYLDAP_SESSION *session;
+  struct nslcd_conn *conn;
+  /* create a new LDAP session */
+  session = myldap_create_session();
+  /* clean up the session if we're done */
+  pthread_cleanup_push(worker_cleanup, session);
+  /* start waiting for incoming connections */
+  while (1)
+  {
+    /* time out connection to LDAP server if needed and reopen it while
+       there is nothing else to do */
+    myldap_session_check(session);
+    myldap_session_refresh(session);
+    /* wait for a new connection */
+    conn = connqueue_pop(nslcd_cfg->idle_timelimit);
+    if (conn == NULL)
+      continue;
     /* indicate new connection to logging module (generates unique id) */
     log_newsession();
     /* handle the connection */
-    handleconnection(csock, session);
+    handleconnection(conn, session);
     /* indicate end of session in log messages */
     log_clearsession();
   }
@@ -685,6 +1501,7 @@ int main(int argc, char *argv[])
 {
   int i;
   sigset_t signalmask, oldmask;
+  unsigned long hits, misses, evictions;
 #ifdef HAVE_PTHREAD_TIMEDJOIN_NP
   struct timespec ts;
 #endif /* HAVE_PTHREAD_TIMEDJOIN_NP */
@@ -837,8 +1654,23 @@ int main(int argc, char *argv[])
   }
   /* create socket */
   nslcd_serversocket = create_socket(NSLCD_SOCKET);
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  /* create the shared cache (or remove an old one) */
+  if (nslcd_cfg->cache_shared > 0)
+  {
+    nslcd_shmcache = shmcache_create(NSLCD_SHMCACHE, SHMCACHE_NUMSLOTS);
+    if (nslcd_shmcache == NULL)
+      log_log(LOG_WARNING, "unable to create shared cache %s (ignored): %s",
+              NSLCD_SHMCACHE, strerror(errno));
+  }
+  else
+    shmcache_remove(NSLCD_SHMCACHE);
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
   /* start worker threads */
+  stats_init();
+  log_startthread();
   log_log(LOG_INFO, "accepting connections");
+  connqueue_init(nslcd_cfg->threads);
   nslcd_threads = (pthread_t *)malloc(nslcd_cfg->threads * sizeof(pthread_t));
   if (nslcd_threads == NULL)
   {
@@ -856,6 +1688,13 @@ int main(int argc, char *argv[])
       exit(EXIT_FAILURE);
     }
   }
+  /* start the thread that accepts connections */
+  if (pthread_create(&nslcd_acceptor, NULL, acceptor, NULL))
+  {
+    log_log(LOG_ERR, "unable to start acceptor thread: %s", strerror(errno));
+    daemonize_ready(EXIT_FAILURE, "unable to start acceptor thread\n");
+    exit(EXIT_FAILURE);
+  }
   /* install signal handlers for some signals */
   install_sighandler(SIGHUP, sig_handler);
   install_sighandler(SIGINT, sig_handler);
@@ -878,12 +1717,24 @@ int main(int argc, char *argv[])
       log_log(LOG_INFO, "caught signal %s (%d), refresh retries",
               signame(nslcd_receivedsignal), nslcd_receivedsignal);
       myldap_immediate_reconnect();
+      dn2uid_cache_stats(&hits, &misses, &evictions);
+      log_log(LOG_INFO, "dn2uid cache: %lu hits, %lu misses, %lu evictions",
+              hits, misses, evictions);
       nslcd_receivedsignal = 0;
     }
   }
   /* print something about received signal */
   log_log(LOG_INFO, "caught signal %s (%d), shutting down",
           signame(nslcd_receivedsignal), nslcd_receivedsignal);
+  /* stop the acceptor thread and close the connections it was handling */
+  if (pthread_cancel(nslcd_acceptor))
+    log_log(LOG_WARNING, "failed to stop acceptor thread (ignored): %s",
+            strerror(errno));
+  else if ((i = pthread_join(nslcd_acceptor, NULL)) != 0)
+    log_log(LOG_WARNING, "failed to wait for acceptor thread (ignored): %s",
+            strerror(i));
+  else
+    conn_closeall();
   /* cancel all running threads */
   for (i = 0; i < nslcd_cfg->threads; i++)
     if (pthread_cancel(nslcd_threads[i]))
@@ -182,8 +182,8 @@ static int try_bind(const char *userdn, const char *password,
   DICT *dict;
   char filter[BUFLEN_FILTER];
   const char *res;
-  /* set up a new connection */
-  session = myldap_create_session();
+  /* set up a new connection (or get one from the pool) */
+  session = myldap_create_bind_session();
   if (session == NULL)
     return LDAP_UNAVAILABLE;
   /* perform a BIND operation with user credentials */
@@ -213,7 +213,7 @@ static int try_bind(const char *userdn, const char *password,
       dict = search_vars_new(userdn, username, service, ruser, rhost, tty);
       if (dict == NULL)
       {
-        myldap_session_close(session);
+        myldap_bind_session_close(session);
         return LDAP_LOCAL_ERROR;
       }
       res = expr_parse(nslcd_cfg->pam_authc_search, filter, sizeof(filter),
@@ -221,7 +221,7 @@ static int try_bind(const char *userdn, const char *password,
       if (res == NULL)
       {
         search_vars_free(dict);
-        myldap_session_close(session);
+        myldap_bind_session_close(session);
         log_log(LOG_ERR, "invalid pam_authc_search \"%s\"",
                 nslcd_cfg->pam_authc_search);
         return LDAP_LOCAL_ERROR;
@@ -241,7 +241,7 @@ static int try_bind(const char *userdn, const char *password,
     log_log(LOG_WARNING, "%s: %s", userdn, authzmsg);
   }
   /* close the session */
-  myldap_session_close(session);
+  myldap_bind_session_close(session);
   /* return results */
   return rc;
 }
@@ -735,8 +735,8 @@ static int try_pwmod(MYLDAP_SESSION *oldsession,
   MYLDAP_SESSION *session;
   char buffer[BUFLEN_MESSAGE];
   int rc;
-  /* set up a new connection */
-  session = myldap_create_session();
+  /* set up a new connection (or get one from the pool) */
+  session = myldap_create_bind_session();
   if (session == NULL)
     return LDAP_UNAVAILABLE;
   /* perform a BIND operation */
@@ -766,7 +766,7 @@ static int try_pwmod(MYLDAP_SESSION *oldsession,
     }
   }
   /* close the session */
-  myldap_session_close(session);
+  myldap_bind_session_close(session);
   /* return */
   return rc;
 }
@@ -875,6 +875,8 @@ int nslcd_pam_pwmod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
     memset(newpassword, 0, sizeof(newpassword));
     return 0;
   }
+  /* the cached responses for the user are outdated now */
+  passwd_invalidate(entry, username);
   /* write response */
   log_log(LOG_NOTICE, "password changed for %s", myldap_get_dn(entry));
   WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
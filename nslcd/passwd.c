@@ -118,10 +118,88 @@ static int mkfilter_passwd_byuid(uid_t uid, char *buffer, size_t buflen)
   }
 }
 
+/* The cache that is used in dn2uid() is split into a number of shards,
+   each with its own lock, so that threads that are expanding groups
+   concurrently do not all wait for the same lock. The entries of each
+   shard are also kept in a linked list with the most recently used entry
+   at the head so the least recently used entries can be removed when the
+   cache grows beyond cache_dn2uid_maxentries. */
+#define DN2UID_CACHE_SHARDS 16
+struct dn2uid_cache_entry {
+  struct dn2uid_cache_entry *prev; /* more recently used entry */
+  struct dn2uid_cache_entry *next; /* less recently used entry */
+  time_t timestamp;
+  char *uid;
+  const char *dn;           /* the key, allocated after the structure */
+};
+struct dn2uid_cache_shard {
+  pthread_mutex_t mutex;
+  DICT *dict;
+  struct dn2uid_cache_entry *head;
+  struct dn2uid_cache_entry *tail;
+  int num;                  /* number of entries in the shard */
+  time_t nextsweep;         /* time to remove expired entries */
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long evictions;
+};
+static struct dn2uid_cache_shard dn2uid_cache[DN2UID_CACHE_SHARDS];
+
+/* return the shard of the cache that holds the DN */
+static struct dn2uid_cache_shard *dn2uid_cache_shard(const char *dn)
+{
+  /* use the high bits because the dictionary uses the low bits */
+  return &dn2uid_cache[(dict_hash(dn, DICT_DN) >> 24) % DN2UID_CACHE_SHARDS];
+}
+
+/* remove the entry from the linked list of the shard */
+static void dn2uid_cache_unlink(struct dn2uid_cache_shard *shard,
+                                struct dn2uid_cache_entry *cacheentry)
+{
+  if (cacheentry->prev != NULL)
+    cacheentry->prev->next = cacheentry->next;
+  else
+    shard->head = cacheentry->next;
+  if (cacheentry->next != NULL)
+    cacheentry->next->prev = cacheentry->prev;
+  else
+    shard->tail = cacheentry->prev;
+}
+
+/* add the entry to the head of the linked list of the shard */
+static void dn2uid_cache_link(struct dn2uid_cache_shard *shard,
+                              struct dn2uid_cache_entry *cacheentry)
+{
+  cacheentry->prev = NULL;
+  cacheentry->next = shard->head;
+  if (shard->head != NULL)
+    shard->head->prev = cacheentry;
+  else
+    shard->tail = cacheentry;
+  shard->head = cacheentry;
+}
+
+/* remove the entry from the shard and free it, the caller should hold
+   the lock of the shard */
+static void dn2uid_cache_remove(struct dn2uid_cache_shard *shard,
+                                struct dn2uid_cache_entry *cacheentry)
+{
+  (void)dict_del(shard->dict, cacheentry->dn);
+  dn2uid_cache_unlink(shard, cacheentry);
+  if (cacheentry->uid != NULL)
+    free(cacheentry->uid);
+  free(cacheentry);
+  shard->num--;
+  shard->evictions++;
+}
+
 void passwd_init(void)
 {
   int i;
   SET *set;
+  /* set up the dn2uid cache */
+  for (i = 0; i < DN2UID_CACHE_SHARDS; i++)
+    pthread_mutex_init(&dn2uid_cache[i].mutex, NULL);
   /* set up search bases */
   if (passwd_bases[0] == NULL)
     for (i = 0; i < NSS_LDAP_CONFIG_MAX_BASES; i++)
@@ -159,14 +237,6 @@ void passwd_init(void)
   set_free(set);
 }
 
-/* the cache that is used in dn2uid() */
-static pthread_mutex_t dn2uid_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
-static DICT *dn2uid_cache = NULL;
-struct dn2uid_cache_entry {
-  time_t timestamp;
-  char *uid;
-};
-
 /* checks whether the entry has a valid uidNumber attribute
    (>= nss_min_uid) */
 static int entry_has_valid_uid(MYLDAP_ENTRY *entry)
@@ -220,29 +290,17 @@ static int entry_has_valid_uid(MYLDAP_ENTRY *entry)
   return 0;
 }
 
-/* Perform an LDAP lookup to translate the DN into a uid.
-   This function either returns NULL or a strdup()ed string. */
-char *lookup_dn2uid(MYLDAP_SESSION *session, const char *dn, int *rcp,
-                    char *buf, size_t buflen)
+/* the attributes that are requested when translating a DN into a uid */
+static const char *dn2uid_attrs[3];
+
+/* Get the uid from the result of the search for the DN.
+   This function either returns NULL or buf. The search is closed. */
+static char *dn2uid_result(MYLDAP_SEARCH *search, const char *dn, int *rcp,
+                           char *buf, size_t buflen)
 {
-  MYLDAP_SEARCH *search;
   MYLDAP_ENTRY *entry;
-  static const char *attrs[3];
-  int rc = LDAP_SUCCESS;
   const char **values;
   char *uid = NULL;
-  if (rcp == NULL)
-    rcp = &rc;
-  /* we have to look up the entry */
-  attrs[0] = attmap_passwd_uid;
-  attrs[1] = attmap_passwd_uidNumber;
-  attrs[2] = NULL;
-  search = myldap_search(session, dn, LDAP_SCOPE_BASE, passwd_filter, attrs, rcp);
-  if (search == NULL)
-  {
-    log_log(LOG_WARNING, "%s: lookup error: %s", dn, ldap_err2string(*rcp));
-    return NULL;
-  }
   entry = myldap_get_entry(search, rcp);
   if (entry == NULL)
   {
@@ -268,33 +326,58 @@ char *lookup_dn2uid(MYLDAP_SESSION *session, const char *dn, int *rcp,
   return uid;
 }
 
-/* Translate the DN into a user name. This function tries several aproaches
-   at getting the user name, including looking in the DN for a uid attribute,
-   looking in the cache and falling back to looking up a uid attribute in a
-   LDAP query. */
-char *dn2uid(MYLDAP_SESSION *session, const char *dn, char *buf, size_t buflen)
+/* Perform an LDAP lookup to translate the DN into a uid.
+   This function either returns NULL or a strdup()ed string. */
+char *lookup_dn2uid(MYLDAP_SESSION *session, const char *dn, int *rcp,
+                    char *buf, size_t buflen)
 {
+  MYLDAP_SEARCH *search;
+  int rc = LDAP_SUCCESS;
+  if (rcp == NULL)
+    rcp = &rc;
+  /* we have to look up the entry */
+  dn2uid_attrs[0] = attmap_passwd_uid;
+  dn2uid_attrs[1] = attmap_passwd_uidNumber;
+  dn2uid_attrs[2] = NULL;
+  search = myldap_search(session, dn, LDAP_SCOPE_BASE, passwd_filter,
+                         dn2uid_attrs, rcp);
+  if (search == NULL)
+  {
+    log_log(LOG_WARNING, "%s: lookup error: %s", dn, ldap_err2string(*rcp));
+    return NULL;
+  }
+  return dn2uid_result(search, dn, rcp, buf, buflen);
+}
+
+/* Try to translate the DN into a user name without performing an LDAP
+   search by looking in the DN for a uid attribute and looking in the cache.
+   Returns 1 if the answer is known (*uid is set to buf or NULL) and 0 if
+   an LDAP search is needed. */
+static int dn2uid_quick(const char *dn, char *buf, size_t buflen, char **uid)
+{
+  struct dn2uid_cache_shard *shard;
   struct dn2uid_cache_entry *cacheentry = NULL;
-  char *uid;
+  *uid = NULL;
   /* check for empty string */
   if ((dn == NULL) || (*dn == '\0'))
-    return NULL;
+    return 1;
   /* try to look up uid within DN string */
   if (myldap_cpy_rdn_value(dn, attmap_passwd_uid, buf, buflen) != NULL)
   {
     /* check if it is valid */
-    if (!isvalidname(buf))
-      return NULL;
-    return buf;
+    if (isvalidname(buf))
+      *uid = buf;
+    return 1;
   }
-  /* if we don't use the cache, just lookup and return */
+  /* if we don't use the cache, we need to do a lookup */
   if ((nslcd_cfg->cache_dn2uid_positive == 0) && (nslcd_cfg->cache_dn2uid_negative == 0))
-    return lookup_dn2uid(session, dn, NULL, buf, buflen);
+    return 0;
   /* see if we have a cached entry */
-  pthread_mutex_lock(&dn2uid_cache_mutex);
-  if (dn2uid_cache == NULL)
-    dn2uid_cache = dict_new();
-  if ((dn2uid_cache != NULL) && ((cacheentry = dict_get(dn2uid_cache, dn)) != NULL))
+  shard = dn2uid_cache_shard(dn);
+  pthread_mutex_lock(&shard->mutex);
+  if (shard->dict == NULL)
+    shard->dict = dict_new_flags(DICT_DN);
+  if ((shard->dict != NULL) && ((cacheentry = dict_get(shard->dict, dn)) != NULL))
   {
     if ((cacheentry->uid != NULL) && (strlen(cacheentry->uid) < buflen))
     {
@@ -303,8 +386,12 @@ char *dn2uid(MYLDAP_SESSION *session, const char *dn, char *buf, size_t buflen)
           (time(NULL) < (cacheentry->timestamp + nslcd_cfg->cache_dn2uid_positive)))
       {
         strcpy(buf, cacheentry->uid);
-        pthread_mutex_unlock(&dn2uid_cache_mutex);
-        return buf;
+        *uid = buf;
+        dn2uid_cache_unlink(shard, cacheentry);
+        dn2uid_cache_link(shard, cacheentry);
+        shard->hits++;
+        pthread_mutex_unlock(&shard->mutex);
+        return 1;
       }
     }
     else
@@ -313,33 +400,100 @@ char *dn2uid(MYLDAP_SESSION *session, const char *dn, char *buf, size_t buflen)
       if ((nslcd_cfg->cache_dn2uid_negative > 0) &&
            (time(NULL) < (cacheentry->timestamp + nslcd_cfg->cache_dn2uid_negative)))
       {
-        pthread_mutex_unlock(&dn2uid_cache_mutex);
-        return NULL;
+        dn2uid_cache_unlink(shard, cacheentry);
+        dn2uid_cache_link(shard, cacheentry);
+        shard->hits++;
+        pthread_mutex_unlock(&shard->mutex);
+        return 1;
       }
     }
   }
-  pthread_mutex_unlock(&dn2uid_cache_mutex);
-  /* look up the uid using an LDAP query */
-  uid = lookup_dn2uid(session, dn, NULL, buf, buflen);
-  /* store the result in the cache */
-  pthread_mutex_lock(&dn2uid_cache_mutex);
+  shard->misses++;
+  pthread_mutex_unlock(&shard->mutex);
+  return 0;
+}
+
+/* remove the expired entries from the shard of the cache, the caller
+   should hold the lock of the shard */
+static void dn2uid_cache_sweep(struct dn2uid_cache_shard *shard, time_t now)
+{
+  struct dn2uid_cache_entry *cacheentry, *next;
+  time_t ttl;
+  for (cacheentry = shard->head; cacheentry != NULL; cacheentry = next)
+  {
+    next = cacheentry->next;
+    ttl = (cacheentry->uid != NULL) ? nslcd_cfg->cache_dn2uid_positive
+                                    : nslcd_cfg->cache_dn2uid_negative;
+    if (now >= (cacheentry->timestamp + ttl))
+      dn2uid_cache_remove(shard, cacheentry);
+  }
+}
+
+/* store the result of the lookup of the DN in the cache */
+static void dn2uid_cache_store(const char *dn, const char *uid)
+{
+  struct dn2uid_cache_shard *shard;
+  struct dn2uid_cache_entry *cacheentry;
+  time_t now;
+  int maxentries;
+  if ((nslcd_cfg->cache_dn2uid_positive == 0) && (nslcd_cfg->cache_dn2uid_negative == 0))
+    return;
+  shard = dn2uid_cache_shard(dn);
+  pthread_mutex_lock(&shard->mutex);
+  if (shard->dict == NULL)
+  {
+    pthread_mutex_unlock(&shard->mutex);
+    return;
+  }
+  /* regularly remove expired entries so the cache does not keep growing */
+  now = time(NULL);
+  if (now >= shard->nextsweep)
+  {
+    dn2uid_cache_sweep(shard, now);
+    shard->nextsweep = now + ((nslcd_cfg->cache_dn2uid_positive > nslcd_cfg->cache_dn2uid_negative) ?
+                              nslcd_cfg->cache_dn2uid_positive : nslcd_cfg->cache_dn2uid_negative);
+  }
   /* try to get the entry from the cache here again because it could have
      changed in the meantime */
-  cacheentry = dict_get(dn2uid_cache, dn);
+  cacheentry = dict_get(shard->dict, dn);
   if (cacheentry == NULL)
   {
+    /* make room by removing the least recently used entries */
+    if (nslcd_cfg->cache_dn2uid_maxentries > 0)
+    {
+      maxentries = (nslcd_cfg->cache_dn2uid_maxentries + DN2UID_CACHE_SHARDS - 1) /
+                   DN2UID_CACHE_SHARDS;
+      while ((shard->tail != NULL) && (shard->num >= maxentries))
+        dn2uid_cache_remove(shard, shard->tail);
+    }
     /* allocate a new entry in the cache */
-    cacheentry = (struct dn2uid_cache_entry *)malloc(sizeof(struct dn2uid_cache_entry));
+    cacheentry = (struct dn2uid_cache_entry *)malloc(sizeof(struct dn2uid_cache_entry) + strlen(dn) + 1);
     if (cacheentry != NULL)
     {
       cacheentry->uid = NULL;
-      dict_put(dn2uid_cache, dn, cacheentry);
+      cacheentry->dn = (char *)(cacheentry + 1);
+      strcpy((char *)cacheentry->dn, dn);
+      if (dict_put(shard->dict, dn, cacheentry))
+      {
+        free(cacheentry);
+        cacheentry = NULL;
+      }
+      else
+      {
+        dn2uid_cache_link(shard, cacheentry);
+        shard->num++;
+      }
     }
   }
+  else
+  {
+    dn2uid_cache_unlink(shard, cacheentry);
+    dn2uid_cache_link(shard, cacheentry);
+  }
   /* update the cache entry */
   if (cacheentry != NULL)
   {
-    cacheentry->timestamp = time(NULL);
+    cacheentry->timestamp = now;
     /* copy the uid if needed */
     if (cacheentry->uid == NULL)
       cacheentry->uid = uid != NULL ? strdup(uid) : NULL;
@@ -349,11 +503,110 @@ char *dn2uid(MYLDAP_SESSION *session, const char *dn, char *buf, size_t buflen)
       cacheentry->uid = uid != NULL ? strdup(uid) : NULL;
     }
   }
-  pthread_mutex_unlock(&dn2uid_cache_mutex);
-  /* copy the result into the buffer */
+  pthread_mutex_unlock(&shard->mutex);
+}
+
+void dn2uid_cache_stats(unsigned long *hits, unsigned long *misses,
+                        unsigned long *evictions)
+{
+  int i;
+  *hits = *misses = *evictions = 0;
+  for (i = 0; i < DN2UID_CACHE_SHARDS; i++)
+  {
+    pthread_mutex_lock(&dn2uid_cache[i].mutex);
+    *hits += dn2uid_cache[i].hits;
+    *misses += dn2uid_cache[i].misses;
+    *evictions += dn2uid_cache[i].evictions;
+    pthread_mutex_unlock(&dn2uid_cache[i].mutex);
+  }
+}
+
+/* Translate the DN into a user name. This function tries several aproaches
+   at getting the user name, including looking in the DN for a uid attribute,
+   looking in the cache and falling back to looking up a uid attribute in a
+   LDAP query. */
+char *dn2uid(MYLDAP_SESSION *session, const char *dn, char *buf, size_t buflen)
+{
+  char *uid;
+  int rc = LDAP_SUCCESS;
+  if (dn2uid_quick(dn, buf, buflen, &uid))
+    return uid;
+  /* look up the uid using an LDAP query */
+  uid = lookup_dn2uid(session, dn, &rc, buf, buflen);
+  /* store the result in the cache (but not lookup errors) */
+  if ((uid != NULL) || (rc == LDAP_SUCCESS) || (rc == LDAP_NO_SUCH_OBJECT))
+    dn2uid_cache_store(dn, uid);
   return uid;
 }
 
+/* the maximum number of searches that dn2uids() has outstanding */
+#define DN2UID_PIPELINE 16
+
+void dn2uids(MYLDAP_SESSION *session, const char **dns, int numdns,
+             char **uids)
+{
+  MYLDAP_SEARCH *searches[DN2UID_PIPELINE];
+  char buf[BUFLEN_NAME];
+  char *uid;
+  int *pending;
+  int numpending = 0;
+  int i, j, n;
+  int rc;
+  pending = (int *)malloc((numdns > 0 ? numdns : 1) * sizeof(int));
+  if (pending == NULL)
+  {
+    log_log(LOG_CRIT, "dn2uids(): malloc() failed to allocate memory");
+    for (i = 0; i < numdns; i++)
+      uids[i] = NULL;
+    return;
+  }
+  /* first handle the DNs that do not need an LDAP search */
+  for (i = 0; i < numdns; i++)
+  {
+    if (dn2uid_quick(dns[i], buf, sizeof(buf), &uid))
+      uids[i] = (uid != NULL) ? strdup(uid) : NULL;
+    else
+    {
+      uids[i] = NULL;
+      pending[numpending++] = i;
+    }
+  }
+  /* look up the others, starting a number of searches before reading
+     any results so the server can process them in parallel */
+  dn2uid_attrs[0] = attmap_passwd_uid;
+  dn2uid_attrs[1] = attmap_passwd_uidNumber;
+  dn2uid_attrs[2] = NULL;
+  for (i = 0; i < numpending; i += n)
+  {
+    n = numpending - i;
+    if (n > DN2UID_PIPELINE)
+      n = DN2UID_PIPELINE;
+    for (j = 0; j < n; j++)
+    {
+      searches[j] = myldap_search(session, dns[pending[i + j]],
+                                  LDAP_SCOPE_BASE, passwd_filter,
+                                  dn2uid_attrs, &rc);
+      if (searches[j] == NULL)
+        log_log(LOG_WARNING, "%s: lookup error: %s", dns[pending[i + j]],
+                ldap_err2string(rc));
+    }
+    for (j = 0; j < n; j++)
+    {
+      uid = NULL;
+      rc = LDAP_OPERATIONS_ERROR;
+      if (searches[j] != NULL)
+        uid = dn2uid_result(searches[j], dns[pending[i + j]], &rc,
+                            buf, sizeof(buf));
+      /* only store negative results if the search completed (searches
+         that were dropped because the connection was closed fail) */
+      if ((uid != NULL) || (rc == LDAP_SUCCESS) || (rc == LDAP_NO_SUCH_OBJECT))
+        dn2uid_cache_store(dns[pending[i + j]], uid);
+      uids[pending[i + j]] = (uid != NULL) ? strdup(uid) : NULL;
+    }
+  }
+  free(pending);
+}
+
 MYLDAP_ENTRY *uid2entry(MYLDAP_SESSION *session, const char *uid, int *rcp)
 {
   MYLDAP_SEARCH *search = NULL;
@@ -393,6 +646,34 @@ MYLDAP_ENTRY *uid2entry(MYLDAP_SESSION *session, const char *uid, int *rcp)
   return NULL;
 }
 
+void passwd_invalidate(MYLDAP_ENTRY *entry, const char *username)
+{
+  const char **values;
+  char *tmp;
+  uid_t uid;
+  int i;
+  cache_invalidate(username, (uid_t)-1);
+  shared_invalidate(NSLCD_ACTION_PASSWD_BYNAME, username, strlen(username));
+  /* also remove the responses for all uidNumber values of the entry */
+  values = myldap_get_values_len(entry, attmap_passwd_uidNumber);
+  for (i = 0; (values != NULL) && (values[i] != NULL); i++)
+  {
+    if (uidSid != NULL)
+      uid = (uid_t)binsid2id(values[i]);
+    else
+    {
+      errno = 0;
+      uid = strtouid(values[i], &tmp, 10);
+      if ((*(values[i]) == '\0') || (*tmp != '\0') || (errno != 0))
+        continue;
+    }
+    /* responses are stored for the uid as requested by the client */
+    uid += nslcd_cfg->nss_uid_offset;
+    cache_invalidate(NULL, uid);
+    shared_invalidate(NSLCD_ACTION_PASSWD_BYUID, &uid, sizeof(uid_t));
+  }
+}
+
 char *uid2dn(MYLDAP_SESSION *session, const char *uid, char *buf, size_t buflen)
 {
   MYLDAP_ENTRY *entry;
@@ -413,10 +694,37 @@ char *uid2dn(MYLDAP_SESSION *session, const char *uid, char *buf, size_t buflen)
 /* the maximum number of uidNumber attributes per entry */
 #define MAXUIDS_PER_ENTRY 5
 
+/* write a single passwd entry (without the NSLCD_RESULT_BEGIN) */
+static int write_passwd_entry(TFILE *fp, const char *name, const char *passwd,
+                              uid_t uid, gid_t gid, const char *gecos,
+                              const char *homedir, const char *shell)
+{
+  int32_t tmpint32;
+  WRITE_STRING(fp, name);
+  WRITE_STRING(fp, passwd);
+  WRITE_INT32(fp, uid);
+  WRITE_INT32(fp, gid);
+  WRITE_STRING(fp, gecos);
+  WRITE_STRING(fp, homedir);
+  WRITE_STRING(fp, shell);
+  return 0;
+}
+
+/* return the size of the passwd entry that would be written */
+static size_t passwd_entry_size(const char *name, const char *passwd,
+                                const char *gecos, const char *homedir,
+                                const char *shell)
+{
+  return 7 * sizeof(int32_t) + strlen(name) + strlen(passwd) +
+         strlen(gecos) + strlen(homedir) + strlen(shell);
+}
+
 static int write_passwd(TFILE *fp, MYLDAP_ENTRY *entry, const char *requser,
                         const uid_t *requid, uid_t calleruid)
 {
   int32_t tmpint32;
+  TFILE *mfp;
+  int shared;
   const char **tmpvalues;
   char *tmp;
   const char **usernames;
@@ -443,14 +751,20 @@ static int write_passwd(TFILE *fp, MYLDAP_ENTRY *entry, const char *requser,
   if (myldap_has_objectclass(entry, "shadowAccount") && nsswitch_shadow_uses_ldap())
   {
     passwd = "x";
+    shared = 1;
   }
   else
   {
     passwd = get_userpassword(entry, attmap_passwd_userPassword,
                               passbuffer, sizeof(passbuffer));
+    /* only publish the entry if root gets the same password */
+    shared = (passwd == NULL);
     if ((passwd == NULL) || (calleruid != 0))
       passwd = default_passwd_userPassword;
   }
+  /* only single entry lookups are published in the shared cache */
+  if ((requser == NULL) && (requid == NULL))
+    shared = 0;
   /* get the uids for this entry */
   if (requid != NULL)
   {
@@ -558,13 +872,34 @@ static int write_passwd(TFILE *fp, MYLDAP_ENTRY *entry, const char *requser,
           if (uids[j] >= nslcd_cfg->nss_min_uid)
           {
             WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
-            WRITE_STRING(fp, usernames[i]);
-            WRITE_STRING(fp, passwd);
-            WRITE_INT32(fp, uids[j]);
-            WRITE_INT32(fp, gid);
-            WRITE_STRING(fp, gecos);
-            WRITE_STRING(fp, homedir);
-            WRITE_STRING(fp, shell);
+            /* publish the first entry in the shared cache if it is small */
+            if ((shared) &&
+                ((passwd_entry_size(usernames[i], passwd, gecos, homedir,
+                                    shell) +
+                  ((requser != NULL) ? strlen(requser) : sizeof(uid_t))) <=
+                 SHARED_MAXENTRY) &&
+                ((mfp = shared_open()) != NULL))
+            {
+              shared = 0;
+              if (write_passwd_entry(mfp, usernames[i], passwd, uids[j], gid,
+                                     gecos, homedir, shell))
+              {
+                (void)tio_close(mfp);
+                return -1;
+              }
+              if (requser != NULL)
+              {
+                if (shared_write(fp, mfp, NSLCD_ACTION_PASSWD_BYNAME,
+                                 requser, strlen(requser)))
+                  return -1;
+              }
+              else if (shared_write(fp, mfp, NSLCD_ACTION_PASSWD_BYUID,
+                                    requid, sizeof(uid_t)))
+                return -1;
+            }
+            else if (write_passwd_entry(fp, usernames[i], passwd, uids[j],
+                                        gid, gecos, homedir, shell))
+              return -1;
           }
         }
       }
@@ -573,10 +908,11 @@ static int write_passwd(TFILE *fp, MYLDAP_ENTRY *entry, const char *requser,
   return 0;
 }
 
-NSLCD_HANDLE_UID(
+NSLCD_HANDLE_UID_CACHED(
   passwd, byname, NSLCD_ACTION_PASSWD_BYNAME,
   char name[BUFLEN_NAME];
   char filter[BUFLEN_FILTER];
+  char keybuf[BUFLEN_CACHEKEY];
   READ_STRING(fp, name);
   log_setrequest("passwd=\"%s\"", name);
   if (!isvalidname(name))
@@ -585,14 +921,17 @@ NSLCD_HANDLE_UID(
     return -1;
   }
   nsswitch_check_reload();,
+  cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_PASSWD_BYNAME,
+            "%d %s", calleruid == 0, name),
   mkfilter_passwd_byname(name, filter, sizeof(filter)),
   write_passwd(fp, entry, name, NULL, calleruid)
 )
 
-NSLCD_HANDLE_UID(
+NSLCD_HANDLE_UID_CACHED(
   passwd, byuid, NSLCD_ACTION_PASSWD_BYUID,
   uid_t uid;
   char filter[BUFLEN_FILTER];
+  char keybuf[BUFLEN_CACHEKEY];
   READ_INT32(fp, uid);
   log_setrequest("passwd=%lu", (unsigned long int)uid);
   if (uid < nslcd_cfg->nss_min_uid)
@@ -605,10 +944,197 @@ NSLCD_HANDLE_UID(
     return 0;
   }
   nsswitch_check_reload();,
+  cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_PASSWD_BYUID,
+            "%d %lu", calleruid == 0, (unsigned long int)uid),
   mkfilter_passwd_byuid(uid, filter, sizeof(filter)),
   write_passwd(fp, entry, NULL, &uid, calleruid)
 )
 
+/* check whether the entry has the name as uid value */
+static int entry_has_name(MYLDAP_ENTRY *entry, const char *name)
+{
+  const char **values;
+  int i;
+  values = myldap_get_values(entry, attmap_passwd_uid);
+  for (i = 0; (values != NULL) && (values[i] != NULL); i++)
+    if (STR_CMP(name, values[i]) == 0)
+      return 1;
+  return 0;
+}
+
+/* check whether the entry has a uidNumber value that matches the uid
+   (with nss_uid_offset applied) */
+static int entry_has_uid(MYLDAP_ENTRY *entry, uid_t uid)
+{
+  const char **values;
+  char *tmp;
+  uid_t value;
+  int i;
+  values = myldap_get_values_len(entry, attmap_passwd_uidNumber);
+  for (i = 0; (values != NULL) && (values[i] != NULL); i++)
+  {
+    if (uidSid != NULL)
+      value = (uid_t)binsid2id(values[i]);
+    else
+    {
+      errno = 0;
+      value = strtouid(values[i], &tmp, 10);
+      if ((*(values[i]) == '\0') || (*tmp != '\0') || (errno != 0))
+        continue;
+    }
+    if ((value + nslcd_cfg->nss_uid_offset) == uid)
+      return 1;
+  }
+  return 0;
+}
+
+/* write the passwd entries of the entry for each of the names or uids of
+   the batch request that the entry matches, other names and uids of the
+   entry are left out as with single lookups */
+static int write_passwd_requested(TFILE *fp, MYLDAP_ENTRY *entry,
+                                  int32_t action, const char **values,
+                                  int num, uid_t calleruid)
+{
+  uid_t uid;
+  int i;
+  for (i = 0; i < num; i++)
+  {
+    if (action == NSLCD_ACTION_PASSWD_BYNAMES)
+    {
+      if ((entry_has_name(entry, values[i])) &&
+          (write_passwd(fp, entry, values[i], NULL, calleruid)))
+        return -1;
+    }
+    else
+    {
+      /* the uid offset was removed from the values for the filter */
+      uid = strtouid(values[i], NULL, 10);
+      if (uidSid == NULL)
+        uid += nslcd_cfg->nss_uid_offset;
+      if ((entry_has_uid(entry, uid)) &&
+          (write_passwd(fp, entry, NULL, &uid, calleruid)))
+        return -1;
+    }
+  }
+  return 0;
+}
+
+/* write the passwd entries for a batch request, the values are searched
+   for in as few searches as possible */
+static int write_passwd_batch(TFILE *fp, MYLDAP_SESSION *session,
+                              int32_t action, const char *attr,
+                              const char **values, int num, uid_t calleruid)
+{
+  int32_t tmpint32;
+  MYLDAP_SEARCH *search;
+  MYLDAP_ENTRY *entry;
+  const char *base;
+  char filter[BUFLEN_FILTER];
+  int i, j, n, rc = LDAP_SUCCESS;
+  /* write the response header */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, action);
+  for (i = 0; i < num; i += n)
+  {
+    /* binary objectSid values are built by mkfilter_passwd_byuid() and
+       cannot be combined */
+    if ((action == NSLCD_ACTION_PASSWD_BYUIDS) && (uidSid != NULL))
+    {
+      n = 1;
+      if (mkfilter_passwd_byuid(strtouid(values[i], NULL, 10),
+                                filter, sizeof(filter)))
+        n = -1;
+    }
+    else
+      n = mkfilter_anyof(passwd_filter, attr, values + i, num - i,
+                         filter, sizeof(filter));
+    if (n < 0)
+    {
+      log_log(LOG_ERR, "write_passwd_batch(): filter buffer too small");
+      return -1;
+    }
+    /* perform a search for each search base */
+    for (j = 0; (base = passwd_bases[j]) != NULL; j++)
+    {
+      search = myldap_search(session, base, passwd_scope, filter,
+                             passwd_attrs, NULL);
+      if (search == NULL)
+        return -1;
+      while ((entry = myldap_get_entry(search, &rc)) != NULL)
+      {
+        if (write_passwd_requested(fp, entry, action, values + i, n,
+                                   calleruid))
+          return -1;
+        if ((tio_wpending(fp) > NSLCD_WRITE_BACKLOG) && (tio_flush(fp)))
+          return -1;
+      }
+    }
+    if (rc != LDAP_SUCCESS)
+      return -1;
+  }
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
+
+int nslcd_passwd_bynames(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
+{
+  char **names;
+  int num, i, n, rc;
+  /* read request parameters */
+  num = read_batch(fp, 0, &names);
+  if (num < 0)
+    return -1;
+  log_setrequest("passwd(%d names)", num);
+  /* leave out names that are denied by the validnames option */
+  for (i = n = 0; i < num; i++)
+  {
+    if (isvalidname(names[i]))
+      names[n++] = names[i];
+    else
+      log_log(LOG_WARNING, "\"%s\": request denied by validnames option",
+              names[i]);
+  }
+  nsswitch_check_reload();
+  /* write the entries (split to a separate function so we can ensure the
+     call to free() below in case a write fails) */
+  rc = write_passwd_batch(fp, session, NSLCD_ACTION_PASSWD_BYNAMES,
+                          attmap_passwd_uid, (const char **)names, n,
+                          calleruid);
+  free(names);
+  return rc;
+}
+
+int nslcd_passwd_byuids(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
+{
+  char **uids;
+  uid_t uid;
+  int num, i, n, rc;
+  /* read request parameters */
+  num = read_batch(fp, 1, &uids);
+  if (num < 0)
+    return -1;
+  log_setrequest("passwd(%d uids)", num);
+  /* leave out uids that are ignored by the nss_min_uid option and apply
+     the uid offset (mkfilter_passwd_byuid() does that for objectSid) */
+  for (i = n = 0; i < num; i++)
+  {
+    uid = strtouid(uids[i], NULL, 10);
+    if (uid < nslcd_cfg->nss_min_uid)
+      continue;
+    if (uidSid == NULL)
+      uid -= nslcd_cfg->nss_uid_offset;
+    (void)mysnprintf(uids[n++], BUFLEN_NAME, "%lu", (unsigned long int)uid);
+  }
+  nsswitch_check_reload();
+  /* write the entries (split to a separate function so we can ensure the
+     call to free() below in case a write fails) */
+  rc = write_passwd_batch(fp, session, NSLCD_ACTION_PASSWD_BYUIDS,
+                          attmap_passwd_uidNumber, (const char **)uids, n,
+                          calleruid);
+  free(uids);
+  return rc;
+}
+
 NSLCD_HANDLE_UID(
   passwd, all, NSLCD_ACTION_PASSWD_ALL,
   const char *filter;
@@ -311,10 +311,11 @@ MYLDAP_ENTRY *shadow_uid2entry(MYLDAP_SESSION *session, const char *username,
   return NULL;
 }
 
-NSLCD_HANDLE_UID(
+NSLCD_HANDLE_UID_CACHED(
   shadow, byname, NSLCD_ACTION_SHADOW_BYNAME,
   char name[BUFLEN_NAME];
   char filter[BUFLEN_FILTER];
+  char keybuf[BUFLEN_CACHEKEY];
   READ_STRING(fp, name);
   log_setrequest("shadow=\"%s\"", name);
   if (!isvalidname(name))
@@ -322,6 +323,8 @@ NSLCD_HANDLE_UID(
     log_log(LOG_WARNING, "request denied by validnames option");
     return -1;
   },
+  cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_SHADOW_BYNAME,
+            "%d %s", calleruid == 0, name),
   mkfilter_shadow_byname(name, filter, sizeof(filter)),
   write_shadow(fp, entry, name, calleruid)
 )
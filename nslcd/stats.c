@@ -0,0 +1,217 @@
+/*
+   stats.c - runtime statistics of requests and LDAP searches
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif /* HAVE_STDINT_H */
+#include <time.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "log.h"
+
+/* some older versions of Solaris don't provide CLOCK_MONOTONIC but do have
+   a CLOCK_HIGHRES that has the same properties we need */
+#ifndef CLOCK_MONOTONIC
+#ifdef CLOCK_HIGHRES
+#define CLOCK_MONOTONIC CLOCK_HIGHRES
+#endif /* CLOCK_HIGHRES */
+#endif /* not CLOCK_MONOTONIC */
+
+/* the number of buckets of the request latency histogram */
+#define STATS_BUCKETS 7
+
+/* the upper bounds of the latency buckets in microseconds, the last bucket
+   holds all slower requests */
+static const int32_t stats_bounds[STATS_BUCKETS - 1] = {
+  100, 1000, 10000, 100000, 1000000, 10000000
+};
+
+/* the actions that statistics are kept for */
+static const int32_t stats_actions[] = {
+  NSLCD_ACTION_CONFIG_GET, NSLCD_ACTION_KEEPALIVE, NSLCD_ACTION_PIPELINE,
+  NSLCD_ACTION_STATS, NSLCD_ACTION_ALIAS_BYNAME, NSLCD_ACTION_ALIAS_ALL,
+  NSLCD_ACTION_ETHER_BYNAME, NSLCD_ACTION_ETHER_BYETHER,
+  NSLCD_ACTION_ETHER_ALL, NSLCD_ACTION_GROUP_BYNAME,
+  NSLCD_ACTION_GROUP_BYGID, NSLCD_ACTION_GROUP_BYNAMES,
+  NSLCD_ACTION_GROUP_BYGIDS, NSLCD_ACTION_GROUP_BYMEMBER,
+  NSLCD_ACTION_GROUP_ALL, NSLCD_ACTION_HOST_BYNAME, NSLCD_ACTION_HOST_BYADDR,
+  NSLCD_ACTION_HOST_ALL, NSLCD_ACTION_NETGROUP_BYNAME,
+  NSLCD_ACTION_NETGROUP_EXPAND, NSLCD_ACTION_NETGROUP_INNETGR,
+  NSLCD_ACTION_NETGROUP_ALL, NSLCD_ACTION_NETWORK_BYNAME,
+  NSLCD_ACTION_NETWORK_BYADDR, NSLCD_ACTION_NETWORK_ALL,
+  NSLCD_ACTION_PASSWD_BYNAME, NSLCD_ACTION_PASSWD_BYUID,
+  NSLCD_ACTION_PASSWD_BYNAMES, NSLCD_ACTION_PASSWD_BYUIDS,
+  NSLCD_ACTION_PASSWD_ALL, NSLCD_ACTION_PROTOCOL_BYNAME,
+  NSLCD_ACTION_PROTOCOL_BYNUMBER, NSLCD_ACTION_PROTOCOL_ALL,
+  NSLCD_ACTION_RPC_BYNAME, NSLCD_ACTION_RPC_BYNUMBER, NSLCD_ACTION_RPC_ALL,
+  NSLCD_ACTION_SERVICE_BYNAME, NSLCD_ACTION_SERVICE_BYNUMBER,
+  NSLCD_ACTION_SERVICE_ALL, NSLCD_ACTION_SHADOW_BYNAME,
+  NSLCD_ACTION_SHADOW_ALL, NSLCD_ACTION_PAM_AUTHC, NSLCD_ACTION_PAM_AUTHZ,
+  NSLCD_ACTION_PAM_SESS_O, NSLCD_ACTION_PAM_SESS_C, NSLCD_ACTION_PAM_PWMOD,
+  NSLCD_ACTION_USERMOD
+};
+#define STATS_NUMACTIONS (sizeof(stats_actions) / sizeof(stats_actions[0]))
+
+/* the counters of a single action */
+struct stats_action {
+  unsigned long requests;
+  unsigned long failed;
+  unsigned long latency[STATS_BUCKETS];
+};
+
+/* the counters, these are updated without locking when possible and are
+   read without locking (a slightly inconsistent view is not a problem) */
+static struct stats_action stats_counters[STATS_NUMACTIONS];
+static unsigned long stats_searches = 0;
+static unsigned long stats_searches_failed = 0;
+static time_t stats_started = 0;
+
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+#define STATS_INC(counter)                                                  \
+  (void)__sync_fetch_and_add(&(counter), 1UL)
+#else /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define STATS_INC(counter)                                                  \
+  do {                                                                      \
+    pthread_mutex_lock(&stats_mutex);                                       \
+    (counter)++;                                                            \
+    pthread_mutex_unlock(&stats_mutex);                                     \
+  } while (0)
+#endif /* not HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+
+/* write a counter as two 32-bit values */
+#define WRITE_COUNTER(fp, value)                                            \
+  WRITE_INT32(fp, (int32_t)(((uint64_t)(value)) >> 32));                    \
+  WRITE_INT32(fp, (int32_t)(((uint64_t)(value)) & 0xffffffffUL));
+
+/* write a named counter */
+#define WRITE_NAMED_COUNTER(fp, name, value)                                \
+  WRITE_STRING(fp, name);                                                   \
+  WRITE_COUNTER(fp, value);
+
+/* the number of named counters that are written by nslcd_stats() */
+#define STATS_NUMCOUNTERS 10
+
+void stats_init(void)
+{
+  stats_started = time(NULL);
+}
+
+void stats_request_start(struct timespec *start)
+{
+  if (clock_gettime(CLOCK_MONOTONIC, start))
+    start->tv_sec = start->tv_nsec = 0;
+}
+
+void stats_request_done(int32_t action, int rc, const struct timespec *start)
+{
+  struct timespec now;
+  long usec;
+  unsigned int i;
+  int bucket;
+  /* find the counters for the action */
+  for (i = 0; (i < STATS_NUMACTIONS) && (stats_actions[i] != action); i++)
+    /* nothing */ ;
+  if (i >= STATS_NUMACTIONS)
+    return;
+  STATS_INC(stats_counters[i].requests);
+  if (rc != 0)
+    STATS_INC(stats_counters[i].failed);
+  /* find the latency bucket */
+  if (clock_gettime(CLOCK_MONOTONIC, &now))
+    return;
+  usec = (now.tv_sec - start->tv_sec) * 1000000L +
+         (now.tv_nsec - start->tv_nsec) / 1000L;
+  for (bucket = 0; (bucket < (STATS_BUCKETS - 1)) && (usec >= stats_bounds[bucket]); bucket++)
+    /* nothing */ ;
+  STATS_INC(stats_counters[i].latency[bucket]);
+}
+
+void stats_search(int rc)
+{
+  STATS_INC(stats_searches);
+  if (rc != LDAP_SUCCESS)
+    STATS_INC(stats_searches_failed);
+}
+
+int nslcd_stats(TFILE *fp, MYLDAP_SESSION UNUSED(*session))
+{
+  int32_t tmpint32;
+  unsigned long hits, misses, shared, evictions, used;
+  unsigned long dn2uid_hits, dn2uid_misses, dn2uid_evictions;
+  unsigned int i;
+  int j, num;
+  log_setrequest("stats");
+  log_log(LOG_DEBUG, "nslcd_stats()");
+  cache_stats(&hits, &misses, &shared, &evictions, &used);
+  dn2uid_cache_stats(&dn2uid_hits, &dn2uid_misses, &dn2uid_evictions);
+  /* write the response header */
+  WRITE_INT32(fp, NSLCD_VERSION);
+  WRITE_INT32(fp, NSLCD_ACTION_STATS);
+  WRITE_INT32(fp, NSLCD_RESULT_BEGIN);
+  WRITE_INT32(fp, (int32_t)(time(NULL) - stats_started));
+  /* write the latency buckets */
+  WRITE_INT32(fp, STATS_BUCKETS);
+  for (j = 0; j < (STATS_BUCKETS - 1); j++)
+  {
+    WRITE_INT32(fp, stats_bounds[j]);
+  }
+  /* write the counters */
+  WRITE_INT32(fp, STATS_NUMCOUNTERS);
+  WRITE_NAMED_COUNTER(fp, "ldap_searches", stats_searches);
+  WRITE_NAMED_COUNTER(fp, "ldap_searches_failed", stats_searches_failed);
+  WRITE_NAMED_COUNTER(fp, "cache_hits", hits);
+  WRITE_NAMED_COUNTER(fp, "cache_misses", misses);
+  WRITE_NAMED_COUNTER(fp, "cache_shared", shared);
+  WRITE_NAMED_COUNTER(fp, "cache_evictions", evictions);
+  WRITE_NAMED_COUNTER(fp, "cache_bytes", used);
+  WRITE_NAMED_COUNTER(fp, "dn2uid_hits", dn2uid_hits);
+  WRITE_NAMED_COUNTER(fp, "dn2uid_misses", dn2uid_misses);
+  WRITE_NAMED_COUNTER(fp, "dn2uid_evictions", dn2uid_evictions);
+  /* write the counters of the actions that were requested */
+  for (num = 0, i = 0; i < STATS_NUMACTIONS; i++)
+    if (stats_counters[i].requests > 0)
+      num++;
+  WRITE_INT32(fp, num);
+  for (i = 0; i < STATS_NUMACTIONS; i++)
+  {
+    if (stats_counters[i].requests == 0)
+      continue;
+    /* more actions may have been requested since they were counted */
+    if (num-- <= 0)
+      break;
+    WRITE_INT32(fp, stats_actions[i]);
+    WRITE_COUNTER(fp, stats_counters[i].requests);
+    WRITE_COUNTER(fp, stats_counters[i].failed);
+    for (j = 0; j < STATS_BUCKETS; j++)
+    {
+      WRITE_COUNTER(fp, stats_counters[i].latency[j]);
+    }
+  }
+  WRITE_INT32(fp, NSLCD_RESULT_END);
+  return 0;
+}
@@ -288,6 +288,8 @@ int nslcd_usermod(TFILE *fp, MYLDAP_SESSION *session, uid_t calleruid)
     return 0;
   }
   log_log(LOG_NOTICE, "changed information for %s", myldap_get_dn(entry));
+  /* the cached responses for the user are outdated now */
+  passwd_invalidate(entry, username);
   WRITE_INT32(fp, NSLCD_USERMOD_END);
   WRITE_INT32(fp, NSLCD_RESULT_END);
   return 0;
@@ -22,8 +22,250 @@
 #include "config.h"
 
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif /* HAVE_STDINT_H */
+#include <netinet/in.h>
+
+#include "common.h"
+#include "common/shmcache.h"
 
 int NSS_NAME(enablelookups) = 1;
 
 /* version information about the NSS module */
 char *NSS_NAME(version)[3] = { PACKAGE, VERSION, NULL };
+
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+
+/* the time to wait before trying to set up a kept open connection again
+   after nslcd refused or did not support it */
+#define KEEPALIVE_RETRY 60
+
+/* the connection to nslcd that is kept open for re-use by lookups, the
+   keepalive_inuse flag is atomically set by the thread that is using the
+   connection */
+static TFILE *keepalive_fp = NULL;
+static int keepalive_inuse = 0;
+static pid_t keepalive_pid;
+static dev_t keepalive_dev;
+static ino_t keepalive_ino;
+/* the connection should not be re-used after this time */
+static time_t keepalive_expire;
+/* the time after which a new kept open connection may be set up */
+static time_t keepalive_retry = 0;
+/* half the time nslcd keeps an idle connection open */
+static int keepalive_timeout;
+
+/* request nslcd to keep the connection open, returns the number of seconds
+   an idle connection is kept open or 0 */
+static int keepalive_request(TFILE *fp)
+{
+  int32_t buf[5];
+  buf[0] = htonl((int32_t)NSLCD_VERSION);
+  buf[1] = htonl((int32_t)NSLCD_ACTION_KEEPALIVE);
+  if (tio_write(fp, buf, 2 * sizeof(int32_t)) || tio_flush(fp))
+    return 0;
+  /* read the complete response */
+  if (tio_read(fp, buf, 5 * sizeof(int32_t)))
+    return 0;
+  if ((ntohl(buf[0]) != (int32_t)NSLCD_VERSION) ||
+      (ntohl(buf[1]) != (int32_t)NSLCD_ACTION_KEEPALIVE) ||
+      (ntohl(buf[2]) != (int32_t)NSLCD_RESULT_BEGIN) ||
+      (ntohl(buf[4]) != (int32_t)NSLCD_RESULT_END))
+    return 0;
+  return (int)ntohl(buf[3]);
+}
+
+/* check whether the kept open connection can be re-used */
+static int keepalive_usable(void)
+{
+  struct stat sb;
+  struct pollfd fds[1];
+  int fd = tio_fileno(keepalive_fp);
+  /* the file descriptor should still be our socket (the application may
+     have closed it and opened something else) */
+  if ((fstat(fd, &sb) != 0) || (sb.st_dev != keepalive_dev) ||
+      (sb.st_ino != keepalive_ino))
+    return 0;
+  /* after a fork() the child should not use the parent's connection */
+  if (keepalive_pid != getpid())
+    return 0;
+  /* nslcd may close the connection after it was idle for some time */
+  if (time(NULL) >= keepalive_expire)
+    return 0;
+  /* nothing should be available for reading (this also detects the
+     connection being closed) */
+  fds[0].fd = fd;
+  fds[0].events = POLLIN;
+  if (poll(fds, 1, 0) != 0)
+    return 0;
+  return 1;
+}
+
+/* discard the kept open connection */
+static void keepalive_discard(void)
+{
+  struct stat sb;
+  int fd = tio_fileno(keepalive_fp);
+  /* only close the file descriptor if it is still our socket, otherwise
+     leak the buffers (this should be very rare) */
+  if ((fstat(fd, &sb) == 0) && (sb.st_dev == keepalive_dev) &&
+      (sb.st_ino == keepalive_ino))
+    (void)tio_close(keepalive_fp);
+  keepalive_fp = NULL;
+}
+
+/* the time to wait before trying to map the shared cache file again */
+#define SHMCACHE_RETRY 10
+
+/* the shared cache file that is published by nslcd, the previous mapping
+   is kept after it was invalidated until no other threads can be using it
+   (shmcache_users counts the threads that are doing a lookup) */
+static SHMCACHE *shmcache = NULL;
+static SHMCACHE *shmcache_retired = NULL;
+static int shmcache_users = 0;
+static int shmcache_opening = 0;
+static time_t shmcache_retry = 0;
+
+/* unmap the retired mapping if the calling thread is the only one doing a
+   lookup, threads that start a lookup later only see the new mapping, this
+   should be called with shmcache_opening set */
+static void shmcache_release_retired(void)
+{
+  if ((shmcache_retired != NULL) &&
+      (__sync_fetch_and_add(&shmcache_users, 0) == 1))
+  {
+    shmcache_close(shmcache_retired);
+    shmcache_retired = NULL;
+  }
+}
+
+/* map the new cache file and retire the invalidated mapping, the mapping
+   is not replaced while a previously retired mapping may still be in use */
+static SHMCACHE *shmcache_reopen(void)
+{
+  SHMCACHE *cache;
+  /* only one thread at a time tries to (re-)map the file */
+  if ((time(NULL) < shmcache_retry) ||
+      (!__sync_bool_compare_and_swap(&shmcache_opening, 0, 1)))
+    return NULL;
+  shmcache_retry = time(NULL) + SHMCACHE_RETRY;
+  shmcache_release_retired();
+  if (shmcache_retired != NULL)
+  {
+    __sync_lock_release(&shmcache_opening);
+    return NULL;
+  }
+  cache = shmcache_open(NSLCD_SHMCACHE);
+  shmcache_retired = shmcache;
+  __sync_synchronize();
+  shmcache = cache;
+  /* see if we can get rid of the old mapping right away */
+  shmcache_release_retired();
+  __sync_lock_release(&shmcache_opening);
+  return cache;
+}
+
+/* look up a result in the shared cache that is published by nslcd */
+int nss_shmcache_lookup(int32_t action, const void *key, size_t keylen,
+                        void *buf, size_t buflen)
+{
+  SHMCACHE *cache;
+  int rc = -1;
+  /* register as user before getting the mapping so that it cannot be
+     unmapped while it is being used */
+  (void)__sync_add_and_fetch(&shmcache_users, 1);
+  cache = shmcache;
+  if ((cache == NULL) || (!shmcache_valid(cache)))
+    cache = shmcache_reopen();
+  if (cache != NULL)
+    rc = shmcache_lookup(cache, action, key, keylen, buf, buflen);
+  (void)__sync_sub_and_fetch(&shmcache_users, 1);
+  return rc;
+}
+
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+
+/* get a connection to nslcd for doing a single request */
+TFILE *nss_connection_get(void)
+{
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  TFILE *fp;
+  struct stat sb;
+  int timeout;
+  /* if another thread uses the kept open connection, use a new one */
+  if (!__sync_bool_compare_and_swap(&keepalive_inuse, 0, 1))
+    return nslcd_client_open();
+  /* see if we can re-use the connection */
+  if (keepalive_fp != NULL)
+  {
+    if (keepalive_usable())
+      return keepalive_fp;
+    keepalive_discard();
+  }
+  /* try to set up a new kept open connection */
+  if (time(NULL) >= keepalive_retry)
+  {
+    if ((fp = nslcd_client_open()) == NULL)
+    {
+      __sync_lock_release(&keepalive_inuse);
+      return NULL;
+    }
+    timeout = keepalive_request(fp);
+    if ((timeout > 1) && (fstat(tio_fileno(fp), &sb) == 0))
+    {
+      keepalive_fp = fp;
+      keepalive_pid = getpid();
+      keepalive_dev = sb.st_dev;
+      keepalive_ino = sb.st_ino;
+      keepalive_timeout = timeout / 2;
+      keepalive_expire = time(NULL) + keepalive_timeout;
+      return fp;
+    }
+    /* nslcd does not keep the connection open, don't retry immediately */
+    (void)tio_close(fp);
+    keepalive_retry = time(NULL) + KEEPALIVE_RETRY;
+  }
+  __sync_lock_release(&keepalive_inuse);
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+  return nslcd_client_open();
+}
+
+/* release the connection after the complete response has been read */
+void nss_connection_release(TFILE *fp)
+{
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  /* only the thread that holds keepalive_inuse can have this connection */
+  if (fp == keepalive_fp)
+  {
+    keepalive_expire = time(NULL) + keepalive_timeout;
+    __sync_lock_release(&keepalive_inuse);
+    return;
+  }
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+  (void)tio_close(fp);
+}
+
+/* close the connection without reading the complete response */
+void nss_connection_close(TFILE *fp, int skip)
+{
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+  if (fp == keepalive_fp)
+  {
+    keepalive_discard();
+    __sync_lock_release(&keepalive_inuse);
+    return;
+  }
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+  if (skip)
+    (void)tio_skipall(fp, SKIP_TIMEOUT);
+  (void)tio_close(fp);
+}
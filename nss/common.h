@@ -28,6 +28,7 @@
 
 #include "nslcd.h"
 #include "common/nslcd-prot.h"
+#include "common/shmcache.h"
 #include "compat/attrs.h"
 #include "compat/nss_compat.h"
 
@@ -46,6 +47,27 @@
    connection and reading whatever data that is available */
 #define SKIP_TIMEOUT 500
 
+/* Get a connection to nslcd for doing a single request. This may return a
+   connection that was kept open from an earlier request. */
+TFILE *nss_connection_get(void);
+
+/* Release the connection after the complete response has been read. The
+   connection is kept open for re-use if possible. */
+void nss_connection_release(TFILE *fp);
+
+/* Close the connection without reading the complete response. If skip is
+   set any remaining data is read from connections that are not kept open
+   before closing them. */
+void nss_connection_close(TFILE *fp, int skip);
+
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+/* Look up a result in the shared cache that is published by nslcd. The
+   result is copied to buf and the length is returned or -1 if the result
+   is not in the cache. */
+int nss_shmcache_lookup(int32_t action, const void *key, size_t keylen,
+                        void *buf, size_t buflen);
+#endif /* HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+
 /* These are macros for handling read and write problems, they are
    NSS specific due to the return code so are defined here. They
    genrally close the open file, set an error code and return with
@@ -58,7 +80,7 @@
 
 /* Macro is called to handle errors on read operations. */
 #define ERROR_OUT_READERROR(fp)                                             \
-  (void)tio_close(fp);                                                      \
+  nss_connection_close(fp, 0);                                              \
   fp = NULL;                                                                \
   *errnop = ENOENT;                                                         \
   return NSS_STATUS_UNAVAIL;
@@ -76,9 +98,13 @@
   ERROR_OUT_READERROR(fp)
 
 /* This macro is called if the read status code is not
-   NSLCD_RESULT_BEGIN. */
+   NSLCD_RESULT_BEGIN. If the status code (in tmpint32) is
+   NSLCD_RESULT_END the response has been read completely. */
 #define ERROR_OUT_NOSUCCESS(fp)                                             \
-  (void)tio_close(fp);                                                      \
+  if (tmpint32 == (int32_t)NSLCD_RESULT_END)                                \
+    nss_connection_release(fp);                                             \
+  else                                                                      \
+    nss_connection_close(fp, 0);                                            \
   fp = NULL;                                                                \
   return NSS_STATUS_NOTFOUND;
 
@@ -130,17 +156,83 @@
   NSS_EXTRA_DEFS;                                                           \
   NSS_AVAILCHECK;                                                           \
   NSS_BUFCHECK;                                                             \
-  /* open socket and write request */                                       \
-  NSLCD_REQUEST(fp, action, writefn);                                       \
+  NSS_GETONE_REQUEST(action, writefn, readfn)
+
+/* This macro does the request for NSS_GETONE() above. */
+#define NSS_GETONE_REQUEST(action, writefn, readfn)                         \
+  /* get a connection and write request */                                 \
+  NSLCD_REQUEST_ON(fp, nss_connection_get(), action, writefn);              \
   /* read response */                                                       \
   READ_RESPONSE_CODE(fp);                                                   \
   retv = readfn;                                                            \
-  /* close socket and we're done */                                         \
+  /* release the connection (it can be re-used if there are no more          \
+     results) and we're done */                                             \
+  if (retv == NSS_STATUS_SUCCESS)                                           \
+  {                                                                         \
+    if ((tio_read(fp, &tmpint32, sizeof(int32_t)) == 0) &&                  \
+        (ntohl(tmpint32) == (int32_t)NSLCD_RESULT_END))                     \
+    {                                                                       \
+      nss_connection_release(fp);                                           \
+      return retv;                                                          \
+    }                                                                       \
+  }                                                                         \
   if ((retv == NSS_STATUS_SUCCESS) || (retv == NSS_STATUS_TRYAGAIN))        \
+    nss_connection_close(fp, 1);                                            \
+  return retv;
+
+/* This macro is like NSS_GETONE() above but first tries to find the
+   result in the shared cache that is published by nslcd. The key is the
+   request parameter (with keylen its size). */
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+#define NSS_GETONE_CACHED(action, key, keylen, writefn, readfn)             \
+  TFILE *fp;                                                                \
+  int32_t tmpint32;                                                         \
+  nss_status_t retv;                                                        \
+  uint8_t cachebuf[SHMCACHE_SLOTSIZE];                                      \
+  int cachelen;                                                             \
+  NSS_EXTRA_DEFS;                                                           \
+  NSS_AVAILCHECK;                                                           \
+  NSS_BUFCHECK;                                                             \
+  /* read the result from the shared cache if it is there */               \
+  cachelen = nss_shmcache_lookup(action, key, keylen,                       \
+                                 cachebuf, sizeof(cachebuf));               \
+  if ((cachelen >= 0) &&                                                    \
+      ((fp = tio_memopen(cachebuf, (size_t)cachelen, 0)) != NULL))          \
   {                                                                         \
-    (void)tio_skipall(fp, SKIP_TIMEOUT);                                    \
-    (void)tio_close(fp);                                                    \
+    retv = readfn;                                                          \
+    /* on read errors the stream is closed and we ask nslcd */              \
+    if (retv != NSS_STATUS_UNAVAIL)                                         \
+    {                                                                       \
+      (void)tio_close(fp);                                                  \
+      return retv;                                                          \
+    }                                                                       \
   }                                                                         \
+  NSS_GETONE_REQUEST(action, writefn, readfn)
+#else /* not HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+#define NSS_GETONE_CACHED(action, key, keylen, writefn, readfn)             \
+  NSS_GETONE(action, writefn, readfn)
+#endif /* not HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+
+/* This macro is like NSS_GETONE() above but the readfn reads all results,
+   including the final NSLCD_RESULT_END. The readfn should only close the
+   stream on read errors (returning NSS_STATUS_UNAVAIL). */
+#define NSS_GETALL(action, writefn, readfn)                                 \
+  TFILE *fp;                                                                \
+  int32_t tmpint32;                                                         \
+  nss_status_t retv;                                                        \
+  NSS_EXTRA_DEFS;                                                           \
+  NSS_AVAILCHECK;                                                           \
+  NSS_BUFCHECK;                                                             \
+  /* get a connection and write request */                                 \
+  NSLCD_REQUEST_ON(fp, nss_connection_get(), action, writefn);              \
+  /* read response */                                                       \
+  READ_RESPONSE_CODE(fp);                                                   \
+  retv = readfn;                                                            \
+  /* release the connection and we're done */                               \
+  if (retv == NSS_STATUS_SUCCESS)                                           \
+    nss_connection_release(fp);                                             \
+  else if (retv != NSS_STATUS_UNAVAIL)                                      \
+    nss_connection_close(fp, 1);                                            \
   return retv;
 
 /* This macro generates a simple setent() function body. This closes any
@@ -118,18 +118,18 @@ static nss_status_t read_gids(TFILE *fp, gid_t skipgroup, long int *start,
 nss_status_t NSS_NAME(getgrnam_r)(const char *name, struct group *result,
                                   char *buffer, size_t buflen, int *errnop)
 {
-  NSS_GETONE(NSLCD_ACTION_GROUP_BYNAME,
-             WRITE_STRING(fp, name),
-             read_group(fp, result, buffer, buflen, errnop));
+  NSS_GETONE_CACHED(NSLCD_ACTION_GROUP_BYNAME, name, strlen(name),
+                    WRITE_STRING(fp, name),
+                    read_group(fp, result, buffer, buflen, errnop));
 }
 
 /* get a group entry by numeric gid */
 nss_status_t NSS_NAME(getgrgid_r)(gid_t gid, struct group *result,
                                   char *buffer, size_t buflen, int *errnop)
 {
-  NSS_GETONE(NSLCD_ACTION_GROUP_BYGID,
-             WRITE_INT32(fp, gid),
-             read_group(fp, result, buffer, buflen, errnop));
+  NSS_GETONE_CACHED(NSLCD_ACTION_GROUP_BYGID, &gid, sizeof(gid_t),
+                    WRITE_INT32(fp, gid),
+                    read_group(fp, result, buffer, buflen, errnop));
 }
 
 /* thread-local file pointer to an ongoing request */
@@ -172,12 +172,12 @@ nss_status_t NSS_NAME(initgroups_dyn)(const char *user, gid_t skipgroup,
                                       gid_t **groupsp, long int limit,
                                       int *errnop)
 {
-/* temporarily map the buffer and buflen names so the check in NSS_GETONE
+/* temporarily map the buffer and buflen names so the check in NSS_GETALL
    for validity of the buffer works (renaming the parameters may cause
    confusion) */
 #define buffer groupsp
 #define buflen *size
-  NSS_GETONE(NSLCD_ACTION_GROUP_BYMEMBER,
+  NSS_GETALL(NSLCD_ACTION_GROUP_BYMEMBER,
              WRITE_STRING(fp, user),
              read_gids(fp, skipgroup, start, size, groupsp, limit, errnop));
 #undef buffer
@@ -250,7 +250,7 @@ static nss_status_t group_getgroupsbymember(nss_backend_t UNUSED(*be), void *arg
   struct nss_groupsbymem *argp = (struct nss_groupsbymem *)args;
   long int start = (long int)argp->numgids;
   gid_t skipgroup = (start > 0) ? argp->gid_array[0] : (gid_t)-1;
-  NSS_GETONE(NSLCD_ACTION_GROUP_BYMEMBER,
+  NSS_GETALL(NSLCD_ACTION_GROUP_BYMEMBER,
              WRITE_STRING(fp, argp->username),
              read_gids(fp, skipgroup, &start, NULL, (gid_t **)&argp->gid_array,
                        argp->maxgids, &NSS_ARGS(args)->erange);
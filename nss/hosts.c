@@ -43,7 +43,7 @@
 
 #undef ERROR_OUT_READERROR
 #define ERROR_OUT_READERROR(fp)                                             \
-  (void)tio_close(fp);                                                      \
+  nss_connection_close(fp, 0);                                              \
   fp = NULL;                                                                \
   *errnop = ENOENT;                                                         \
   *h_errnop = NO_RECOVERY;                                                  \
@@ -128,7 +128,7 @@ static nss_status_t read_hostent(TFILE *fp, struct hostent *result,
     {
       *errnop = ENOENT;
       *h_errnop = NO_ADDRESS;
-      (void)tio_close(fp);
+      nss_connection_close(fp, 0);
       return NSS_STATUS_NOTFOUND;
     }
     /* skip to the next entry */
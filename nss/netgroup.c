@@ -89,6 +89,32 @@ static nss_status_t read_netgrent_line(TFILE *fp, struct __netgrent *result,
   return NSS_STATUS_UNAVAIL;
 }
 
+/* read the response to the innetgr request */
+static nss_status_t read_innetgr(TFILE *fp, int *errnop)
+{
+  int32_t tmpint32;
+  SKIP_STRING(fp); /* netgroup name */
+  return NSS_STATUS_SUCCESS;
+}
+
+/* ask nslcd whether the host, user and domain are a member of the
+   netgroup (NULL values match any value), this returns
+   NSS_STATUS_NOTFOUND if they are not */
+static nss_status_t innetgr_request(const char *netgroup, const char *host,
+                                    const char *user, const char *domain,
+                                    int *errnop)
+{
+  TFILE *fp;
+  int32_t tmpint32;
+  nss_status_t retv;
+  NSS_GETONE_REQUEST(NSLCD_ACTION_NETGROUP_INNETGR,
+                     WRITE_STRING(fp, netgroup);
+                     WRITE_STRING(fp, host);
+                     WRITE_STRING(fp, user);
+                     WRITE_STRING(fp, domain),
+                     read_innetgr(fp, errnop));
+}
+
 #ifdef NSS_FLAVOUR_GLIBC
 
 /* thread-local file pointer to an ongoing request */
@@ -108,8 +134,9 @@ nss_status_t NSS_NAME(setnetgrent)(const char *group,
   /* check parameter */
   if ((group == NULL) || (group[0] == '\0'))
     return NSS_STATUS_UNAVAIL;
-  /* open a new stream and write the request */
-  NSLCD_REQUEST(netgrentfp, NSLCD_ACTION_NETGROUP_BYNAME,
+  /* open a new stream and write the request (nslcd resolves the nested
+     netgroups so only triples are returned) */
+  NSLCD_REQUEST(netgrentfp, NSLCD_ACTION_NETGROUP_EXPAND,
                 WRITE_STRING(netgrentfp, group));
   /* read response code */
   READ_RESPONSE_CODE(netgrentfp);
@@ -158,6 +185,19 @@ nss_status_t NSS_NAME(endnetgrent)(struct __netgrent UNUSED(*result))
   NSS_ENDENT(netgrentfp);
 }
 
+/* check whether the host, user and domain are a member of the netgroup
+   without going over all the triples of the netgroup */
+nss_status_t NSS_NAME(innetgr)(const char *netgroup, const char *host,
+                               const char *user, const char *domain,
+                               int *errnop)
+{
+  NSS_AVAILCHECK;
+  /* check parameter */
+  if ((netgroup == NULL) || (netgroup[0] == '\0'))
+    return NSS_STATUS_UNAVAIL;
+  return innetgr_request(netgroup, host, user, domain, errnop);
+}
+
 #endif /* NSS_FLAVOUR_GLIBC */
 
 #ifdef NSS_FLAVOUR_SOLARIS
@@ -206,8 +246,9 @@ static nss_status_t start_netgroup_request(struct setnetgrent_backend *be,
   if ((group == NULL) || (group[0] == '\0'))
     return NSS_STATUS_UNAVAIL;
   set_add(be->seen_groups, group);
-  /* open a new stream and write the request */
-  NSLCD_REQUEST(NETGROUP_BE(be)->fp, NSLCD_ACTION_NETGROUP_BYNAME,
+  /* open a new stream and write the request (nslcd resolves the nested
+     netgroups so only triples are returned) */
+  NSLCD_REQUEST(NETGROUP_BE(be)->fp, NSLCD_ACTION_NETGROUP_EXPAND,
                 WRITE_STRING(NETGROUP_BE(be)->fp, group));
   /* read response code */
   READ_RESPONSE_CODE(NETGROUP_BE(be)->fp);
@@ -355,9 +396,7 @@ static nss_status_t netgroup_innetgr(nss_backend_t UNUSED(*be),
                                      void *args)
 {
   unsigned int i;
-  nss_status_t res = NSS_SUCCESS;
-  struct nss_setnetgrent_args set_args;
-  struct nss_getnetgrent_args get_args;
+  nss_status_t res;
   const char *host = NULL, *user = NULL, *domain = NULL;
   /* get the host, user and domain arguments */
   if ((args == NULL) ||
@@ -375,37 +414,17 @@ static nss_status_t netgroup_innetgr(nss_backend_t UNUSED(*be),
   INNETGR_ARGS(args)->status = NSS_NETGR_NO;
   for (i = 0; i < INNETGR_ARGS(args)->groups.argc; i++)
   {
-    /* prepare calling {set,get,end}netgrent() */
-    set_args.netgroup = INNETGR_ARGS(args)->groups.argv[i];
-    res = netgroup_setnetgrent_constructor(NULL, &set_args);
-    if (res != NSS_SUCCESS)
-      break;
-    /* we skip setnetgrent because it does nothing in our case */
-    /* call getnetgrent until we find an error, no more or a match */
-    while (1)
+    res = innetgr_request(INNETGR_ARGS(args)->groups.argv[i],
+                          host, user, domain, &errno);
+    if (res == NSS_STATUS_SUCCESS)
     {
-      res = netgroup_setnetgrent_getnetgrent(set_args.iterator, &get_args);
-      /* see if we have an error or are at the end of the results */
-      if ((res != NSS_SUCCESS) || (get_args.status != NSS_NETGR_FOUND))
-        break;
-      /* see if we have a match */
-      if (((host == NULL) || (strcmp(host, get_args.retp[NSS_NETGR_MACHINE]) == 0)) &&
-          ((user == NULL) || (strcmp(user, get_args.retp[NSS_NETGR_USER]) == 0)) &&
-          ((domain == NULL) || (strcmp(domain, get_args.retp[NSS_NETGR_DOMAIN]) == 0)))
-      {
-        INNETGR_ARGS(args)->status = NSS_NETGR_FOUND;
-        break;
-      }
-    }
-    (void)netgroup_setnetgrent_endnetgrent(set_args.iterator, NULL);
-    (void)netgroup_setnetgrent_destructor(set_args.iterator, NULL);
-    if (res != NSS_SUCCESS)
-      break;
-    /* check if we have a match */
-    if (INNETGR_ARGS(args)->status == NSS_NETGR_FOUND)
+      INNETGR_ARGS(args)->status = NSS_NETGR_FOUND;
       break;
+    }
+    else if (res != NSS_STATUS_NOTFOUND)
+      return res;
   }
-  return res;
+  return NSS_SUCCESS;
 }
 
 static nss_backend_op_t netgroup_ops[] = {
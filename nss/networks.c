@@ -43,7 +43,7 @@
 
 #undef ERROR_OUT_READERROR
 #define ERROR_OUT_READERROR(fp)                                             \
-  (void)tio_close(fp);                                                      \
+  nss_connection_close(fp, 0);                                              \
   fp = NULL;                                                                \
   *errnop = ENOENT;                                                         \
   *h_errnop = NO_RECOVERY;                                                  \
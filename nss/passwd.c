@@ -57,18 +57,18 @@ static nss_status_t read_passwd(TFILE *fp, struct passwd *result,
 nss_status_t NSS_NAME(getpwnam_r)(const char *name, struct passwd *result,
                                   char *buffer, size_t buflen, int *errnop)
 {
-  NSS_GETONE(NSLCD_ACTION_PASSWD_BYNAME,
-             WRITE_STRING(fp, name),
-             read_passwd(fp, result, buffer, buflen, errnop));
+  NSS_GETONE_CACHED(NSLCD_ACTION_PASSWD_BYNAME, name, strlen(name),
+                    WRITE_STRING(fp, name),
+                    read_passwd(fp, result, buffer, buflen, errnop));
 }
 
 /* get a single passwd entry by uid */
 nss_status_t NSS_NAME(getpwuid_r)(uid_t uid, struct passwd *result,
                                   char *buffer, size_t buflen, int *errnop)
 {
-  NSS_GETONE(NSLCD_ACTION_PASSWD_BYUID,
-             WRITE_INT32(fp, uid),
-             read_passwd(fp, result, buffer, buflen, errnop));
+  NSS_GETONE_CACHED(NSLCD_ACTION_PASSWD_BYUID, &uid, sizeof(uid_t),
+                    WRITE_INT32(fp, uid),
+                    read_passwd(fp, result, buffer, buflen, errnop));
 }
 
 /* thread-local file pointer to an ongoing request */
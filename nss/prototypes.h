@@ -89,6 +89,7 @@ nss_status_t NSS_NAME(endhostent)(void);
 nss_status_t NSS_NAME(setnetgrent)(const char *group, struct __netgrent *result);
 nss_status_t NSS_NAME(getnetgrent_r)(struct __netgrent *result, char *buffer, size_t buflen, int *errnop);
 nss_status_t NSS_NAME(endnetgrent)(struct __netgrent *result);
+nss_status_t NSS_NAME(innetgr)(const char *netgroup, const char *host, const char *user, const char *domain, int *errnop);
 
 /* networks - network names and numbers */
 nss_status_t NSS_NAME(getnetbyname_r)(const char *name, struct netent *result, char *buffer, size_t buflen, int *errnop, int *h_errnop);
@@ -52,6 +52,19 @@ def validate_name(name):
         raise ValueError('%r: denied by validnames option' % name)
 
 
+# the maximum number of values that are combined in a single search for
+# batch requests
+BATCH_SEARCHSIZE = 100
+
+
+def read_batch(fp, read):
+    """Read the keys of a batch request using the read function."""
+    num = fp.read_int32()
+    if num < 0 or num > constants.NSLCD_BATCH_MAXKEYS:
+        raise ValueError('%d: invalid number of keys in batch request' % num)
+    return [read() for x in range(num)]
+
+
 class Request(object):
     """
     Request handler class. Subclasses are expected to handle actual requests
@@ -88,6 +101,18 @@ class Request(object):
             for values in self.convert(dn, attributes, parameters):
                 yield values
 
+    def get_batch_results(self, attribute, values):
+        """Provide the result entries for a batch request by performing
+        searches for entries that have any of the attribute values."""
+        module = sys.modules[self.__module__]
+        for i in range(0, len(values), BATCH_SEARCHSIZE):
+            search_filter = '(&%s(|%s))' % (module.filter, ''.join(
+                module.attmap.mk_filter(attribute, value)
+                for value in values[i:i + BATCH_SEARCHSIZE]))
+            for dn, attributes in self.search(self.conn, filter=search_filter):
+                for values2 in self.convert(dn, attributes, {}):
+                    yield values2
+
     def handle_request(self, parameters):
         """This method handles the request based on the parameters read
         with read_parameters()."""
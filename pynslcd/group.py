@@ -192,6 +192,30 @@ class GroupByGidRequest(GroupRequest):
         return dict(gidNumber=fp.read_int32())
 
 
+class GroupByNamesRequest(GroupRequest):
+
+    action = constants.NSLCD_ACTION_GROUP_BYNAMES
+
+    def read_parameters(self, fp):
+        names = common.read_batch(fp, fp.read_string)
+        return dict(names=[x for x in names if common.is_valid_name(x)])
+
+    def get_results(self, parameters):
+        return self.get_batch_results('cn', parameters['names'])
+
+
+class GroupByGidsRequest(GroupRequest):
+
+    action = constants.NSLCD_ACTION_GROUP_BYGIDS
+
+    def read_parameters(self, fp):
+        return dict(gidNumbers=common.read_batch(fp, fp.read_int32))
+
+    def get_results(self, parameters):
+        gids = [x - cfg.nss_gid_offset for x in parameters['gidNumbers']]
+        return self.get_batch_results('gidNumber', gids)
+
+
 class GroupByMemberRequest(GroupRequest):
 
     action = constants.NSLCD_ACTION_GROUP_BYMEMBER
@@ -111,6 +111,69 @@ class NetgroupByNameRequest(NetgroupRequest):
         return dict(cn=fp.read_string())
 
 
+class NetgroupExpandRequest(NetgroupRequest):
+
+    action = constants.NSLCD_ACTION_NETGROUP_EXPAND
+
+    def read_parameters(self, fp):
+        return dict(cn=fp.read_string())
+
+    def get_results(self, parameters):
+        name = parameters['cn']
+        triples = []
+        seen_triples = set()
+        seen = set()
+        tocheck = [name]
+        found = False
+        while tocheck:
+            group = tocheck.pop(0)
+            if group in seen:
+                continue
+            seen.add(group)
+            for dn, attributes in self.search(self.conn, parameters=dict(cn=group)):
+                found = found or group == name
+                for triple in attributes['nisNetgroupTriple']:
+                    m = _netgroup_triple_re.match(triple)
+                    if m:
+                        triple = '(%s,%s,%s)' % (
+                            m.group('host').strip(), m.group('user').strip(),
+                            m.group('domain').strip())
+                        if triple not in seen_triples:
+                            seen_triples.add(triple)
+                            triples.append(triple)
+                tocheck.extend(x.strip() for x in attributes['memberNisNetgroup'])
+        if found:
+            yield (name, triples, [])
+
+
+class NetgroupInnetgrRequest(NetgroupExpandRequest):
+
+    action = constants.NSLCD_ACTION_NETGROUP_INNETGR
+
+    def read_parameters(self, fp):
+        return dict(cn=fp.read_string(), host=fp.read_string(),
+                    user=fp.read_string(), domain=fp.read_string())
+
+    def matches(self, parameters, triple):
+        m = _netgroup_triple_re.match(triple)
+        if not m:
+            return False
+        host, user, domain = (m.group(x).strip() for x in ('host', 'user', 'domain'))
+        return ((not parameters['host'] or not host or
+                 parameters['host'].lower() == host.lower()) and
+                (not parameters['user'] or not user or
+                 parameters['user'] == user) and
+                (not parameters['domain'] or not domain or
+                 parameters['domain'].lower() == domain.lower()))
+
+    def handle_request(self, parameters):
+        for name, triples, members in self.get_results(parameters):
+            if any(self.matches(parameters, triple) for triple in triples):
+                self.fp.write_int32(constants.NSLCD_RESULT_BEGIN)
+                self.fp.write_string(name)
+        self.fp.write_int32(constants.NSLCD_RESULT_END)
+
+
 class NetgroupAllRequest(NetgroupRequest):
 
     action = constants.NSLCD_ACTION_NETGROUP_ALL
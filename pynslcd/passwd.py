@@ -127,6 +127,31 @@ class PasswdByUidRequest(PasswdRequest):
         self.fp.write_int32(constants.NSLCD_RESULT_END)
 
 
+class PasswdByNamesRequest(PasswdRequest):
+
+    action = constants.NSLCD_ACTION_PASSWD_BYNAMES
+
+    def read_parameters(self, fp):
+        names = common.read_batch(fp, fp.read_string)
+        return dict(names=[x for x in names if common.is_valid_name(x)])
+
+    def get_results(self, parameters):
+        return self.get_batch_results('uid', parameters['names'])
+
+
+class PasswdByUidsRequest(PasswdRequest):
+
+    action = constants.NSLCD_ACTION_PASSWD_BYUIDS
+
+    def read_parameters(self, fp):
+        return dict(uidNumbers=common.read_batch(fp, fp.read_int32))
+
+    def get_results(self, parameters):
+        uids = [x - cfg.nss_uid_offset for x in parameters['uidNumbers']
+                if x >= cfg.nss_min_uid]
+        return self.get_batch_results('uidNumber', uids)
+
+
 class PasswdAllRequest(PasswdRequest):
 
     action = constants.NSLCD_ACTION_PASSWD_ALL
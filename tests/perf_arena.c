@@ -0,0 +1,199 @@
+/*
+   perf_arena.c - simple benchmark of request-scoped memory allocation
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+/*
+   This simulates the memory allocations that myldap does for a byname
+   lookup (one search and entry) and a bymember lookup (a search for the
+   groups and a search for each member DN) with one malloc() per search,
+   entry and value buffer (as was done before) and with the session arena
+   (searches from the arena and reused after they are closed, the entry
+   embedded in the search and value buffers from a per-search arena that
+   is kept between requests). It
+   reports the number of calls to malloc() and the number of requests per
+   second:
+
+     ./perf_arena [REQUESTS [MEMBERS]]
+
+   This is not run as part of the test suite.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include "common.h"
+
+#include "common/arena.h"
+
+/* approximate sizes of the allocations done by myldap */
+#define SEARCH_SIZE 480
+#define ENTRY_SIZE 216
+#define VALUES_SIZE 64
+
+/* a simulated search, only the fields needed for reuse */
+struct search {
+  size_t size;
+  struct search *free_next;
+  ARENA *entryarena;
+};
+
+static unsigned long mallocs;
+
+/* arenas for entry values that are kept between requests */
+static ARENA *entryarenas[64];
+static int numentryarenas = 0;
+
+static double now(void)
+{
+  struct timeval tv;
+  (void)gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* use the memory so the compiler cannot optimise the allocations away */
+static void touch(void *ptr, size_t size)
+{
+  memset(ptr, 0x42, size);
+}
+
+/* a single search that returns one entry with malloc() and free() */
+static void search_malloc(void)
+{
+  void *search, *entry, *values;
+  assertok((search = malloc(SEARCH_SIZE)) != NULL);
+  assertok((entry = malloc(ENTRY_SIZE)) != NULL);
+  assertok((values = malloc(VALUES_SIZE)) != NULL);
+  mallocs += 3;
+  touch(search, SEARCH_SIZE);
+  touch(entry, ENTRY_SIZE);
+  touch(values, VALUES_SIZE);
+  free(values);
+  free(entry);
+  free(search);
+}
+
+/* a single search that returns one entry with the session arena */
+static void search_arena(ARENA *arena, struct search **freesearches)
+{
+  struct search *search;
+  void *values;
+  if (*freesearches != NULL)
+  {
+    search = *freesearches;
+    *freesearches = search->free_next;
+  }
+  else
+  {
+    assertok((search = (struct search *)arena_alloc(arena, SEARCH_SIZE + ENTRY_SIZE)) != NULL);
+    search->size = SEARCH_SIZE + ENTRY_SIZE;
+    search->entryarena = NULL;
+  }
+  touch(search + 1, SEARCH_SIZE + ENTRY_SIZE - sizeof(struct search));
+  if ((search->entryarena == NULL) && (numentryarenas > 0))
+    search->entryarena = entryarenas[--numentryarenas];
+  else if (search->entryarena == NULL)
+  {
+    assertok((search->entryarena = arena_new(1024)) != NULL);
+    mallocs++;
+  }
+  assertok((values = arena_alloc(search->entryarena, VALUES_SIZE)) != NULL);
+  touch(values, VALUES_SIZE);
+  arena_reset(search->entryarena);
+  /* close the search */
+  search->free_next = *freesearches;
+  *freesearches = search;
+}
+
+/* release the memory of the request in bulk */
+static void cleanup_arena(ARENA *arena, struct search **freesearches)
+{
+  struct search *search;
+  for (search = *freesearches; search != NULL; search = search->free_next)
+  {
+    if (search->entryarena == NULL)
+      continue;
+    if (numentryarenas < 64)
+    {
+      arena_reset(search->entryarena);
+      entryarenas[numentryarenas++] = search->entryarena;
+    }
+    else
+      arena_free(search->entryarena);
+  }
+  *freesearches = NULL;
+  arena_reset(arena);
+}
+
+static void run(const char *name, long requests, int members)
+{
+  ARENA *arena;
+  struct search *freesearches = NULL;
+  double start, elapsed;
+  unsigned long before;
+  long i;
+  int j;
+  /* without the arena */
+  mallocs = 0;
+  start = now();
+  for (i = 0; i < requests; i++)
+    for (j = 0; j <= members; j++)
+      search_malloc();
+  elapsed = now() - start;
+  printf("perf_arena: %-8s malloc: %6.2f mallocs/request %10.0f requests/s\n",
+         name, (double)mallocs / requests, requests / elapsed);
+  /* with the arena */
+  assertok((arena = arena_new(8192)) != NULL);
+  mallocs = 0;
+  before = arena_mallocs(arena);
+  start = now();
+  for (i = 0; i < requests; i++)
+  {
+    for (j = 0; j <= members; j++)
+      search_arena(arena, &freesearches);
+    cleanup_arena(arena, &freesearches);
+  }
+  elapsed = now() - start;
+  mallocs += arena_mallocs(arena) - before;
+  printf("perf_arena: %-8s arena:  %6.2f mallocs/request %10.0f requests/s\n",
+         name, (double)mallocs / requests, requests / elapsed);
+  arena_free(arena);
+  while (numentryarenas > 0)
+    arena_free(entryarenas[--numentryarenas]);
+}
+
+/* the main program... */
+int main(int argc, char *argv[])
+{
+  long requests = 1000000;
+  int members = 20;
+  if (argc > 1)
+    requests = atol(argv[1]);
+  if (argc > 2)
+    members = atoi(argv[2]);
+  run("byname", requests, 0);
+  run("bymember", requests / 10, members);
+  return 0;
+}
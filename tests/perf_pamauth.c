@@ -0,0 +1,161 @@
+/*
+   perf_pamauth.c - simple benchmark of PAM authentication through nslcd
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+/*
+   This sends a number of PAM authentication requests (by default 1000) to
+   a running nslcd from a number of threads (by default 8) and reports the
+   number of authentications per second:
+
+     ./perf_pamauth USERNAME PASSWORD [REQUESTS [THREADS]]
+
+   Run it against nslcd with pam_bind_connections set to 0 and to a
+   positive value to compare authentication with and without pooled
+   connections. This is not run as part of the test suite.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif /* HAVE_STDINT_H */
+#include <sys/time.h>
+
+#include "nslcd.h"
+#include "common/nslcd-prot.h"
+#include "common/tio.h"
+
+/* handle protocol errors by failing the authentication */
+#define ERROR_OUT_OPENERROR                                                 \
+  return -1;
+#define ERROR_OUT_READERROR(fp)                                             \
+  (void)tio_close(fp);                                                      \
+  return -1;
+#define ERROR_OUT_BUFERROR(fp)                                              \
+  ERROR_OUT_READERROR(fp)
+#define ERROR_OUT_WRITEERROR(fp)                                            \
+  ERROR_OUT_READERROR(fp)
+#define ERROR_OUT_NOSUCCESS(fp)                                             \
+  ERROR_OUT_READERROR(fp)
+
+static const char *username;
+static const char *password;
+static int numrequests;
+
+/* perform a single authentication, returns the NSLCD_PAM_* code or -1 */
+static int do_authc(void)
+{
+  TFILE *fp;
+  int32_t tmpint32;
+  int32_t authc;
+  char buffer[1024];
+  NSLCD_REQUEST(fp, NSLCD_ACTION_PAM_AUTHC,
+                WRITE_STRING(fp, username);
+                WRITE_STRING(fp, "perf_pamauth");
+                WRITE_STRING(fp, "");
+                WRITE_STRING(fp, "");
+                WRITE_STRING(fp, "");
+                WRITE_STRING(fp, password));
+  READ_RESPONSE_CODE(fp);
+  READ_INT32(fp, authc);
+  READ_STRING(fp, buffer);
+  READ_INT32(fp, tmpint32);
+  READ_STRING(fp, buffer);
+  (void)tio_close(fp);
+  return (int)authc;
+}
+
+static void *run_authc(void *arg)
+{
+  int *failures = (int *)arg;
+  int i;
+  for (i = 0; i < numrequests; i++)
+    if (do_authc() != NSLCD_PAM_SUCCESS)
+      (*failures)++;
+  return NULL;
+}
+
+static double now(void)
+{
+  struct timeval tv;
+  (void)gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* the main program... */
+int main(int argc, char *argv[])
+{
+  int numthreads = 8;
+  int total = 1000;
+  pthread_t *threads;
+  int *failures;
+  int i, failed = 0;
+  double start, elapsed;
+  if ((argc < 3) || (argc > 5))
+  {
+    fprintf(stderr, "Usage: %s USERNAME PASSWORD [REQUESTS [THREADS]]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  username = argv[1];
+  password = argv[2];
+  if (argc > 3)
+    total = atoi(argv[3]);
+  if (argc > 4)
+    numthreads = atoi(argv[4]);
+  if ((total <= 0) || (numthreads <= 0))
+  {
+    fprintf(stderr, "%s: invalid number of requests or threads\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  numrequests = (total + numthreads - 1) / numthreads;
+  threads = (pthread_t *)malloc(numthreads * sizeof(pthread_t));
+  failures = (int *)calloc(numthreads, sizeof(int));
+  if ((threads == NULL) || (failures == NULL))
+  {
+    fprintf(stderr, "%s: malloc() failed\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  /* start all threads and wait for them to finish */
+  start = now();
+  for (i = 0; i < numthreads; i++)
+    if (pthread_create(&threads[i], NULL, run_authc, &failures[i]))
+    {
+      fprintf(stderr, "%s: pthread_create() failed: %s\n", argv[0], strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  for (i = 0; i < numthreads; i++)
+  {
+    (void)pthread_join(threads[i], NULL);
+    failed += failures[i];
+  }
+  elapsed = now() - start;
+  printf("%d authentications (%d failed) from %d threads in %.3fs: %.1f auth/s\n",
+         numrequests * numthreads, failed, numthreads, elapsed,
+         (numrequests * numthreads) / elapsed);
+  free(threads);
+  free(failures);
+  return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,91 @@
+/*
+   test_arena.c - simple test for the arena module
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+
+#include "common.h"
+
+#include "common/arena.h"
+
+/* allocations should be aligned and not overlap */
+static void test_alloc(void)
+{
+  ARENA *arena;
+  char *ptrs[100];
+  char *str;
+  int i, j;
+  assertok((arena = arena_new(256)) != NULL);
+  assert(arena_mallocs(arena) == 1);
+  for (i = 0; i < 100; i++)
+  {
+    assertok((ptrs[i] = (char *)arena_alloc(arena, i + 1)) != NULL);
+    assert((((size_t)ptrs[i]) % sizeof(void *)) == 0);
+    memset(ptrs[i], i, i + 1);
+  }
+  for (i = 0; i < 100; i++)
+    for (j = 0; j <= i; j++)
+      assert(ptrs[i][j] == (char)i);
+  assert(arena_mallocs(arena) > 1);
+  /* allocations larger than the chunk size */
+  assertok((str = (char *)arena_alloc(arena, 10000)) != NULL);
+  memset(str, 'x', 10000);
+  assertok((str = arena_strdup(arena, "test value")) != NULL);
+  assertstreq(str, "test value");
+  arena_free(arena);
+}
+
+/* resetting the arena should keep the first chunk */
+static void test_reset(void)
+{
+  ARENA *arena;
+  unsigned long mallocs;
+  char *ptr1, *ptr2;
+  int i;
+  assertok((arena = arena_new(1024)) != NULL);
+  ptr1 = (char *)arena_alloc(arena, 100);
+  assert(ptr1 != NULL);
+  /* fill the arena so new chunks are needed */
+  for (i = 0; i < 100; i++)
+    assert(arena_alloc(arena, 100) != NULL);
+  arena_reset(arena);
+  mallocs = arena_mallocs(arena);
+  /* the same memory is handed out again without calling malloc() */
+  ptr2 = (char *)arena_alloc(arena, 100);
+  assert(ptr1 == ptr2);
+  for (i = 0; i < 5; i++)
+    assert(arena_alloc(arena, 100) != NULL);
+  assert(arena_mallocs(arena) == mallocs);
+  arena_free(arena);
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  test_alloc();
+  test_reset();
+  return 0;
+}
@@ -0,0 +1,311 @@
+/*
+   test_cache.c - tests for the response cache
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+#include "nslcd/common.h"
+#include "nslcd/cfg.h"
+#include "nslcd/log.h"
+
+/* get the current amount of memory used by the cache */
+static unsigned long cache_used(void)
+{
+  unsigned long hits, misses, shared, evictions, used;
+  cache_stats(&hits, &misses, &shared, &evictions, &used);
+  return used;
+}
+
+/* get the number of entries that were evicted from the cache */
+static unsigned long cache_evicted(void)
+{
+  unsigned long hits, misses, shared, evictions, used;
+  cache_stats(&hits, &misses, &shared, &evictions, &used);
+  return evictions;
+}
+
+/* get the number of responses that were shared between requests */
+static unsigned long cache_numshared(void)
+{
+  unsigned long hits, misses, shared, evictions, used;
+  cache_stats(&hits, &misses, &shared, &evictions, &used);
+  return shared;
+}
+
+/* write a passwd response with the specified number of entries (only the
+   uid is written) */
+static void write_response(TFILE *fp, int num)
+{
+  int32_t values[3];
+  int i;
+  values[0] = NSLCD_VERSION;
+  values[1] = NSLCD_ACTION_PASSWD_BYNAME;
+  assert(tio_write(fp, values, 2 * sizeof(int32_t)) == 0);
+  for (i = 0; i < num; i++)
+  {
+    values[0] = NSLCD_RESULT_BEGIN;
+    values[1] = 1000 + i;
+    assert(tio_write(fp, values, 2 * sizeof(int32_t)) == 0);
+  }
+  values[0] = NSLCD_RESULT_END;
+  assert(tio_write(fp, values, sizeof(int32_t)) == 0);
+}
+
+/* check that the responses that are stored are written for the same
+   request and that empty responses are cached separately */
+static void test_negative(void)
+{
+  char keybuf[BUFLEN_CACHEKEY];
+  const char *key;
+  TFILE *fp;
+  const void *data;
+  size_t len;
+  key = cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_PASSWD_BYNAME,
+                  "%d %s", 0, "negative");
+  assert(key != NULL);
+  /* empty responses are not cached when cache_negative is 0 */
+  nslcd_cfg->cache_negative[LM_PASSWD] = 0;
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(cache_write(fp, key) == 0);
+  write_response(fp, 0);
+  cache_store(fp, NSLCD_ACTION_PASSWD_BYNAME, key);
+  (void)tio_close(fp);
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(cache_write(fp, key) == 0);
+  cache_done(fp);
+  (void)tio_close(fp);
+  assert(cache_used() == 0);
+  /* with cache_negative set they are */
+  nslcd_cfg->cache_negative[LM_PASSWD] = 60;
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(cache_write(fp, key) == 0);
+  write_response(fp, 0);
+  cache_store(fp, NSLCD_ACTION_PASSWD_BYNAME, key);
+  (void)tio_close(fp);
+  assert(cache_used() > 0);
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(cache_write(fp, key) == 1);
+  data = tio_memdata(fp, &len);
+  assert(len == 3 * sizeof(int32_t));
+  assert(((const int32_t *)data)[2] == NSLCD_RESULT_END);
+  (void)tio_close(fp);
+  /* positive responses use the other timeout */
+  nslcd_cfg->cache_positive[LM_PASSWD] = 0;
+  cache_invalidate("negative", (uid_t)-1);
+  assert(cache_used() == 0);
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(cache_write(fp, key) == 0);
+  write_response(fp, 2);
+  cache_store(fp, NSLCD_ACTION_PASSWD_BYNAME, key);
+  (void)tio_close(fp);
+  assert(cache_used() == 0);
+  nslcd_cfg->cache_positive[LM_PASSWD] = 60;
+}
+
+/* check that the memory that is used by the entries is accounted for */
+static void test_size(void)
+{
+  char keybuf1[BUFLEN_CACHEKEY], keybuf2[BUFLEN_CACHEKEY];
+  const char *key1, *key2;
+  char data[100];
+  unsigned long size;
+  memset(data, 'x', sizeof(data));
+  key1 = cache_key(keybuf1, sizeof(keybuf1), NSLCD_ACTION_PASSWD_BYNAME,
+                   "%d %s", 1, "size");
+  key2 = cache_key(keybuf2, sizeof(keybuf2), NSLCD_ACTION_PASSWD_BYUID,
+                   "%d %lu", 0, 1234UL);
+  assert((key1 != NULL) && (key2 != NULL));
+  assert(cache_used() == 0);
+  /* the size includes the data and the key */
+  cache_put(key1, data, sizeof(data), 60);
+  size = cache_used();
+  assert(size > (sizeof(data) + strlen(key1)));
+  /* replacing an entry does not change the size */
+  cache_put(key1, data, sizeof(data), 60);
+  assert(cache_used() == size);
+  /* the size depends on the length of the data */
+  cache_put(key2, data, sizeof(data), 60);
+  assert(cache_used() == (2 * size));
+  cache_put(key2, data, 10, 60);
+  assert(cache_used() < (2 * size));
+  /* removed entries are no longer counted */
+  cache_invalidate("size", 1234);
+  assert(cache_used() == 0);
+  /* entries that are larger than the cache are not stored */
+  nslcd_cfg->cache_size = size - 1;
+  cache_put(key1, data, sizeof(data), 60);
+  assert(cache_used() == 0);
+  nslcd_cfg->cache_size = 1024 * 1024;
+}
+
+/* check that the least recently used entries are evicted first */
+static void test_lru(void)
+{
+  const char *keys[] = { "lru a", "lru b", "lru c", "lru d" };
+  char data[100];
+  void *tmp;
+  size_t len;
+  unsigned long size, evictions;
+  memset(data, 'x', sizeof(data));
+  assert(cache_used() == 0);
+  cache_put(keys[0], data, sizeof(data), 60);
+  size = cache_used();
+  /* make room for exactly three entries */
+  nslcd_cfg->cache_size = 3 * size;
+  cache_put(keys[1], data, sizeof(data), 60);
+  cache_put(keys[2], data, sizeof(data), 60);
+  assert(cache_used() == 3 * size);
+  /* use the first entry so the second is the least recently used */
+  tmp = cache_get(keys[0], &len);
+  assert(tmp != NULL);
+  assert(len == sizeof(data));
+  free(tmp);
+  evictions = cache_evicted();
+  cache_put(keys[3], data, sizeof(data), 60);
+  assert(cache_evicted() == evictions + 1);
+  assert(cache_used() == 3 * size);
+  assert(cache_get(keys[1], &len) == NULL);
+  tmp = cache_get(keys[0], &len);
+  assert(tmp != NULL);
+  free(tmp);
+  tmp = cache_get(keys[2], &len);
+  assert(tmp != NULL);
+  free(tmp);
+  tmp = cache_get(keys[3], &len);
+  assert(tmp != NULL);
+  free(tmp);
+  /* make everything else fall out of the cache */
+  nslcd_cfg->cache_size = size;
+  cache_put(keys[3], data, sizeof(data), 60);
+  assert(cache_used() == size);
+  assert(cache_get(keys[0], &len) == NULL);
+  assert(cache_get(keys[2], &len) == NULL);
+  nslcd_cfg->cache_size = 1024 * 1024;
+}
+
+/* the data that is passed to the waiting thread */
+struct waiter_args {
+  const char *key;
+  int rc;
+  size_t len;
+};
+
+/* look up the key while another thread is doing the search */
+static void *waiter(void *arg)
+{
+  struct waiter_args *args = (struct waiter_args *)arg;
+  TFILE *fp;
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(fp != NULL);
+  args->rc = cache_write(fp, args->key);
+  (void)tio_memdata(fp, &args->len);
+  (void)tio_close(fp);
+  return NULL;
+}
+
+/* check that concurrent requests for the same key wait for the first
+   request and get the same response */
+static void test_singleflight(void)
+{
+  char keybuf[BUFLEN_CACHEKEY];
+  struct waiter_args args;
+  pthread_t thread;
+  TFILE *fp;
+  size_t len;
+  unsigned long shared, used;
+  /* responses are shared even if they are not cached */
+  nslcd_cfg->cache_positive[LM_PASSWD] = 0;
+  args.key = cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_PASSWD_BYNAME,
+                       "%d %s", 0, "shared");
+  assert(args.key != NULL);
+  shared = cache_numshared();
+  used = cache_used();
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(cache_write(fp, args.key) == 0);
+  assertok(pthread_create(&thread, NULL, waiter, &args) == 0);
+  /* give the other thread time to start waiting */
+  usleep(200000);
+  write_response(fp, 3);
+  cache_store(fp, NSLCD_ACTION_PASSWD_BYNAME, args.key);
+  (void)tio_memdata(fp, &len);
+  assertok(pthread_join(thread, NULL) == 0);
+  assert(args.rc == 1);
+  assert(args.len == len);
+  assert(cache_numshared() == shared + 1);
+  (void)tio_close(fp);
+  assert(cache_used() == used);
+  /* a failed search is also reported to the waiting thread */
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(cache_write(fp, args.key) == 0);
+  assertok(pthread_create(&thread, NULL, waiter, &args) == 0);
+  usleep(200000);
+  cache_done(fp);
+  assertok(pthread_join(thread, NULL) == 0);
+  assert(args.rc == -1);
+  assert(args.len == 0);
+  (void)tio_close(fp);
+  /* the next request does the search itself */
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(cache_write(fp, args.key) == 0);
+  cache_done(fp);
+  (void)tio_close(fp);
+  nslcd_cfg->cache_positive[LM_PASSWD] = 60;
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  char *srcdir;
+  char fname[100];
+  /* build the name of the file */
+  srcdir = getenv("srcdir");
+  if (srcdir == NULL)
+    srcdir = ".";
+  snprintf(fname, sizeof(fname), "%s/nslcd-test.conf", srcdir);
+  fname[sizeof(fname) - 1] = '\0';
+  /* ensure that file is not world readable for configuration parsing to
+     succeed */
+  (void)chmod(fname, (mode_t)0660);
+  /* initialize configuration */
+  cfg_init(fname);
+  /* partially initialize logging */
+  log_setdefaultloglevel(LOG_DEBUG);
+  /* set up the cache */
+  nslcd_cfg->cache_size = 1024 * 1024;
+  nslcd_cfg->cache_positive[LM_PASSWD] = 60;
+  nslcd_cfg->cache_negative[LM_PASSWD] = 60;
+  /* run the tests */
+  test_negative();
+  test_size();
+  test_lru();
+  test_singleflight();
+  return 0;
+}
@@ -208,7 +208,7 @@ static void test_read(void)
           "filter group (&(objeclClass=posixGroup)(gid=1*))\n"
           "\n"
           "scope passwd one\n"
-          "cache dn2uid 10m 1s\n");
+          "cache dn2uid 10m 1s maxentries 1000\n");
   fclose(fp);
   /* parse the file */
   cfg_defaults(&cfg);
@@ -230,6 +230,7 @@ static void test_read(void)
   assert(passwd_scope == LDAP_SCOPE_ONELEVEL);
   assert(cfg.cache_dn2uid_positive == 10 * 60);
   assert(cfg.cache_dn2uid_negative == 1);
+  assert(cfg.cache_dn2uid_maxentries == 1000);
   /* remove temporary file */
   remove("temp.cfg");
 }
@@ -23,9 +23,12 @@
 #include "config.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <sys/stat.h>
 
+#include "common.h"
+
 #include "nslcd/common.h"
 #include "nslcd/cfg.h"
 #include "nslcd/log.h"
@@ -44,6 +47,32 @@ static void test_isvalidname(void)
   assert(isvalidname("(foo bar)"));
 }
 
+static void test_mkfilter_anyof(void)
+{
+  char buffer[200];
+  const char *values[] = {"cn=a,dc=test", "cn=b*(x),dc=test", "cn=c,dc=test"};
+  /* a single value gives a simple filter */
+  assert(mkfilter_anyof("(objectClass=posixGroup)", "member", values, 1,
+                        buffer, sizeof(buffer)) == 1);
+  assertstreq(buffer, "(&(objectClass=posixGroup)(member=cn=a,dc=test))");
+  /* multiple values are combined in an OR (and are escaped) */
+  assert(mkfilter_anyof("(objectClass=*)", "member", values, 3,
+                        buffer, sizeof(buffer)) == 3);
+  assertstreq(buffer, "(&(objectClass=*)(|(member=cn=a,dc=test)"
+                      "(member=cn=b\\2a\\28x\\29,dc=test)(member=cn=c,dc=test)))");
+  /* only the values that fit are used */
+  assert(mkfilter_anyof("(objectClass=*)", "member", values, 3,
+                        buffer, 80) == 2);
+  assertstreq(buffer, "(&(objectClass=*)(|(member=cn=a,dc=test)"
+                      "(member=cn=b\\2a\\28x\\29,dc=test)))");
+  assert(mkfilter_anyof("(objectClass=*)", "member", values, 3,
+                        buffer, 45) == 1);
+  assertstreq(buffer, "(&(objectClass=*)(member=cn=a,dc=test))");
+  /* not even a single value fits */
+  assert(mkfilter_anyof("(objectClass=*)", "member", values, 3,
+                        buffer, 20) < 0);
+}
+
 /* the main program... */
 int main(int UNUSED(argc), char UNUSED(*argv[]))
 {
@@ -64,5 +93,6 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   log_setdefaultloglevel(LOG_DEBUG);
   /* run the tests */
   test_isvalidname();
+  test_mkfilter_anyof();
   return 0;
 }
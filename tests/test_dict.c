@@ -26,6 +26,7 @@
 #include <string.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "common/dict.h"
 #include "compat/attrs.h"
@@ -75,6 +76,51 @@ static void test_simple(void)
   free(keys);
 }
 
+/* Test removing entries from the dict. */
+static void test_del(void)
+{
+  DICT *dict;
+  static char *value1 = "value1";
+  static char *value2 = "value2";
+  const char **keys;
+  char buf[80];
+  int i;
+  /* initialize */
+  dict = dict_new();
+  dict_put(dict, "key1", value1);
+  dict_put(dict, "key2", value2);
+  /* remove an existing and a non-existing key */
+  assert(dict_del(dict, "key1") == value1);
+  assert(dict_del(dict, "key1") == NULL);
+  assert(dict_del(dict, "key3") == NULL);
+  assert(dict_get(dict, "key1") == NULL);
+  assert(dict_get(dict, "key2") == value2);
+  /* add and remove a lot of entries */
+  for (i = 0; i < 1000; i++)
+  {
+    sprintf(buf, "test%04d", i);
+    dict_put(dict, buf, value1);
+  }
+  for (i = 0; i < 1000; i += 2)
+  {
+    sprintf(buf, "test%04d", i);
+    assert(dict_del(dict, buf) == value1);
+  }
+  for (i = 0; i < 1000; i++)
+  {
+    sprintf(buf, "test%04d", i);
+    assert(dict_get(dict, buf) == ((i % 2) ? value1 : NULL));
+  }
+  /* the removed keys should not be returned */
+  keys = dict_keys(dict);
+  for (i = 0; keys[i] != NULL; i++)
+    /* nothing */ ;
+  assert(i == 501);
+  /* free stuff */
+  dict_free(dict);
+  free(keys);
+}
+
 /* Test to insert a large number of elements in the dict. */
 static void test_lotsofelements(void)
 {
@@ -177,6 +223,137 @@ static void test_countelements(int num)
   free(keys);
 }
 
+/* Test the comparison of keys in dicts with flags. */
+static void test_flags(void)
+{
+  DICT *dict;
+  static char *value1 = "value1";
+  static char *value2 = "value2";
+  const char **keys;
+  /* a case-insensitive dict */
+  dict = dict_new_flags(DICT_IGNORECASE);
+  dict_put(dict, "Key1", value1);
+  assert(dict_get(dict, "key1") == value1);
+  assert(dict_get(dict, "KEY1") == value1);
+  assert(dict_get(dict, "key 1") == NULL);
+  dict_put(dict, "KEY1", value2);
+  assert(dict_get(dict, "Key1") == value2);
+  /* the key should be stored as it was first added */
+  keys = dict_keys(dict);
+  assert(keys[0] != NULL);
+  assert(strcmp(keys[0], "Key1") == 0);
+  assert(keys[1] == NULL);
+  free(keys);
+  assert(dict_del(dict, "kEy1") == value2);
+  assert(dict_get(dict, "Key1") == NULL);
+  dict_free(dict);
+  /* a dict of DNs */
+  dict = dict_new_flags(DICT_DN);
+  dict_put(dict, "cn=Foo Bar,ou=Groups,dc=example,dc=com", value1);
+  assert(dict_get(dict, "CN=foo bar,OU=groups,DC=Example,DC=COM") == value1);
+  assert(dict_get(dict, " cn = Foo Bar , ou=Groups,  dc=example,dc=com ") == value1);
+  assert(dict_get(dict, "cn=FooBar,ou=Groups,dc=example,dc=com") == NULL);
+  assert(dict_get(dict, "cn=Foo  Bar,ou=Groups,dc=example,dc=com") == NULL);
+  /* escaped characters are not separators */
+  dict_put(dict, "cn=Foo\\, Bar,dc=example,dc=com", value2);
+  assert(dict_get(dict, "cn=foo\\, bar, dc=example, dc=com") == value2);
+  assert(dict_get(dict, "cn=Foo\\,Bar,dc=example,dc=com") == NULL);
+  dict_put(dict, "cn=Foo\\ ,dc=example,dc=com", value2);
+  assert(dict_get(dict, "cn=Foo,dc=example,dc=com") == NULL);
+  assert(dict_get(dict, "cn=foo\\ , dc=example,dc=com") == value2);
+  /* the hash should match for equivalent DNs */
+  assert(dict_hash("cn=Foo, dc=example", DICT_DN) ==
+         dict_hash("CN=foo,DC=EXAMPLE", DICT_DN));
+  dict_free(dict);
+}
+
+/* Test presizing the dict and taking entries out with dict_getany(). */
+static void test_reserve(void)
+{
+  DICT *dict;
+  static char *value1 = "value1";
+  char buf[80];
+  const char *key;
+  int i;
+  /* initialize */
+  dict = dict_new();
+  assert(dict_reserve(dict, 5000) == 0);
+  assert(dict_reserve(dict, 10) == 0);
+  for (i = 0; i < 5000; i++)
+  {
+    sprintf(buf, "test%04d", i);
+    assert(dict_put(dict, buf, value1) == 0);
+  }
+  /* remove all entries one by one */
+  for (i = 0; (key = dict_getany(dict)) != NULL; i++)
+  {
+    assert(dict_get(dict, key) == value1);
+    strcpy(buf, key);
+    assert(dict_del(dict, buf) == value1);
+    assert(dict_get(dict, buf) == NULL);
+  }
+  assert(i == 5000);
+  /* the dict should still be usable */
+  dict_put(dict, "key1", value1);
+  assert(dict_get(dict, "key1") == value1);
+  assert(dict_getany(dict) != NULL);
+  /* free stuff */
+  dict_free(dict);
+}
+
+/* Time storing, looking up and removing a large number of keys. */
+static void test_performance(int num)
+{
+  DICT *dict;
+  char buf[80];
+  int i;
+  clock_t start;
+  /* insert the entries */
+  start = clock();
+  dict = dict_new();
+  for (i = 0; i < num; i++)
+  {
+    sprintf(buf, "user%07d", (int)(((long)i * 611953L) % num));
+    assert(dict_put(dict, buf, &buf) == 0);
+  }
+  printf("test_dict: %d puts: %.3fs\n", num,
+         (double)(clock() - start) / CLOCKS_PER_SEC);
+  /* look up existing and missing keys */
+  start = clock();
+  for (i = 0; i < num; i++)
+  {
+    sprintf(buf, "user%07d", (int)(((long)i * 611953L) % num));
+    assert(dict_get(dict, buf) == &buf);
+    sprintf(buf, "missing%07d", (int)(((long)i * 611953L) % num));
+    assert(dict_get(dict, buf) == NULL);
+  }
+  printf("test_dict: %d gets: %.3fs\n", 2 * num,
+         (double)(clock() - start) / CLOCKS_PER_SEC);
+  /* remove all entries */
+  start = clock();
+  for (i = 0; i < num; i++)
+  {
+    sprintf(buf, "user%07d", (int)(((long)i * 611953L) % num));
+    assert(dict_del(dict, buf) == &buf);
+  }
+  assert(dict_getany(dict) == NULL);
+  printf("test_dict: %d dels: %.3fs\n", num,
+         (double)(clock() - start) / CLOCKS_PER_SEC);
+  dict_free(dict);
+  /* insert the entries in a presized dict */
+  start = clock();
+  dict = dict_new();
+  assert(dict_reserve(dict, num) == 0);
+  for (i = 0; i < num; i++)
+  {
+    sprintf(buf, "user%07d", (int)(((long)i * 611953L) % num));
+    assert(dict_put(dict, buf, &buf) == 0);
+  }
+  printf("test_dict: %d puts (reserved): %.3fs\n", num,
+         (double)(clock() - start) / CLOCKS_PER_SEC);
+  dict_free(dict);
+}
+
 /* the main program... */
 int main(int UNUSED(argc), char UNUSED(*argv[]))
 {
@@ -191,6 +368,7 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   fname[sizeof(fname) - 1] = '\0';
   /* run the tests */
   test_simple();
+  test_del();
   test_lotsofelements();
   test_readelements(fname);
   test_countelements(0);
@@ -200,5 +378,8 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   test_countelements(4);
   test_countelements(10);
   test_countelements(20);
+  test_flags();
+  test_reserve();
+  test_performance(1000000);
   return 0;
 }
@@ -0,0 +1,101 @@
+/*
+   test_group.c - tests for looking up nested groups
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+
+#include "common.h"
+
+/* include group.c to be able to test the static functions */
+#include "nslcd/group.c"
+
+#define TESTDN "cn=testgroup,ou=groups,dc=test,dc=tld"
+
+/* check that parents of groups that could not be searched for are not
+   stored in the cache and that the failure is reported */
+static void test_parents_failed(void)
+{
+  MYLDAP_SESSION *session;
+  TFILE *fp;
+  SET *seen, *tocheck;
+  const char *dns[] = { TESTDN };
+  char keybuf[BUFLEN_CACHEKEY];
+  const char *key;
+  size_t len;
+  session = myldap_create_session();
+  assert(session != NULL);
+  fp = tio_memopen(NULL, 0, 4096);
+  assert(fp != NULL);
+  seen = set_new_flags(SET_DN);
+  tocheck = set_new_flags(SET_DN);
+  assert((seen != NULL) && (tocheck != NULL));
+  /* the search fails so the result is incomplete */
+  assert(write_parents(fp, session, dns, 1, seen, tocheck) == 1);
+  key = cache_key(keybuf, sizeof(keybuf), NSLCD_ACTION_GROUP_BYMEMBER,
+                  "p %s", TESTDN);
+  assert(key != NULL);
+  assert(cache_get(key, &len) == NULL);
+  /* the failure is also passed on for nested lookups */
+  set_add(tocheck, TESTDN);
+  assert(write_nested_parents(fp, session, seen, tocheck) == 1);
+  assert(cache_get(key, &len) == NULL);
+  set_free(seen);
+  set_free(tocheck);
+  (void)tio_close(fp);
+  myldap_session_close(session);
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  char *srcdir;
+  char fname[100];
+  /* build the name of the file */
+  srcdir = getenv("srcdir");
+  if (srcdir == NULL)
+    srcdir = ".";
+  snprintf(fname, sizeof(fname), "%s/nslcd-test.conf", srcdir);
+  fname[sizeof(fname) - 1] = '\0';
+  /* ensure that file is not world readable for configuration parsing to
+     succeed */
+  (void)chmod(fname, (mode_t)0660);
+  /* initialize configuration */
+  cfg_init(fname);
+  /* point to a server that is not listening and fail searches quickly */
+  nslcd_cfg->uris[0].uri = strdup("ldap://127.0.0.1:1/");
+  nslcd_cfg->uris[1].uri = NULL;
+  nslcd_cfg->reconnect_sleeptime = 0;
+  nslcd_cfg->reconnect_retrytime = 0;
+  /* enable caching of group data */
+  nslcd_cfg->cache_size = 1024 * 1024;
+  nslcd_cfg->cache_positive[LM_GROUP] = 600;
+  nslcd_cfg->cache_negative[LM_GROUP] = 600;
+  /* partially initialize logging */
+  log_setdefaultloglevel(LOG_DEBUG);
+  test_parents_failed();
+  return 0;
+}
@@ -0,0 +1,110 @@
+/*
+   test_log.c - simple tests for the logging module
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "nslcd/log.h"
+
+#define NUMTHREADS 4
+#define NUMMESSAGES 1000
+
+/* log a number of messages, the argument is the thread number */
+static void *log_messages(void *arg)
+{
+  int thread = *((int *)arg);
+  int i;
+  log_newsession();
+  for (i = 0; i < NUMMESSAGES; i++)
+  {
+    log_log(LOG_INFO, "thread %d message %d", thread, i);
+    log_log(LOG_DEBUG, "thread %d debug %d", thread, i);
+  }
+  return NULL;
+}
+
+/* log messages from a number of threads with the logger thread and check
+   that all messages from each thread were written in order */
+static void test_threads(const char *logfile)
+{
+  pthread_t threads[NUMTHREADS];
+  int numbers[NUMTHREADS];
+  int next[NUMTHREADS];
+  char line[200];
+  FILE *fp;
+  int i, thread, msg, total = 0;
+  (void)unlink(logfile);
+  log_addlogging_file(LOG_INFO, logfile);
+  log_startlogging();
+  log_startthread();
+  for (i = 0; i < NUMTHREADS; i++)
+  {
+    numbers[i] = i;
+    next[i] = 0;
+    assertok(pthread_create(&threads[i], NULL, log_messages, &numbers[i]) == 0);
+  }
+  for (i = 0; i < NUMTHREADS; i++)
+    assertok(pthread_join(threads[i], NULL) == 0);
+  log_stopthread();
+  /* this is written directly */
+  log_log(LOG_INFO, "done");
+  /* check the written messages */
+  fp = fopen(logfile, "r");
+  assertok(fp != NULL);
+  while (fgets(line, sizeof(line), fp) != NULL)
+  {
+    assert(strstr(line, "DEBUG") == NULL);
+    if (strcmp(line, "nslcd: done\n") == 0)
+      continue;
+    assert(sscanf(strstr(line, "] ") + 2, "thread %d message %d",
+                  &thread, &msg) == 2);
+    assert((thread >= 0) && (thread < NUMTHREADS));
+    assert(msg == next[thread]);
+    next[thread]++;
+    total++;
+  }
+  (void)fclose(fp);
+  assert(total == (NUMTHREADS * NUMMESSAGES));
+  (void)unlink(logfile);
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  char *builddir;
+  char logfile[256];
+  /* the log file is written in the build directory */
+  builddir = getenv("builddir");
+  if (builddir == NULL)
+    builddir = ".";
+  snprintf(logfile, sizeof(logfile), "%s/test_log.log", builddir);
+  logfile[sizeof(logfile) - 1] = '\0';
+  test_threads(logfile);
+  return 0;
+}
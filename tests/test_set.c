@@ -81,5 +81,18 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   set_free(set);
   free(list);
 
+  /* a set of DNs */
+  set = set_new_flags(SET_DN);
+  set_add(set, "cn=Foo,ou=Groups,dc=example,dc=com");
+  assert(set_contains(set, "CN=foo,OU=groups,DC=Example,DC=COM"));
+  assert(set_contains(set, "cn = Foo, ou=Groups , dc=example,dc=com "));
+  assert(!set_contains(set, "cn=Foo Bar,ou=Groups,dc=example,dc=com"));
+  set_add(set, "CN=FOO, OU=GROUPS, DC=EXAMPLE, DC=COM");
+  v = set_pop(set);
+  assert(strcmp(v, "cn=Foo,ou=Groups,dc=example,dc=com") == 0);
+  free((void *)v);
+  assert(set_pop(set) == NULL);
+  set_free(set);
+
   return 0;
 }
@@ -0,0 +1,289 @@
+/*
+   test_shmcache.c - simple tests for the shared memory lookup cache
+   This file is part of the nss-pam-ldapd library.
+
+   Copyright (C) 2026 Arthur de Jong
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 2.1 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+   02110-1301 USA
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "common.h"
+#include "common/shmcache.h"
+#include "compat/attrs.h"
+
+#ifdef HAVE_SYNC_BOOL_COMPARE_AND_SWAP
+
+/* the number of slots in the test cache (all keys collide with this) */
+#define NUMSLOTS 4
+
+/* look up the key and check that the result is the expected value */
+static void assertlookup(SHMCACHE *cache, int32_t action, const char *key,
+                         const char *expected)
+{
+  char buf[SHMCACHE_SLOTSIZE];
+  int len;
+  len = shmcache_lookup(cache, action, key, strlen(key), buf, sizeof(buf));
+  if (expected == NULL)
+  {
+    assert(len == -1);
+    return;
+  }
+  assert(len == (int)strlen(expected));
+  buf[len] = '\0';
+  assertstreq(buf, expected);
+}
+
+/* store the key with the value as result */
+static void store(SHMCACHE *cache, int32_t action, const char *key,
+                  const char *value, time_t expire)
+{
+  shmcache_store(cache, action, key, strlen(key), value, strlen(value),
+                 expire);
+}
+
+/* test creating and opening cache files */
+static void test_open(const char *filename)
+{
+  SHMCACHE *writer, *reader;
+  int fd;
+  (void)unlink(filename);
+  /* opening a missing file fails */
+  assert(shmcache_open(filename) == NULL);
+  /* files that are not cache files are not used */
+  fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  assertok(fd >= 0);
+  assertok(write(fd, "this is not a cache file", 24) == 24);
+  assertok(close(fd) == 0);
+  assert(shmcache_open(filename) == NULL);
+  /* create a file and open it */
+  writer = shmcache_create(filename, NUMSLOTS);
+  assertok(writer != NULL);
+  reader = shmcache_open(filename);
+  assertok(reader != NULL);
+  assert(shmcache_valid(writer));
+  assert(shmcache_valid(reader));
+  /* stored results are seen by the reader */
+  store(writer, 1, "key", "value", time(NULL) + 60);
+  assertlookup(reader, 1, "key", "value");
+  /* creating a new file invalidates the old one */
+  shmcache_close(writer);
+  writer = shmcache_create(filename, NUMSLOTS);
+  assertok(writer != NULL);
+  assert(!shmcache_valid(reader));
+  assertlookup(reader, 1, "key", NULL);
+  shmcache_close(reader);
+  reader = shmcache_open(filename);
+  assertok(reader != NULL);
+  assertlookup(reader, 1, "key", NULL);
+  /* removing the file invalidates it */
+  shmcache_remove(filename);
+  assert(!shmcache_valid(reader));
+  assert(!shmcache_valid(writer));
+  assert(shmcache_open(filename) == NULL);
+  shmcache_close(reader);
+  shmcache_close(writer);
+}
+
+/* test storing and looking up results */
+static void test_lookup(const char *filename)
+{
+  SHMCACHE *cache;
+  char buf[4];
+  time_t expire = time(NULL) + 60;
+  cache = shmcache_create(filename, NUMSLOTS);
+  assertok(cache != NULL);
+  assertlookup(cache, 1, "key1", NULL);
+  store(cache, 1, "key1", "value1", expire);
+  store(cache, 2, "key1", "other1", expire);
+  assertlookup(cache, 1, "key1", "value1");
+  assertlookup(cache, 2, "key1", "other1");
+  assertlookup(cache, 1, "key2", NULL);
+  assertlookup(cache, 1, "key", NULL);
+  /* a new result replaces the old one */
+  store(cache, 1, "key1", "value1b", expire);
+  assertlookup(cache, 1, "key1", "value1b");
+  assertlookup(cache, 2, "key1", "other1");
+  /* empty results can be stored */
+  store(cache, 1, "empty", "", expire);
+  assertlookup(cache, 1, "empty", "");
+  /* results that do not fit in the buffer are not returned */
+  assert(shmcache_lookup(cache, 1, "key1", 4, buf, sizeof(buf)) == -1);
+  shmcache_remove(filename);
+  shmcache_close(cache);
+}
+
+/* test that expired results are not returned */
+static void test_expiry(const char *filename)
+{
+  SHMCACHE *cache;
+  time_t now = time(NULL);
+  cache = shmcache_create(filename, NUMSLOTS);
+  assertok(cache != NULL);
+  store(cache, 1, "old", "value", now - 1);
+  store(cache, 1, "now", "value", now);
+  store(cache, 1, "new", "value", now + 60);
+  assertlookup(cache, 1, "old", NULL);
+  assertlookup(cache, 1, "now", NULL);
+  assertlookup(cache, 1, "new", "value");
+  /* a refreshed result is returned again */
+  store(cache, 1, "old", "value2", now + 60);
+  assertlookup(cache, 1, "old", "value2");
+  shmcache_remove(filename);
+  shmcache_close(cache);
+}
+
+/* test that keys that map to the same slots replace the oldest result */
+static void test_collisions(const char *filename)
+{
+  SHMCACHE *cache;
+  char key[16], value[16];
+  time_t now = time(NULL);
+  int i;
+  cache = shmcache_create(filename, NUMSLOTS);
+  assertok(cache != NULL);
+  /* all keys fit because all slots are probed */
+  for (i = 0; i < NUMSLOTS; i++)
+  {
+    sprintf(key, "key%d", i);
+    sprintf(value, "value%d", i);
+    store(cache, 1, key, value, now + 100 + i);
+  }
+  for (i = 0; i < NUMSLOTS; i++)
+  {
+    sprintf(key, "key%d", i);
+    sprintf(value, "value%d", i);
+    assertlookup(cache, 1, key, value);
+  }
+  /* another key replaces the result that expires first */
+  store(cache, 1, "extra", "value", now + 200);
+  assertlookup(cache, 1, "extra", "value");
+  assertlookup(cache, 1, "key0", NULL);
+  for (i = 1; i < NUMSLOTS; i++)
+  {
+    sprintf(key, "key%d", i);
+    sprintf(value, "value%d", i);
+    assertlookup(cache, 1, key, value);
+  }
+  /* expired results are replaced first */
+  store(cache, 1, "key2", "value2", now - 1);
+  store(cache, 1, "key0", "value0", now + 200);
+  assertlookup(cache, 1, "key0", "value0");
+  assertlookup(cache, 1, "key1", "value1");
+  assertlookup(cache, 1, "key2", NULL);
+  assertlookup(cache, 1, "key3", "value3");
+  assertlookup(cache, 1, "extra", "value");
+  shmcache_remove(filename);
+  shmcache_close(cache);
+}
+
+/* test that results that do not fit in a slot are not stored */
+static void test_oversized(const char *filename)
+{
+  SHMCACHE *cache;
+  char value[SHMCACHE_MAXDATA + 2];
+  time_t expire = time(NULL) + 60;
+  cache = shmcache_create(filename, NUMSLOTS);
+  assertok(cache != NULL);
+  /* the key and the result exactly fill the slot */
+  memset(value, 'x', sizeof(value));
+  value[SHMCACHE_MAXDATA - 3] = '\0';
+  store(cache, 1, "big", value, expire);
+  assertlookup(cache, 1, "big", value);
+  /* one byte too many */
+  value[SHMCACHE_MAXDATA - 3] = 'x';
+  value[SHMCACHE_MAXDATA - 2] = '\0';
+  store(cache, 1, "too", value, expire);
+  assertlookup(cache, 1, "too", NULL);
+  /* the old result is kept if the new one does not fit */
+  store(cache, 1, "big", value, expire);
+  value[SHMCACHE_MAXDATA - 3] = '\0';
+  assertlookup(cache, 1, "big", value);
+  /* keys that are too large are ignored */
+  memset(value, 'x', sizeof(value));
+  value[SHMCACHE_MAXDATA + 1] = '\0';
+  store(cache, 1, value, "", expire);
+  assertlookup(cache, 1, value, NULL);
+  shmcache_remove(filename);
+  shmcache_close(cache);
+}
+
+/* test removing single results from the cache */
+static void test_invalidate(const char *filename)
+{
+  SHMCACHE *writer, *reader;
+  time_t expire = time(NULL) + 60;
+  writer = shmcache_create(filename, NUMSLOTS);
+  assertok(writer != NULL);
+  reader = shmcache_open(filename);
+  assertok(reader != NULL);
+  store(writer, 1, "key1", "value1", expire);
+  store(writer, 1, "key2", "value2", expire);
+  store(writer, 2, "key1", "other1", expire);
+  shmcache_invalidate(writer, 1, "key1", 4);
+  assertlookup(reader, 1, "key1", NULL);
+  assertlookup(reader, 1, "key2", "value2");
+  assertlookup(reader, 2, "key1", "other1");
+  /* invalidating missing keys does nothing */
+  shmcache_invalidate(writer, 1, "key1", 4);
+  shmcache_invalidate(writer, 1, "key3", 4);
+  assertlookup(reader, 1, "key2", "value2");
+  /* the key can be stored again */
+  store(writer, 1, "key1", "value1b", expire);
+  assertlookup(reader, 1, "key1", "value1b");
+  shmcache_remove(filename);
+  shmcache_close(reader);
+  shmcache_close(writer);
+}
+
+/* the main program... */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  char *builddir;
+  char filename[256];
+  /* the cache file is written in the build directory */
+  builddir = getenv("builddir");
+  if (builddir == NULL)
+    builddir = ".";
+  snprintf(filename, sizeof(filename), "%s/test_shmcache.cache", builddir);
+  filename[sizeof(filename) - 1] = '\0';
+  test_open(filename);
+  test_lookup(filename);
+  test_expiry(filename);
+  test_collisions(filename);
+  test_oversized(filename);
+  test_invalidate(filename);
+  return 0;
+}
+
+#else /* not HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
+
+/* the shared cache is not available, skip the test */
+int main(int UNUSED(argc), char UNUSED(*argv[]))
+{
+  return 77;
+}
+
+#endif /* not HAVE_SYNC_BOOL_COMPARE_AND_SWAP */
@@ -351,6 +351,93 @@ static void test_timeout_writer(void)
   assertok(fclose(rfp) == 0);
 }
 
+/* this test writes to and reads from memory streams */
+static void test_memstream(void)
+{
+  TFILE *wfp, *rfp;
+  uint8_t buf[20];
+  const void *data;
+  size_t len;
+  int i, j;
+  /* write some blocks to a memory stream */
+  assertok((wfp = tio_memopen(NULL, 0, 4 * sizeof(buf))) != NULL);
+  for (i = 0; i < 4; i++)
+  {
+    for (j = 0; j < (int)sizeof(buf); j++)
+      buf[j] = (uint8_t)(i * sizeof(buf) + j);
+    assertok(tio_write(wfp, buf, sizeof(buf)) == 0);
+  }
+  /* writing beyond the maximum size should fail */
+  assertok(tio_write(wfp, buf, 1) != 0);
+  assert(errno == ENOBUFS);
+  /* flushing should keep the data */
+  assertok(tio_flush(wfp) == 0);
+  data = tio_memdata(wfp, &len);
+  assert(len == 4 * sizeof(buf));
+  for (j = 0; j < (int)len; j++)
+    assert(((const uint8_t *)data)[j] == (uint8_t)j);
+  /* read the data back from another memory stream */
+  assertok((rfp = tio_memopen(data, len, 0)) != NULL);
+  assert(tio_rpending(rfp) == 4 * sizeof(buf));
+  for (i = 0; i < 4; i++)
+  {
+    assertok(tio_read(rfp, buf, sizeof(buf)) == 0);
+    for (j = 0; j < (int)sizeof(buf); j++)
+      assert(buf[j] == (uint8_t)(i * sizeof(buf) + j));
+  }
+  assert(tio_rpending(rfp) == 0);
+  /* reading beyond the end should fail */
+  assertok(tio_read(rfp, buf, 1) != 0);
+  /* close the streams */
+  assertok(tio_close(rfp) == 0);
+  assertok(tio_close(wfp) == 0);
+}
+
+/* test keeping the data written after a mark */
+static void test_wmark(void)
+{
+  int sp[2];
+  FILE *rfp;
+  TFILE *wfp;
+  uint8_t buf[20];
+  const void *data;
+  size_t len;
+  int i, j;
+  /* set up the socket pair */
+  assertok(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+  assertok((rfp = fdopen(sp[0], "rb")) != NULL);
+  assertok((wfp = tio_fdopen(sp[1], 1000, 1000, 2 * 1024, 4 * 1024,
+                             2 * sizeof(buf), 8 * sizeof(buf))) != NULL);
+  /* data written before the mark is not returned */
+  memset(buf, 0xff, sizeof(buf));
+  assertok(tio_write(wfp, buf, 3) == 0);
+  tio_wmark(wfp);
+  /* write more than the initial buffer size, the buffer should grow */
+  for (i = 0; i < 4; i++)
+  {
+    for (j = 0; j < (int)sizeof(buf); j++)
+      buf[j] = (uint8_t)(i * sizeof(buf) + j);
+    assertok(tio_write(wfp, buf, sizeof(buf)) == 0);
+  }
+  data = tio_wmarked(wfp, &len);
+  assert(data != NULL);
+  assert(len == 4 * sizeof(buf));
+  for (j = 0; j < (int)len; j++)
+    assert(((const uint8_t *)data)[j] == (uint8_t)j);
+  /* the mark is only returned once */
+  assert(tio_wmarked(wfp, &len) == NULL);
+  assert(tio_wpending(wfp) == 3 + 4 * sizeof(buf));
+  /* flushing the data clears the mark */
+  tio_wmark(wfp);
+  assertok(tio_write(wfp, buf, sizeof(buf)) == 0);
+  assertok(tio_flush(wfp) == 0);
+  assert(tio_wmarked(wfp, &len) == NULL);
+  assert(tio_wpending(wfp) == 0);
+  /* close the files */
+  assertok(tio_close(wfp) == 0);
+  assertok(fclose(rfp) == 0);
+}
+
 /* the main program... */
 int main(int UNUSED(argc), char UNUSED(*argv[]))
 {
@@ -369,5 +456,8 @@ int main(int UNUSED(argc), char UNUSED(*argv[]))
   /* test timeout functionality */
   test_timeout_reader();
   test_timeout_writer();
+  /* test memory streams */
+  test_memstream();
+  test_wmark();
   return 0;
 }
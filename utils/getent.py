@@ -27,7 +27,7 @@ import struct
 import sys
 
 from cmdline import VersionAction
-from nslcd import NslcdClient
+from nslcd import NslcdClient, NslcdRequest, lookups, stats
 import constants
 
 
@@ -36,6 +36,7 @@ supported databases:
   aliases, ethers, group, group.bymember, hosts, hostsv4, hostsv6,
   netgroup, netgroup.norec, networks, networksv4, networksv6, passwd,
   protocols, rpc, services, shadow
+  stats (statistics of the running nslcd, keys are not used)
 
 Report bugs to <%s>.
 '''.strip() % constants.PACKAGE_BUGREPORT
@@ -53,6 +54,46 @@ parser.add_argument('keys', metavar='KEY', nargs='*',
                     help='filter returned database values by key')
 
 
+def _batch_requests(action, keys):
+    """Return the requests for looking up the keys with the batch action
+    (numeric keys are sent as numbers)."""
+    requests = []
+    for i in range(0, len(keys), constants.NSLCD_BATCH_MAXKEYS):
+        batch = keys[i:i + constants.NSLCD_BATCH_MAXKEYS]
+        con = NslcdRequest(action)
+        con.write_int32(len(batch))
+        for key in batch:
+            if re.match('^\d+$', key):
+                con.write_int32(int(key))
+            else:
+                con.write_string(key)
+        requests.append(con)
+    return requests
+
+
+def _batch_lookup(keys, byids, bynames, read):
+    """Look up the keys with the batch actions and return the entries that
+    were found for each key or None if nslcd does not support them. The
+    read function should return (name, id, entry) tuples."""
+    ids = [key for key in keys if re.match('^\d+$', key)]
+    names = [key for key in keys if not re.match('^\d+$', key)]
+    found_ids = {}
+    found_names = {}
+    try:
+        requests = (_batch_requests(byids, ids) +
+                    _batch_requests(bynames, names))
+        for con in lookups(requests):
+            for name, num, entry in read(con):
+                found_names.setdefault(name, []).append(entry)
+                found_ids.setdefault(str(num), []).append(entry)
+    except IOError:
+        return None
+    return [
+        found_ids.get(str(int(key)), []) if re.match('^\d+$', key) else
+        found_names.get(key, [])
+        for key in keys]
+
+
 def write_aliases(con):
     while con.get_response() == constants.NSLCD_RESULT_BEGIN:
         print('%-16s%s' % (
@@ -65,9 +106,12 @@ def getent_aliases(database, keys=None):
     if not keys:
         write_aliases(NslcdClient(constants.NSLCD_ACTION_ALIAS_ALL))
         return
+    requests = []
     for key in keys:
-        con = NslcdClient(constants.NSLCD_ACTION_ALIAS_BYNAME)
+        con = NslcdRequest(constants.NSLCD_ACTION_ALIAS_BYNAME)
         con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_aliases(con)
 
 
@@ -82,40 +126,64 @@ def getent_ethers(database, keys=None):
     if not keys:
         write_ethers(NslcdClient(constants.NSLCD_ACTION_ETHER_ALL))
         return
+    requests = []
     for key in keys:
         if re.match('^[0-9a-fA-F]{1,2}(:[0-9a-fA-F]{1,2}){5}$', key):
-            con = NslcdClient(constants.NSLCD_ACTION_ETHER_BYETHER)
+            con = NslcdRequest(constants.NSLCD_ACTION_ETHER_BYETHER)
             con.write_ether(key)
         else:
-            con = NslcdClient(constants.NSLCD_ACTION_ETHER_BYNAME)
+            con = NslcdRequest(constants.NSLCD_ACTION_ETHER_BYNAME)
             con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_ethers(con)
 
 
-def write_group(con):
+def read_group(con):
     while con.get_response() == constants.NSLCD_RESULT_BEGIN:
-        print('%s:%s:%d:%s' % (
+        entry = (
                 con.read_string(),
                 con.read_string(),
                 con.read_int32(),
                 ','.join(con.read_stringlist()),
-            ))
+            )
+        yield entry[0], entry[2], entry
+
+
+def print_group(entries):
+    for entry in entries:
+        print('%s:%s:%d:%s' % entry)
+
+
+def write_group(con):
+    print_group(entry for name, gid, entry in read_group(con))
 
 
 def getent_group(database, keys=None):
     if not keys:
         write_group(NslcdClient(constants.NSLCD_ACTION_GROUP_ALL))
         return
+    if database == 'group' and len(keys) > 1:
+        found = _batch_lookup(
+            keys, constants.NSLCD_ACTION_GROUP_BYGIDS,
+            constants.NSLCD_ACTION_GROUP_BYNAMES, read_group)
+        if found is not None:
+            for entries in found:
+                print_group(entries)
+            return
+    requests = []
     for key in keys:
         if database == 'group.bymember':
-            con = NslcdClient(constants.NSLCD_ACTION_GROUP_BYMEMBER)
+            con = NslcdRequest(constants.NSLCD_ACTION_GROUP_BYMEMBER)
             con.write_string(key)
         elif re.match('^\d+$', key):
-            con = NslcdClient(constants.NSLCD_ACTION_GROUP_BYGID)
+            con = NslcdRequest(constants.NSLCD_ACTION_GROUP_BYGID)
             con.write_int32(int(key))
         else:
-            con = NslcdClient(constants.NSLCD_ACTION_GROUP_BYNAME)
+            con = NslcdRequest(constants.NSLCD_ACTION_GROUP_BYNAME)
             con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_group(con)
 
 
@@ -155,18 +223,21 @@ def getent_hosts(database, keys=None):
     if not keys:
         write_hosts(NslcdClient(constants.NSLCD_ACTION_HOST_ALL), db_af)
         return
+    requests = []
     for key in keys:
         ipv4_addr = _get_ipv4(key)
         ipv6_addr = _get_ipv6(key)
         if ipv4_addr and db_af in (socket.AF_INET, None):
-            con = NslcdClient(constants.NSLCD_ACTION_HOST_BYADDR)
+            con = NslcdRequest(constants.NSLCD_ACTION_HOST_BYADDR)
             con.write_address(socket.AF_INET, ipv4_addr)
         elif ipv6_addr and db_af in (socket.AF_INET6, None):
-            con = NslcdClient(constants.NSLCD_ACTION_HOST_BYADDR)
+            con = NslcdRequest(constants.NSLCD_ACTION_HOST_BYADDR)
             con.write_address(socket.AF_INET6, ipv6_addr)
         else:
-            con = NslcdClient(constants.NSLCD_ACTION_HOST_BYNAME)
+            con = NslcdRequest(constants.NSLCD_ACTION_HOST_BYNAME)
             con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_hosts(con, db_af)
 
 
@@ -243,24 +314,27 @@ def getent_networks(database, keys=None):
     if not keys:
         write_networks(NslcdClient(constants.NSLCD_ACTION_NETWORK_ALL), db_af)
         return
+    requests = []
     for key in keys:
         ipv4_addr = _get_ipv4(key)
         ipv6_addr = _get_ipv6(key)
         if ipv4_addr and db_af in (socket.AF_INET, None):
-            con = NslcdClient(constants.NSLCD_ACTION_NETWORK_BYADDR)
+            con = NslcdRequest(constants.NSLCD_ACTION_NETWORK_BYADDR)
             con.write_address(socket.AF_INET, ipv4_addr)
         elif ipv6_addr and db_af in (socket.AF_INET6, None):
-            con = NslcdClient(constants.NSLCD_ACTION_NETWORK_BYADDR)
+            con = NslcdRequest(constants.NSLCD_ACTION_NETWORK_BYADDR)
             con.write_address(socket.AF_INET6, ipv6_addr)
         else:
-            con = NslcdClient(constants.NSLCD_ACTION_NETWORK_BYNAME)
+            con = NslcdRequest(constants.NSLCD_ACTION_NETWORK_BYNAME)
             con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_networks(con, db_af)
 
 
-def write_passwd(con):
+def read_passwd(con):
     while con.get_response() == constants.NSLCD_RESULT_BEGIN:
-        print('%s:%s:%d:%d:%s:%s:%s' % (
+        entry = (
                 con.read_string(),
                 con.read_string(),
                 con.read_int32(),
@@ -268,20 +342,41 @@ def write_passwd(con):
                 con.read_string(),
                 con.read_string(),
                 con.read_string(),
-            ))
+            )
+        yield entry[0], entry[2], entry
+
+
+def print_passwd(entries):
+    for entry in entries:
+        print('%s:%s:%d:%d:%s:%s:%s' % entry)
+
+
+def write_passwd(con):
+    print_passwd(entry for name, uid, entry in read_passwd(con))
 
 
 def getent_passwd(database, keys=None):
     if not keys:
         write_passwd(NslcdClient(constants.NSLCD_ACTION_PASSWD_ALL))
         return
+    if len(keys) > 1:
+        found = _batch_lookup(
+            keys, constants.NSLCD_ACTION_PASSWD_BYUIDS,
+            constants.NSLCD_ACTION_PASSWD_BYNAMES, read_passwd)
+        if found is not None:
+            for entries in found:
+                print_passwd(entries)
+            return
+    requests = []
     for key in keys:
         if re.match('^\d+$', key):
-            con = NslcdClient(constants.NSLCD_ACTION_PASSWD_BYUID)
+            con = NslcdRequest(constants.NSLCD_ACTION_PASSWD_BYUID)
             con.write_int32(int(key))
         else:
-            con = NslcdClient(constants.NSLCD_ACTION_PASSWD_BYNAME)
+            con = NslcdRequest(constants.NSLCD_ACTION_PASSWD_BYNAME)
             con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_passwd(con)
 
 
@@ -297,13 +392,16 @@ def getent_protocols(database, keys=None):
     if not keys:
         write_protocols(NslcdClient(constants.NSLCD_ACTION_PROTOCOL_ALL))
         return
+    requests = []
     for key in keys:
         if re.match('^\d+$', key):
-            con = NslcdClient(constants.NSLCD_ACTION_PROTOCOL_BYNUMBER)
+            con = NslcdRequest(constants.NSLCD_ACTION_PROTOCOL_BYNUMBER)
             con.write_int32(int(key))
         else:
-            con = NslcdClient(constants.NSLCD_ACTION_PROTOCOL_BYNAME)
+            con = NslcdRequest(constants.NSLCD_ACTION_PROTOCOL_BYNAME)
             con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_protocols(con)
 
 
@@ -319,13 +417,16 @@ def getent_rpc(database, keys=None):
     if not keys:
         write_rpc(NslcdClient(constants.NSLCD_ACTION_RPC_ALL))
         return
+    requests = []
     for key in keys:
         if re.match('^\d+$', key):
-            con = NslcdClient(constants.NSLCD_ACTION_RPC_BYNUMBER)
+            con = NslcdRequest(constants.NSLCD_ACTION_RPC_BYNUMBER)
             con.write_int32(int(key))
         else:
-            con = NslcdClient(constants.NSLCD_ACTION_RPC_BYNAME)
+            con = NslcdRequest(constants.NSLCD_ACTION_RPC_BYNAME)
             con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_rpc(con)
 
 
@@ -342,19 +443,22 @@ def getent_services(database, keys=None):
     if not keys:
         write_services(NslcdClient(constants.NSLCD_ACTION_SERVICE_ALL))
         return
+    requests = []
     for key in keys:
         value = key
         protocol = ''
         if '/' in value:
             value, protocol = value.split('/', 1)
         if re.match('^\d+$', value):
-            con = NslcdClient(constants.NSLCD_ACTION_SERVICE_BYNUMBER)
+            con = NslcdRequest(constants.NSLCD_ACTION_SERVICE_BYNUMBER)
             con.write_int32(int(value))
             con.write_string(protocol)
         else:
-            con = NslcdClient(constants.NSLCD_ACTION_SERVICE_BYNAME)
+            con = NslcdRequest(constants.NSLCD_ACTION_SERVICE_BYNAME)
             con.write_string(value)
             con.write_string(protocol)
+        requests.append(con)
+    for con in lookups(requests):
         write_services(con)
 
 
@@ -381,12 +485,56 @@ def getent_shadow(database, keys=None):
     if not keys:
         write_shadow(NslcdClient(constants.NSLCD_ACTION_SHADOW_ALL))
         return
+    requests = []
     for key in keys:
-        con = NslcdClient(constants.NSLCD_ACTION_SHADOW_BYNAME)
+        con = NslcdRequest(constants.NSLCD_ACTION_SHADOW_BYNAME)
         con.write_string(key)
+        requests.append(con)
+    for con in lookups(requests):
         write_shadow(con)
 
 
+def _latency2str(bound):
+    if bound >= 1000000:
+        return '%ds' % (bound // 1000000)
+    if bound >= 1000:
+        return '%dms' % (bound // 1000)
+    return '%dus' % bound
+
+
+def _ratio2str(part, total):
+    return '%.1f%%' % (100.0 * part / total) if total else '-'
+
+
+def getent_stats(database, keys=None):
+    result = stats()
+    counters = result['counters']
+    print('uptime: %d' % result['uptime'])
+    for name in sorted(counters):
+        print('%s: %d' % (name, counters[name]))
+    print('cache_hit_ratio: %s' % _ratio2str(
+        counters.get('cache_hits', 0) + counters.get('cache_shared', 0),
+        counters.get('cache_hits', 0) + counters.get('cache_shared', 0) +
+        counters.get('cache_misses', 0)))
+    print('dn2uid_hit_ratio: %s' % _ratio2str(
+        counters.get('dn2uid_hits', 0),
+        counters.get('dn2uid_hits', 0) + counters.get('dn2uid_misses', 0)))
+    # find the names of the actions
+    names = dict(
+        (value, name[len('NSLCD_ACTION_'):].lower())
+        for name, value in vars(constants).items()
+        if name.startswith('NSLCD_ACTION_'))
+    bounds = result['buckets'][:-1]
+    buckets = ['<' + _latency2str(bound) for bound in bounds]
+    buckets.append('>=' + _latency2str(bounds[-1]) if bounds else 'all')
+    for action in sorted(result['actions']):
+        requests, failed, latency = result['actions'][action]
+        print('%s: requests=%d failed=%d %s' % (
+            names.get(action, '0x%08x' % action), requests, failed,
+            ' '.join('%s=%d' % (bucket, count)
+                     for bucket, count in zip(buckets, latency))))
+
+
 if __name__ == '__main__':
     args = parser.parse_args()
     try:
@@ -412,6 +560,8 @@ if __name__ == '__main__':
             getent_services(args.database, args.keys)
         elif args.database == 'shadow':
             getent_shadow(args.database, args.keys)
+        elif args.database == 'stats':
+            getent_stats(args.database, args.keys)
         else:
             parser.error('Unknown database: %s' % args.database)
     except struct.error:
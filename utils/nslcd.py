@@ -20,6 +20,7 @@
 # 02110-1301 USA
 
 import fcntl
+import io
 import os
 import socket
 import struct
@@ -31,6 +32,9 @@ import constants
 # definition for reading and writing INT32 values
 _int32 = struct.Struct('!i')
 
+# definition for reading counters (two INT32 values)
+_counter = struct.Struct('!Q')
+
 
 class NslcdClient(object):
 
@@ -91,6 +95,9 @@ class NslcdClient(object):
             value = value.decode('utf-8')
         return value
 
+    def read_counter(self):
+        return _counter.unpack(self.read(_counter.size))[0]
+
     def read_stringlist(self):
         num = self.read_int32()
         return [self.read_string() for x in range(num)]
@@ -133,6 +140,103 @@ class NslcdClient(object):
         self.close()
 
 
+class NslcdRequest(NslcdClient):
+    """Request that is built in memory so that it can be sent over a
+    pipelined connection or the response to such a request."""
+
+    def __init__(self, action, data=None):
+        self.action = action
+        self.fp = io.BytesIO(data or b'')
+        if data is None:
+            self.write_int32(constants.NSLCD_VERSION)
+            self.write_int32(action)
+
+    def getvalue(self):
+        return self.fp.getvalue()
+
+    def send(self):
+        """Send the request over a new connection and return the connection
+        to read the response from."""
+        con = NslcdClient(self.action)
+        con.write(self.getvalue()[2 * _int32.size:])
+        return con
+
+
+class NslcdPipeline(object):
+    """Connection to nslcd over which many requests are sent without
+    waiting for the responses (see NSLCD_ACTION_PIPELINE)."""
+
+    def __init__(self):
+        self.con = NslcdClient(constants.NSLCD_ACTION_PIPELINE)
+        if self.con.get_response() != constants.NSLCD_RESULT_BEGIN:
+            raise IOError('NSLCD protocol error')
+        self.maxrequests = self.con.read_int32()
+        if self.con.read_int32() != constants.NSLCD_RESULT_END:
+            raise IOError('NSLCD protocol error')
+        if self.maxrequests <= 0:
+            raise IOError('NSLCD pipelining not available')
+
+    def _read_response(self, actions, responses):
+        reqid = self.con.read_int32()
+        data = self.con.read_bytes()
+        responses[reqid] = NslcdRequest(actions.pop(reqid), data)
+
+    def requests(self, requests):
+        """Send the NslcdRequest objects and yield the responses in the
+        same order."""
+        actions = {}
+        responses = {}
+        buf = []
+        nextid = 0
+        nextresponse = 0
+        for request in requests:
+            # make room for the request
+            if len(actions) >= self.maxrequests:
+                if buf:
+                    self.con.sock.sendall(b''.join(buf))
+                    buf = []
+                self._read_response(actions, responses)
+            # queue the request
+            data = request.getvalue()
+            buf.append(_int32.pack(nextid) + _int32.pack(len(data)) + data)
+            actions[nextid] = request.action
+            nextid += 1
+            while nextresponse in responses:
+                yield responses.pop(nextresponse)
+                nextresponse += 1
+        if buf:
+            self.con.sock.sendall(b''.join(buf))
+        while nextresponse < nextid:
+            if nextresponse not in responses:
+                self._read_response(actions, responses)
+            else:
+                yield responses.pop(nextresponse)
+                nextresponse += 1
+
+    def close(self):
+        self.con.close()
+
+
+def lookups(requests):
+    """Perform the NslcdRequest objects and yield the connections or
+    responses to read the results from in the same order. A single pipelined
+    connection is used if nslcd supports it."""
+    requests = list(requests)
+    pipeline = None
+    if len(requests) > 1:
+        try:
+            pipeline = NslcdPipeline()
+        except IOError:
+            pass
+    if pipeline:
+        for response in pipeline.requests(requests):
+            yield response
+        pipeline.close()
+    else:
+        for request in requests:
+            yield request.send()
+
+
 def usermod(username, asroot=False, password=None, args=None):
     # open a connection to nslcd
     con = NslcdClient(constants.NSLCD_ACTION_USERMOD)
@@ -155,3 +259,32 @@ def usermod(username, asroot=False, password=None, args=None):
         response[key] = con.read_string()
     # return the response
     return response
+
+
+def stats():
+    """Return the statistics of nslcd as a dictionary with the uptime, the
+    upper bounds of the latency buckets (in microseconds, the last is None),
+    the named counters and a (requests, failed, latency) tuple for each
+    action that was requested."""
+    con = NslcdClient(constants.NSLCD_ACTION_STATS)
+    if con.get_response() != constants.NSLCD_RESULT_BEGIN:
+        raise IOError('NSLCD protocol error')
+    uptime = con.read_int32()
+    num = con.read_int32()
+    buckets = [con.read_int32() for x in range(num - 1)] + [None]
+    counters = {}
+    for x in range(con.read_int32()):
+        name = con.read_string()
+        counters[name] = con.read_counter()
+    actions = {}
+    for x in range(con.read_int32()):
+        action = con.read_int32()
+        requests = con.read_counter()
+        failed = con.read_counter()
+        latency = [con.read_counter() for y in range(num)]
+        actions[action] = (requests, failed, latency)
+    if con.get_response() != constants.NSLCD_RESULT_END:
+        raise IOError('NSLCD protocol error')
+    con.close()
+    return dict(uptime=uptime, buckets=buckets, counters=counters,
+                actions=actions)